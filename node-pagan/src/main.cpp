@@ -12,8 +12,13 @@
 
 #include "napi.h"
 #include "parserFromKSY.h"
+#include "PropertyPath.h"
 #include "TypeSpec.h"
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 class SpecWrap : public Napi::ObjectWrap<SpecWrap> {
 public:
@@ -77,8 +82,29 @@ public:
     }
     return iter->second;
   }
+
+  /**
+   * compiled property path for the segments. The same paths tend to get requested over and over
+   * so they're compiled once per parser. Once MAX_PATHS different paths were requested the cache
+   * starts over
+   */
+  std::shared_ptr<PropertyPath> path(const std::vector<std::string> &segments) {
+    std::lock_guard<std::mutex> guard(m_PathsMutex);
+    auto iter = m_Paths.find(segments);
+    if (iter == m_Paths.end()) {
+      if (m_Paths.size() >= MAX_PATHS) {
+        m_Paths.clear();
+      }
+      iter = m_Paths.emplace(segments, std::make_shared<PropertyPath>(segments)).first;
+    }
+    return iter->second;
+  }
 private:
+  static constexpr size_t MAX_PATHS = 256;
+
   std::map<uint32_t, TypeSpecWrap*> m_Types;
+  std::map<std::vector<std::string>, std::shared_ptr<PropertyPath>> m_Paths;
+  std::mutex m_PathsMutex;
 };
 
 static Napi::String toStringG(const Napi::CallbackInfo& info) {
@@ -221,12 +247,16 @@ public:
 
   static Napi::Value getFromValue(const Napi::CallbackInfo& info, const std::shared_ptr<DynObject>& parent, Napi::Array keys, TypeSpecCatalog* catalog) {
     try {
-      DynObject cur = *parent;
+      if (keys.Length() == 1) {
+        return getFromValue(info, parent, keys.Get(0u).ToString().Utf8Value().c_str(), catalog);
+      }
 
       // all subobject except the last have to be objects
-      for (int i = 0; i < keys.Length() - 1; ++i) {
-        cur = cur.get<DynObject>(keys.Get(i).ToString().Utf8Value().c_str());
+      std::vector<std::string> segments;
+      for (uint32_t i = 0; i < keys.Length() - 1; ++i) {
+        segments.push_back(keys.Get(i).ToString().Utf8Value());
       }
+      DynObject cur = catalog->path(segments)->getObject(*parent);
 
       return getFromValue(info, std::shared_ptr<DynObject>(new DynObject(cur)), keys.Get(keys.Length() - 1).ToString().Utf8Value().c_str(), catalog);
     }
@@ -238,7 +268,8 @@ public:
 private:
 
   static Napi::Value readValue(const Napi::Env &env, TypeId type, char* index, std::shared_ptr<IOWrapper>& data, std::shared_ptr<IOWrapper>& write) {
-    switch (type) {
+    // big endian values are stored in native byte order in the index
+    switch (nativeType(type)) {
     case TypeId::int8: return Napi::Value::From(env, type_read<int8_t>(type, index, data, write, nullptr));
     case TypeId::int16: return Napi::Value::From(env, type_read<int16_t>(type, index, data, write, nullptr));
     case TypeId::int32: return Napi::Value::From(env, type_read<int32_t>(type, index, data, write, nullptr));
@@ -274,7 +305,7 @@ private:
   }
 
   static void setValue(DynObject *obj, uint32_t type, const std::string &key, Napi::Value value) {
-    switch (type) {
+    switch (nativeType(type)) {
     case TypeId::int8: obj->set(key.c_str(), limit<int8_t>(value.ToNumber().Int32Value())); break;
     case TypeId::int16: obj->set(key.c_str(), limit<int16_t>(value.ToNumber().Int32Value())); break;
     case TypeId::int32: obj->set(key.c_str(), limit<int32_t>(value.ToNumber().Int32Value())); break;
@@ -432,6 +463,37 @@ private:
     return Napi::Buffer<uint8_t>::New(info.Env(), &combined[0], combinedSize);
   }
 
+  Napi::Value setProfiling(const Napi::CallbackInfo& info) {
+    if (info.Length() != 1) {
+      throw Napi::Error::New(info.Env(), "Usage: setProfiling(<enabled>)");
+    }
+    m_Wrappee->setProfiling(info[0].ToBoolean().Value());
+    return info.Env().Undefined();
+  }
+
+  // evaluation statistics per expression of the spec, the most expensive first
+  Napi::Value dumpExpressionProfile(const Napi::CallbackInfo& info) {
+    if (info.Length() != 0) {
+      throw Napi::Error::New(info.Env(), "Usage: dumpExpressionProfile()");
+    }
+
+    Napi::Env env = info.Env();
+    Napi::Array res = Napi::Array::New(env);
+    uint32_t idx = 0;
+    for (const ExpressionProfiler::Record &record : m_Wrappee->expressionProfile()) {
+      Napi::Object entry = Napi::Object::New(env);
+      entry.Set("type", Napi::String::New(env, record.type));
+      entry.Set("property", Napi::String::New(env, record.property));
+      entry.Set("kind", Napi::String::New(env, record.kind));
+      entry.Set("source", Napi::String::New(env, record.source));
+      entry.Set("calls", Napi::Number::New(env, static_cast<double>(record.calls)));
+      entry.Set("nanoseconds", Napi::Number::New(env, static_cast<double>(record.nanoseconds)));
+      entry.Set("shared", Napi::Boolean::New(env, record.shared));
+      res.Set(idx++, entry);
+    }
+    return res;
+  }
+
   Napi::Value write(const Napi::CallbackInfo &info) {
     if (info.Length() != 2) {
       throw Napi::Error::New(info.Env(), "Usage: write(<filepath>, <object>)");
@@ -502,6 +564,8 @@ Napi::Object ParserWrap::Init(Napi::Env env, Napi::Object exports) {
       InstanceMethod<&ParserWrap::write>("write"),
       InstanceMethod<&ParserWrap::getType>("getType"),
       InstanceMethod<&ParserWrap::dumpIndex>("dumpIndex"),
+      InstanceMethod<&ParserWrap::setProfiling>("setProfiling"),
+      InstanceMethod<&ParserWrap::dumpExpressionProfile>("dumpExpressionProfile"),
       StaticMethod<&ParserWrap::FromKSY>("FromKSY"),
     });
 
@@ -516,8 +580,10 @@ Napi::Object ParserWrap::Init(Napi::Env env, Napi::Object exports) {
 ParserWrap::ParserWrap(const Napi::CallbackInfo& info)
   : Napi::ObjectWrap<ParserWrap>(info) {
   Napi::String value = info[0].As<Napi::String>();
+  // optional, compile all expressions of the spec up front instead of on first use
+  bool precompile = (info.Length() > 1) && info[1].ToBoolean().Value();
   try {
-    m_Wrappee = parserFromKSY(value.Utf8Value().c_str());
+    m_Wrappee = parserFromKSY(value.Utf8Value().c_str(), precompile);
   }
   catch (const std::exception& e) {
     Napi::Error::New(info.Env(), e.what()).ThrowAsJavaScriptException();
@@ -0,0 +1,94 @@
+#include "BackgroundIndexer.h"
+#include "ObjectIndexTable.h"
+#include "TypeSpec.h"
+#include <algorithm>
+
+// the indexer yields the cpu according to its budget at most this often
+static const std::chrono::milliseconds THROTTLE_SLICE(10);
+
+BackgroundIndexer::BackgroundIndexer(const DynObject &root, const Budget &budget)
+  : m_Root(root)
+  , m_Budget(budget)
+{
+  m_Thread = std::thread([this]() { run(); });
+}
+
+BackgroundIndexer::~BackgroundIndexer()
+{
+  stop();
+}
+
+void BackgroundIndexer::stop() {
+  m_Stop = true;
+  if (m_Thread.joinable()) {
+    m_Thread.join();
+  }
+}
+
+void BackgroundIndexer::run() {
+  m_SliceStart = std::chrono::steady_clock::now();
+  visit(m_Root);
+  m_Done = true;
+}
+
+bool BackgroundIndexer::checkBudget() {
+  if (m_Stop) {
+    return false;
+  }
+
+  if ((m_Budget.maxIndexBytes > 0) && (m_Root.getIndexTable()->memoryUsage() >= m_Budget.maxIndexBytes)) {
+    LOG_F("background indexer stopped after exhausting its memory budget");
+    return false;
+  }
+
+  if (m_Budget.cpuShare < 1.0) {
+    auto busy = std::chrono::steady_clock::now() - m_SliceStart;
+    if (busy >= THROTTLE_SLICE) {
+      double share = std::max(m_Budget.cpuShare, 0.01);
+      std::this_thread::sleep_for(std::chrono::duration_cast<std::chrono::microseconds>(busy * ((1.0 - share) / share)));
+      m_SliceStart = std::chrono::steady_clock::now();
+    }
+  }
+
+  return true;
+}
+
+bool BackgroundIndexer::visit(const DynObject &obj) {
+  // lazy objects have a static layout, there is nothing in them that needs indexing
+  if (obj.isLazy()) {
+    return true;
+  }
+
+  ++m_NumVisited;
+
+  for (const std::string &key : obj.getKeys()) {
+    if (!checkBudget()) {
+      return false;
+    }
+
+    try {
+      const TypeProperty &prop = obj.getChildType(key.c_str());
+      if (prop.isList) {
+        if ((prop.typeId < TypeId::custom) && (prop.typeId != TypeId::runtime)) {
+          continue;
+        }
+        for (const DynObject &item : obj.getList<DynObject>(key.c_str())) {
+          if (!visit(item)) {
+            return false;
+          }
+        }
+      }
+      else if (obj.isCustom(key.c_str())) {
+        if (!visit(obj.get<DynObject>(key.c_str()))) {
+          return false;
+        }
+      }
+    }
+    catch (const std::exception &e) {
+      // the foreground will run into the same problem if it ever gets here, nothing we can do about it
+      LOG_F("background indexer skipping {}: {}", key, e.what());
+    }
+  }
+
+  return true;
+}
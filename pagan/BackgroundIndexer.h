@@ -0,0 +1,62 @@
+#pragma once
+
+#include "DynObject.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/**
+ * walks an object tree on a thread of its own, in file order, indexing everything that would
+ * otherwise only get indexed on first access (dynamic length arrays, unindexed children).
+ * Results are published to the same slots the foreground uses so by the time the application
+ * gets there, the work is already done. If the foreground gets somewhere first, the indexer
+ * simply uses its result
+ */
+class BackgroundIndexer
+{
+public:
+
+  struct Budget {
+    // share of the time the indexer may be busy, it sleeps for the rest
+    double cpuShare{ 1.0 };
+    // the indexer stops once the index table uses this many bytes, 0 means no limit
+    size_t maxIndexBytes{ 0 };
+  };
+
+public:
+
+  BackgroundIndexer(const DynObject &root, const Budget &budget);
+  ~BackgroundIndexer();
+
+  BackgroundIndexer(const BackgroundIndexer &reference) = delete;
+  BackgroundIndexer &operator=(const BackgroundIndexer &reference) = delete;
+
+  // stop indexing and wait for the thread to end
+  void stop();
+
+  // true once the whole tree was visited, the budget was exhausted or the indexer was stopped
+  bool isDone() const {
+    return m_Done;
+  }
+
+  uint32_t numVisited() const {
+    return m_NumVisited;
+  }
+
+private:
+
+  void run();
+  bool visit(const DynObject &obj);
+  bool checkBudget();
+
+private:
+
+  DynObject m_Root;
+  Budget m_Budget;
+  std::atomic<bool> m_Stop{ false };
+  std::atomic<bool> m_Done{ false };
+  std::atomic<uint32_t> m_NumVisited{ 0 };
+  std::chrono::steady_clock::time_point m_SliceStart;
+  std::thread m_Thread;
+
+};
@@ -1,20 +1,36 @@
 #include "DynObject.h"
+#include "ListView.h"
 #include "TypeSpec.h"
+#include "byteorder.h"
+#include "SubtreeIndexer.h"
+#include "IndexSlot.h"
 #include <numeric>
 
 void DynObject::saveTo(std::shared_ptr<IOWrapper> file) {
-  LOG_BRACKET_F("save object idx {0} to {1}", (uint64_t)m_ObjectIndex, file->tellp());
+  if (isLazy()) {
+    // the object can't have been modified so the data can be copied verbatim
+    int32_t size = m_Spec->getStaticSize();
+    std::shared_ptr<IOWrapper> data = m_Streams.get(m_LazyStream, m_LazyOffset);
+    std::vector<char> buffer(size);
+    if (size > 0) {
+      data->read(buffer.data(), size);
+      file->write(buffer.data(), size);
+    }
+    return;
+  }
+
+  LOG_BRACKET_F("save object idx {0} to {1}", (uint64_t)index(), file->tellp());
   const std::vector<TypeProperty>& props = m_Spec->getProperties();
   // for (auto key : getKeys()) {
   for (int i = 0; i < props.size(); ++i) {
-    if (!isBitSet(m_ObjectIndex, i)) {
+    if (!isBitSet(index(), i)) {
       continue;
     }
     const std::string &key = props[i].key;
     int propertyOffset;
-    auto iter = m_Spec->propertyByKey(m_ObjectIndex, key.c_str(), &propertyOffset);
+    auto iter = m_Spec->propertyByKey(index(), key.c_str(), &propertyOffset);
 
-    uint8_t* propBuffer = m_ObjectIndex->properties + propertyOffset;
+    uint8_t* propBuffer = index()->properties + propertyOffset;
     LOG_F("save prop {0} - index {1}", key, (uint64_t)propBuffer);
     uint32_t typeId = iter->typeId;
 
@@ -31,7 +47,7 @@ void DynObject::saveTo(std::shared_ptr<IOWrapper> file) {
       size_t offset;
       uint32_t typeId;
 
-      std::tie(typeId, offset) = m_Spec->get(m_ObjectIndex, key.c_str());
+      std::tie(typeId, offset) = m_Spec->get(index(), key.c_str());
 
       union {
         struct {
@@ -41,7 +57,7 @@ void DynObject::saveTo(std::shared_ptr<IOWrapper> file) {
         uint64_t buff;
       };
 
-      buff = *reinterpret_cast<uint64_t*>(m_ObjectIndex->properties + offset);
+      buff = loadSlot(index()->properties + offset);
       uint8_t* arrayData = m_IndexTable->arrayAddress(arrayProp.offset);
 
       LOG_F("array size: {0}", arrayProp.count);
@@ -72,9 +88,7 @@ void DynObject::saveTo(std::shared_ptr<IOWrapper> file) {
           };
         }
 
-        m_Spec->indexEOSArray(prop, m_IndexTable, m_ObjectIndex->properties + offset,
-                              this, m_ObjectIndex->dataStream, data, streamLimit, repeatCondition);
-        buff = *reinterpret_cast<uint64_t*>(m_ObjectIndex->properties + offset);
+        buff = publishArray(index()->properties + offset, buff, prop, data, streamLimit, repeatCondition);
         arrayData = m_IndexTable->arrayAddress(arrayProp.offset);
         LOG_F("#items: {0}", arrayProp.count);
       }
@@ -92,7 +106,7 @@ void DynObject::saveTo(std::shared_ptr<IOWrapper> file) {
 uint8_t *DynObject::savePropTo(std::shared_ptr<IOWrapper> file, uint32_t typeId, uint8_t* propBuffer) {
   if (typeId >= TypeId::custom) {
     LOG_F("save prop type {0} @ {1}", m_Spec->getRegistry()->getById(typeId)->getName(), file->tellp());
-    int64_t objOffset = *reinterpret_cast<const int64_t*>(propBuffer);
+    int64_t objOffset = loadSlot(propBuffer);
     std::shared_ptr<TypeSpec> type(m_Spec->getRegistry()->getById(typeId));
 
     if (!type) {
@@ -107,7 +121,7 @@ uint8_t *DynObject::savePropTo(std::shared_ptr<IOWrapper> file, uint32_t typeId,
   }
   else {
     LOG_F("save prop type {0} @ {1}", typeId, file->tellp());
-    std::shared_ptr<IOWrapper> dataStream = m_Streams.get(m_ObjectIndex->dataStream);
+    std::shared_ptr<IOWrapper> dataStream = m_Streams.get(index()->dataStream);
     std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
     char* after;
     type_copy_any(static_cast<TypeId>(typeId), reinterpret_cast<char*>(propBuffer), file, dataStream, writeStream, &after);
@@ -124,10 +138,10 @@ inline void DynObject::debug(size_t indent) const {
 
   for (auto prop : getKeys()) {
     int propertyOffset;
-    auto iter = m_Spec->propertyByKey(m_ObjectIndex, prop.c_str(), &propertyOffset);
+    auto iter = m_Spec->propertyByKey(index(), prop.c_str(), &propertyOffset);
     std::cout << "attribute offset " << propertyOffset << std::endl;
 
-    uint8_t* propBuffer = m_ObjectIndex->properties + propertyOffset;
+    uint8_t* propBuffer = index()->properties + propertyOffset;
     uint32_t typeId = iter->typeId;
 
     std::cout << "list: " << iter->isList << " - " << typeId << std::endl;
@@ -143,7 +157,7 @@ inline void DynObject::debug(size_t indent) const {
     }
 
     if (typeId >= TypeId::custom) {
-      int64_t objOffset = *reinterpret_cast<const int64_t*>(propBuffer);
+      int64_t objOffset = loadSlot(propBuffer);
       std::shared_ptr<TypeSpec> type(m_Spec->getRegistry()->getById(typeId));
 
       if (!type) {
@@ -153,8 +167,8 @@ inline void DynObject::debug(size_t indent) const {
       getObjectAtOffset(type, objOffset, propBuffer).debug(indent + 1);
     }
     else {
-      std::cout << "pod " << m_ObjectIndex->dataStream << " - " << std::endl;
-      std::shared_ptr<IOWrapper> dataStream = m_Streams.get(m_ObjectIndex->dataStream);
+      std::cout << "pod " << index()->dataStream << " - " << std::endl;
+      std::shared_ptr<IOWrapper> dataStream = m_Streams.get(index()->dataStream);
       std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
 
       std::any val = type_read_any(static_cast<TypeId>(typeId), reinterpret_cast<char*>(propBuffer), dataStream, writeStream);
@@ -171,19 +185,27 @@ inline void DynObject::debug(size_t indent) const {
 
 void DynObject::writeIndex(size_t dataOffset, std::streampos streamLimit, bool noSeek) {
   std::shared_ptr<IOWrapper> stream = noSeek
-    ? m_Streams.get(m_ObjectIndex->dataStream)
-    : m_Streams.get(m_ObjectIndex->dataStream, m_ObjectIndex->dataOffset);
-  m_Spec->writeIndex(m_IndexTable, m_ObjectIndex,
+    ? m_Streams.get(index()->dataStream)
+    : m_Streams.get(index()->dataStream, index()->dataOffset);
+  m_Spec->writeIndex(m_IndexTable, index(),
     stream,
     m_Streams, this, streamLimit);
 }
 
+const DynObject *DynObject::rebind(const StreamRegistry &streams, ObjectIndexTable *indexTable, std::deque<DynObject> &chain) const {
+  const DynObject *parent = m_Parent != nullptr
+    ? m_Parent->rebind(streams, indexTable, chain)
+    : nullptr;
+  chain.emplace_back(*this, streams, indexTable, parent);
+  return &*chain.rbegin();
+}
+
 uint8_t* DynObject::getBitmask() const {
-  return m_ObjectIndex->bitmask;
+  return index()->bitmask;
 }
 
 std::shared_ptr<IOWrapper> DynObject::getDataStream() const {
-  return m_Streams.get(m_ObjectIndex->dataStream);
+  return m_Streams.get(index()->dataStream);
 }
 
 uint32_t DynObject::getTypeId() const {
@@ -196,7 +218,7 @@ std::vector<std::string> DynObject::getKeys() const {
   res.reserve(props.size());
 
   for (int i = 0; i < props.size(); ++i) {
-    if (isBitSet(m_ObjectIndex, i)) {
+    if (isBitSet(index(), i)) {
       res.push_back(props[i].key);
     }
   }
@@ -207,7 +229,7 @@ std::vector<std::string> DynObject::getKeys() const {
 bool DynObject::has(const char* key) const {
   const std::vector<TypeProperty>& props = m_Spec->getProperties();
   for (int i = 0; i < props.size(); ++i) {
-    if (isBitSet(m_ObjectIndex, i) && (props[i].key == key)) {
+    if (isBitSet(index(), i) && (props[i].key == key)) {
       return true;
     }
   }
@@ -221,9 +243,9 @@ std::tuple<uint32_t, uint8_t*, std::vector<std::string>> DynObject::getEffective
   std::vector<std::string> args;
   bool isList;
 
-  std::tie(typeId, offset, args, isList) = m_Spec->getWithArgs(m_ObjectIndex, key);
+  std::tie(typeId, offset, args, isList) = m_Spec->getWithArgs(index(), key);
 
-  uint8_t* propBuffer = m_ObjectIndex->properties + offset;
+  uint8_t* propBuffer = index()->properties + offset;
 
 
   // for lists, the concrete type is stored with the individual items so the list type is still actually "runtime"
@@ -240,6 +262,22 @@ const TypeProperty& DynObject::getChildType(const char* key) const {
 }
 
 std::any DynObject::getAny(char* key) const {
+  if (isLazy()) {
+    std::vector<std::string> path;
+    for (char *cur = key; ; ) {
+      size_t len = strcspn(cur, ".");
+      path.push_back(std::string(cur, len));
+      if (cur[len] == '\0') {
+        break;
+      }
+      cur += len + 1;
+    }
+    std::any result;
+    if (readStaticPath(path.cbegin(), path.cend(), result)) {
+      return result;
+    }
+  }
+
   size_t dotOffset = strcspn(key, ".");
   if (key[dotOffset] != '\0') {
     // std::string objKey(key, key + dotOffset);
@@ -249,7 +287,7 @@ std::any DynObject::getAny(char* key) const {
   }
 
   if (m_Spec->hasComputed(key)) {
-    return m_Spec->compute(key, this);
+    return compute(key, this);
   }
 
   // else: this is the "final" or "leaf" key
@@ -257,10 +295,10 @@ std::any DynObject::getAny(char* key) const {
   int offsetParam;
   uint32_t typeId;
 
-  std::tie(typeId, offsetProp, offsetParam) = m_Spec->getPorP(m_ObjectIndex, key);
+  std::tie(typeId, offsetProp, offsetParam) = m_Spec->getPorP(index(), key);
 
   if (offsetProp != -1) {
-    uint8_t* propBuffer = m_ObjectIndex->properties + offsetProp;
+    uint8_t* propBuffer = index()->properties + offsetProp;
 
     if (typeId == TypeId::runtime) {
       typeId = *reinterpret_cast<uint32_t*>(propBuffer);
@@ -271,12 +309,12 @@ std::any DynObject::getAny(char* key) const {
       throw IncompatibleType("expected POD");
     }
 
-    char* index = reinterpret_cast<char*>(propBuffer);
+    char* propIndex = reinterpret_cast<char*>(propBuffer);
 
-    std::shared_ptr<IOWrapper> dataStream = m_Streams.get(m_ObjectIndex->dataStream);
+    std::shared_ptr<IOWrapper> dataStream = m_Streams.get(index()->dataStream);
     std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
 
-    std::any result = type_read_any(static_cast<TypeId>(typeId), index, dataStream, writeStream);
+    std::any result = type_read_any(static_cast<TypeId>(typeId), propIndex, dataStream, writeStream);
 
     // std::shared_ptr<TypeSpec> type(m_Spec->getRegistry()->getById(typeId));
     TypeProperty prop = m_Spec->getProperty(key);
@@ -297,13 +335,30 @@ std::any DynObject::getAny(char* key) const {
 }
 
 std::any DynObject::getAny(const std::vector<std::string>::const_iterator &cur, const std::vector<std::string>::const_iterator &end) const {
+  return getAnyImpl(cur, end, true);
+}
+
+std::any DynObject::getRaw(const std::vector<std::string>::const_iterator &cur, const std::vector<std::string>::const_iterator &end) const {
+  return getAnyImpl(cur, end, false);
+}
+
+std::any DynObject::getAnyImpl(const std::vector<std::string>::const_iterator &cur,
+                               const std::vector<std::string>::const_iterator &end,
+                               bool enumNames) const {
+  if (isLazy()) {
+    std::any result;
+    if (readStaticPath(cur, end, result, enumNames)) {
+      return result;
+    }
+  }
+
   if (cur + 1 != end) {
     DynObject obj = get<DynObject>(cur->c_str());
-    return obj.getAny(cur + 1, end);
+    return obj.getAnyImpl(cur + 1, end, enumNames);
   }
 
   if (m_Spec->hasComputed(cur->c_str())) {
-    return m_Spec->compute(cur->c_str(), this);
+    return compute(cur->c_str(), this);
   }
 
   // else: this is the "final" or "leaf" key
@@ -311,12 +366,12 @@ std::any DynObject::getAny(const std::vector<std::string>::const_iterator &cur,
   int offsetProp;
   uint32_t typeId;
 
-  std::tie(typeId, offsetProp, offsetParam) = m_Spec->getPorP(m_ObjectIndex, cur->c_str());
+  std::tie(typeId, offsetProp, offsetParam) = m_Spec->getPorP(index(), cur->c_str());
 
   LOG_F("getAny({}) found: param {} - prop {}", *cur, offsetParam, offsetProp);
 
   if (offsetProp != -1) {
-    uint8_t* propBuffer = m_ObjectIndex->properties + offsetProp;
+    uint8_t* propBuffer = index()->properties + offsetProp;
 
     if (typeId == TypeId::runtime) {
       typeId = *reinterpret_cast<uint32_t*>(propBuffer);
@@ -327,17 +382,17 @@ std::any DynObject::getAny(const std::vector<std::string>::const_iterator &cur,
       throw IncompatibleType("expected POD");
     }
 
-    char* index = reinterpret_cast<char*>(propBuffer);
+    char* propIndex = reinterpret_cast<char*>(propBuffer);
 
-    std::shared_ptr<IOWrapper> dataStream = m_Streams.get(m_ObjectIndex->dataStream);
+    std::shared_ptr<IOWrapper> dataStream = m_Streams.get(index()->dataStream);
     std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
 
-    std::any result = type_read_any(static_cast<TypeId>(typeId), index, dataStream, writeStream);
+    std::any result = type_read_any(static_cast<TypeId>(typeId), propIndex, dataStream, writeStream);
     LOG_F("getAny({}) type: {}", *cur, result.type().name());
 
     const TypeProperty &prop = m_Spec->getProperty(cur->c_str());
 
-    if (prop.hasEnum) {
+    if (prop.hasEnum && enumNames) {
       return resolveEnum(prop.enumName, flexi_cast<int32_t>(result));
     }
 
@@ -361,7 +416,11 @@ inline std::string DynObject::resolveEnum(const std::string& enumName, int32_t v
     return fmt::format("{0}::{1}", enumName, enumValue->second);
   }
   catch (const std::exception& e) {
-    if (m_Parent != nullptr) {
+    ObjectIndex* parent = parentIndex();
+    if (parent != nullptr) {
+      return objectAt(parent).resolveEnum(enumName, value);
+    }
+    else if (m_Parent != nullptr) {
       return m_Parent->resolveEnum(enumName, value);
     }
     else {
@@ -370,6 +429,22 @@ inline std::string DynObject::resolveEnum(const std::string& enumName, int32_t v
   }
 }
 
+std::optional<int32_t> DynObject::enumValue(const std::string &enumName, const std::string &key) const {
+  std::optional<int32_t> res = m_Spec->enumValue(enumName, key);
+  if (res.has_value()) {
+    return res;
+  }
+
+  ObjectIndex* parent = parentIndex();
+  if (parent != nullptr) {
+    return objectAt(parent).enumValue(enumName, key);
+  }
+  else if (m_Parent != nullptr) {
+    return m_Parent->enumValue(enumName, key);
+  }
+  return std::nullopt;
+}
+
 void DynObject::setAny(const std::vector<std::string>::const_iterator &cur, const std::vector<std::string>::const_iterator &end, const std::any &value) {
   if (cur + 1 != end) {
     DynObject obj = get<DynObject>(cur->c_str());
@@ -380,54 +455,184 @@ void DynObject::setAny(const std::vector<std::string>::const_iterator &cur, cons
   size_t offset;
   uint32_t typeId;
 
-  std::tie(typeId, offset) = m_Spec->get(m_ObjectIndex, cur->c_str());
+  std::tie(typeId, offset) = m_Spec->get(index(), cur->c_str());
 
   if (typeId >= TypeId::custom) {
     throw IncompatibleType("expected POD");
   }
 
-  char *index = reinterpret_cast<char*>(m_ObjectIndex->properties + offset);
+  char *propIndex = reinterpret_cast<char*>(index()->properties + offset);
 
-  std::shared_ptr<IOWrapper> dataStream = m_Streams.get(m_ObjectIndex->dataStream);
+  std::shared_ptr<IOWrapper> dataStream = m_Streams.get(index()->dataStream);
   std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
 
-  type_write_any(static_cast<TypeId>(typeId), index, writeStream, value);
+  type_write_any(static_cast<TypeId>(typeId), propIndex, writeStream, value);
+  invalidateComputed(cur->c_str());
 }
 
 DynObject DynObject::getObjectAtOffset(std::shared_ptr<TypeSpec> type, int64_t objOffset, uint8_t* prop) const {
   if (objOffset < 0) {
     // offset is the index offset for an already-indexed object
     int64_t indexOffset = objOffset * -1;
+    SubtreeScope::await(reinterpret_cast<ObjectIndex*>(indexOffset));
 
     return DynObject(type, m_Streams, m_IndexTable, reinterpret_cast<ObjectIndex*>(indexOffset), this);
   }
+  else if (type->hasStaticLayout()) {
+    // fields can be read without indexing the object, that only happens once it's modified
+    return DynObject(type, m_Streams, m_IndexTable, index()->dataStream, objOffset, prop, this);
+  }
   else {
-    ObjectIndex* objIndex = m_IndexTable->allocateObject(type, m_ObjectIndex->dataStream, objOffset);
+    ObjectIndex* objIndex = m_IndexTable->allocateObject(type, index()->dataStream, objOffset, index());
     // offset is the data offset for a not-yet-indexed object
     DynObject res(type, m_Streams, m_IndexTable, objIndex, this);
     res.writeIndex(objOffset, 0, false);
     // LOG_F("not indexed, data {0}", objOffset);
-    objOffset = reinterpret_cast<int64_t>(objIndex) * -1;
 
-    memcpy(prop, reinterpret_cast<char*>(&objOffset), sizeof(int64_t));
+    if (prop != nullptr) {
+      int64_t indexed = reinterpret_cast<int64_t>(objIndex) * -1;
+      int64_t published = publishSlot(prop, objOffset, indexed);
+      if (published != indexed) {
+        // another thread indexed the object at the same time and was first, use its index
+        return DynObject(type, m_Streams, m_IndexTable, reinterpret_cast<ObjectIndex*>(published * -1), this);
+      }
+    }
     return res;
   }
 }
 
+ObjectIndex* DynObject::parentIndex() const {
+  return isLazy() ? m_LazyParent : m_ObjectIndex->parent;
+}
+
+DynObject DynObject::objectAt(ObjectIndex* objIndex) const {
+  std::shared_ptr<TypeSpec> type = m_Spec->getRegistry()->getById(objIndex->typeId);
+  return DynObject(type, m_Streams, m_IndexTable, objIndex, nullptr);
+}
+
+bool DynObject::isLazy() const {
+  if ((m_ObjectIndex == nullptr) && (m_LazySlot != nullptr)) {
+    // another copy of this object may have been indexed in the meantime
+    int64_t objOffset = loadSlot(m_LazySlot);
+    if (objOffset < 0) {
+      SubtreeScope::await(reinterpret_cast<ObjectIndex*>(objOffset * -1));
+      m_ObjectIndex = reinterpret_cast<ObjectIndex*>(objOffset * -1);
+    }
+  }
+  return m_ObjectIndex == nullptr;
+}
+
+void DynObject::materialize() const {
+  if (!isLazy()) {
+    return;
+  }
+
+  m_ObjectIndex = m_IndexTable->allocateObject(m_Spec, m_LazyStream, m_LazyOffset, m_LazyParent);
+  const_cast<DynObject*>(this)->writeIndex(m_LazyOffset, 0, false);
+
+  if (m_LazySlot != nullptr) {
+    int64_t indexed = reinterpret_cast<int64_t>(m_ObjectIndex) * -1;
+    int64_t published = publishSlot(m_LazySlot, static_cast<int64_t>(m_LazyOffset), indexed);
+    if (published != indexed) {
+      m_ObjectIndex = reinterpret_cast<ObjectIndex*>(published * -1);
+    }
+  }
+}
+
+uint32_t DynObject::readStaticField(const char* key, uint8_t* buffer) const {
+  const TypeSpec::StaticField *field = m_Spec->staticField(key);
+  if ((field == nullptr) || (field->typeId >= TypeId::custom)) {
+    return TypeId::runtime;
+  }
+
+  size_t size = TypeSpec::plainNumberSize(field->typeId);
+  std::shared_ptr<IOWrapper> data = m_Streams.get(m_LazyStream, m_LazyOffset + field->dataOffset);
+  data->read(reinterpret_cast<char*>(buffer), size);
+  if (isBigEndian(field->typeId)) {
+    swapBytesInPlace(reinterpret_cast<char*>(buffer), size);
+  }
+
+  return field->typeId;
+}
+
+bool DynObject::readStaticPath(const std::vector<std::string>::const_iterator &cur,
+                               const std::vector<std::string>::const_iterator &end,
+                               std::any &result, bool enumNames) const {
+  std::shared_ptr<TypeSpec> spec = m_Spec;
+  DataOffset offset = m_LazyOffset;
+
+  // follow nested objects as long as they have a static layout too
+  auto iter = cur;
+  for (; iter + 1 != end; ++iter) {
+    const TypeSpec::StaticField *field = spec->staticField(iter->c_str());
+    if ((field == nullptr) || (field->typeId < TypeId::custom)) {
+      return false;
+    }
+    spec = spec->getRegistry()->getById(field->typeId);
+    offset += field->dataOffset;
+  }
+
+  if (spec->hasComputed(iter->c_str())) {
+    return false;
+  }
+
+  const TypeSpec::StaticField *field = spec->staticField(iter->c_str());
+  if ((field == nullptr) || (field->typeId >= TypeId::custom)) {
+    return false;
+  }
+
+  const TypeProperty &prop = spec->getProperty(iter->c_str());
+  if (prop.hasEnum && enumNames && (spec != m_Spec)) {
+    // enums are looked up through the parent chain, leave that to the materialized objects
+    return false;
+  }
+
+  uint8_t buffer[sizeof(int64_t)];
+  size_t size = TypeSpec::plainNumberSize(field->typeId);
+  std::shared_ptr<IOWrapper> data = m_Streams.get(m_LazyStream, offset + field->dataOffset);
+  data->read(reinterpret_cast<char*>(buffer), size);
+  if (isBigEndian(field->typeId)) {
+    swapBytesInPlace(reinterpret_cast<char*>(buffer), size);
+  }
+
+  std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
+  result = type_read_any(static_cast<TypeId>(field->typeId), reinterpret_cast<char*>(buffer), data, writeStream);
+
+  if (prop.hasEnum && enumNames) {
+    result = resolveEnum(prop.enumName, flexi_cast<int32_t>(result));
+  }
+
+  return true;
+}
+
 bool DynObject::hasComputed(const char* key) const {
   return m_Spec->hasComputed(key);
 }
 
 std::any DynObject::compute(const char* key, const DynObject* obj) const {
-  return m_Spec->compute(key, obj);
+  const TypeSpec::Computed &computed = m_Spec->getComputed(key);
+  if (!computed.cacheable || (obj != this) || isLazy()) {
+    return computed.func(*obj);
+  }
+
+  std::any result;
+  if (!m_IndexTable->cachedComputed(index(), computed.num, computed.isLocal, result)) {
+    result = computed.func(*obj);
+    m_IndexTable->cacheComputed(index(), computed.num, result);
+  }
+  return result;
+}
+
+void DynObject::invalidateComputed(const char *key) {
+  m_IndexTable->invalidateComputed(index(), m_Spec->getComputedDependents(key));
 }
 
 std::tuple<uint32_t, size_t> DynObject::getSpec(const char* key) const {
-  return m_Spec->get(m_ObjectIndex, key);
+  return m_Spec->get(index(), key);
 }
 
 std::tuple<uint32_t, size_t, SizeFunc, AssignCB> DynObject::getFullSpec(const char* key) const {
-  return m_Spec->getFull(m_ObjectIndex, key);
+  return m_Spec->getFull(index(), key);
 }
 
 const TypeProperty& DynObject::getProperty(const char* key) const {
@@ -438,12 +643,21 @@ DynObject DynObject::getObject(const char* key) const {
   if (strcmp(key, "_") == 0) {
     return *this;
   } else if (strcmp(key, "_parent") == 0) {
+    ObjectIndex* parent = parentIndex();
+    if (parent != nullptr) {
+      return objectAt(parent);
+    }
     if (m_Parent == nullptr) {
       throw std::runtime_error("parent pointer not set");
     }
     return *m_Parent;
   }
   else if (strcmp(key, "_root") == 0) {
+    ObjectIndex* parent = parentIndex();
+    if (parent != nullptr) {
+      return objectAt(parent->root != nullptr ? parent->root : parent);
+    }
+    // objects created without a link, fall back to the chain of objects
     const DynObject* iter = this;
     while (iter->m_Parent != nullptr) {
       iter = iter->m_Parent;
@@ -463,7 +677,7 @@ DynObject DynObject::getObject(const char* key) const {
 
   // offset - either into the data stream if the object hasn't been cached yet or to
   //   its index
-  int64_t objOffset = *reinterpret_cast<const int64_t*>(propBuffer);
+  int64_t objOffset = loadSlot(propBuffer);
 
   std::shared_ptr<TypeSpec> type(m_Spec->getRegistry()->getById(typeId));
 
@@ -475,7 +689,11 @@ DynObject DynObject::getObject(const char* key) const {
 
   DynObject res = getObjectAtOffset(type, objOffset, propBuffer);
   std::vector<std::any> args;
-  std::transform(argList.begin(), argList.end(), std::back_inserter(args), [this](const std::string& key) { return getAny(key.c_str()); });
+  // arguments are evaluated by the child's expressions, so enums are passed as their integer value
+  std::transform(argList.begin(), argList.end(), std::back_inserter(args), [this](const std::string& key) {
+    PropertyPath path(key);
+    return getRaw(path.segments().cbegin(), path.segments().cend());
+  });
   res.setParameters(args);
   return res;
 }
@@ -493,7 +711,7 @@ std::vector<DynObject> DynObject::getListOfObjects(const char* key) const {
         throw WrongTypeRequestedError();
       }
     }
-    int64_t objOffset = *reinterpret_cast<int64_t*>(arrayCur);
+    int64_t objOffset = loadSlot(arrayCur);
 
     std::shared_ptr<TypeSpec> type(m_Spec->getRegistry()->getById(itemType));
     res.push_back(getObjectAtOffset(type, objOffset, arrayCur));
@@ -503,6 +721,23 @@ std::vector<DynObject> DynObject::getListOfObjects(const char* key) const {
   return res;
 }
 
+ListView DynObject::getListView(const char* key) const {
+  auto [arrayCur, count, typeId] = accessArrayIndex(key);
+  return ListView(*this, arrayCur, count, typeId);
+}
+
+std::vector<ObjectHandle> DynObject::getListHandles(const char* key) const {
+  auto [arrayCur, count, typeId] = accessArrayIndex(key);
+
+  std::vector<ObjectHandle> res;
+  res.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    res.push_back(getArrayItem(typeId, &arrayCur).handle());
+  }
+
+  return res;
+}
+
 std::tuple<uint8_t*, ObjSize, uint32_t> DynObject::accessArrayIndex(const char* key) const {
   LOG_BRACKET_F("get list of obj {0}", key);
 
@@ -510,7 +745,7 @@ std::tuple<uint8_t*, ObjSize, uint32_t> DynObject::accessArrayIndex(const char*
   uint32_t typeId;
 
   std::tie(typeId, offset) = getSpec(key);
-  LOG_F("(3) key {0}  offset {1} -> {2}", key, offset, (uint64_t)(m_ObjectIndex->properties + offset), typeId);
+  LOG_F("(3) key {0}  offset {1} -> {2}", key, offset, (uint64_t)(index()->properties + offset), typeId);
 
   // if it's a runtime type the concrete type is stored with each item individually
   // so we can't currently determine if the type at runtime is actually valid
@@ -529,7 +764,8 @@ std::tuple<uint8_t*, ObjSize, uint32_t> DynObject::accessArrayIndex(const char*
     uint64_t buff;
   };
 
-  buff = *reinterpret_cast<uint64_t*>(m_ObjectIndex->properties + offset);
+  uint8_t* propBuffer = index()->properties + offset;
+  buff = loadSlot(propBuffer);
   uint8_t* arrayData = m_IndexTable->arrayAddress(arrayProp.offset);
 
   if ((arrayProp.count == COUNT_EOS) || (arrayProp.count == COUNT_MORE)) {
@@ -550,22 +786,13 @@ std::tuple<uint8_t*, ObjSize, uint32_t> DynObject::accessArrayIndex(const char*
         // location, identified by pos
         // TODO: probably need handling for runtime types
         int64_t objIndex = *reinterpret_cast<int64_t*>(pos);
+        SubtreeScope::await(reinterpret_cast<ObjectIndex*>(objIndex * -1));
         DynObject tmp(itemType, m_Streams, m_IndexTable, reinterpret_cast<ObjectIndex*>(objIndex * -1), this);
-
-        auto keys = tmp.getKeys();
-        std::string joined = std::accumulate(keys.begin(), keys.end(), std::string(), [](std::string res, const std::string& iter) {
-          return std::move(res) + "," + iter;
-          });
-
         return prop.repeatCondition(tmp);
       };
     }
 
-    m_Spec->indexEOSArray(prop, m_IndexTable, m_ObjectIndex->properties + offset,
-                          this, m_ObjectIndex->dataStream, data, streamLimit, repeatCondition);
-
-    // update the array properties, now with the actual count filled in
-    buff = *reinterpret_cast<uint64_t*>(m_ObjectIndex->properties + offset);
+    buff = publishArray(propBuffer, buff, prop, data, streamLimit, repeatCondition);
     arrayData = m_IndexTable->arrayAddress(arrayProp.offset);
   }
 
@@ -576,6 +803,21 @@ std::tuple<uint8_t*, ObjSize, uint32_t> DynObject::accessArrayIndex(const char*
   return std::make_tuple(arrayCur, arrayProp.count, typeId);
 }
 
+uint64_t DynObject::publishArray(uint8_t* arrayProp, uint64_t unindexed, const TypeProperty& prop,
+                                 std::shared_ptr<IOWrapper> data, std::streampos streamLimit,
+                                 const std::function<bool(uint8_t*)>& repeatCondition) const {
+  // index into a copy of the property, another thread may be indexing the same array
+  uint64_t indexed = unindexed;
+  m_Spec->indexEOSArray(prop, m_IndexTable, reinterpret_cast<uint8_t*>(&indexed),
+                        this, index()->dataStream, data, streamLimit, repeatCondition, arrayProp);
+
+  uint64_t published = publishSlot(arrayProp, unindexed, indexed);
+  if (published == indexed) {
+    m_IndexTable->dropScannedItems(arrayProp);
+  }
+  return published;
+}
+
 DynObject DynObject::getArrayItem(uint32_t typeId, uint8_t **arrayCur) const {
   uint32_t itemType = typeId;
   // in a "regular" array the item type will always be the same but if it's
@@ -584,18 +826,209 @@ DynObject DynObject::getArrayItem(uint32_t typeId, uint8_t **arrayCur) const {
   if (itemType == TypeId::runtime) {
     itemType = *reinterpret_cast<uint32_t*>(*arrayCur);
     *arrayCur += sizeof(uint32_t);
+    if (itemType < TypeId::custom) {
+      throw WrongTypeRequestedError();
+    }
   }
-  int64_t objOffset = *reinterpret_cast<int64_t*>(*arrayCur);
+  uint8_t *slot = *arrayCur;
+  int64_t objOffset = loadSlot(slot);
 
   std::shared_ptr<TypeSpec> type(m_Spec->getRegistry()->getById(itemType));
 
   *arrayCur += sizeof(int64_t);
-  return getObjectAtOffset(type, objOffset, *arrayCur);
+  return getObjectAtOffset(type, objOffset, slot);
+}
+
+static int64_t plainInteger(uint32_t typeId, const uint8_t *buffer) {
+  switch (nativeType(typeId)) {
+    case TypeId::int8: return *reinterpret_cast<const int8_t*>(buffer);
+    case TypeId::uint8: return *buffer;
+    case TypeId::int16: { int16_t res; memcpy(&res, buffer, sizeof(res)); return res; }
+    case TypeId::uint16: { uint16_t res; memcpy(&res, buffer, sizeof(res)); return res; }
+    case TypeId::int32: { int32_t res; memcpy(&res, buffer, sizeof(res)); return res; }
+    case TypeId::uint32: { uint32_t res; memcpy(&res, buffer, sizeof(res)); return res; }
+    default: { int64_t res; memcpy(&res, buffer, sizeof(res)); return res; }
+  }
+}
+
+bool DynObject::readArrayColumn(uint32_t typeId, const uint8_t *array, ObjSize count, const char *key, int64_t *values) const {
+  if (typeId < TypeId::custom) {
+    return false;
+  }
+
+  std::shared_ptr<TypeSpec> type = m_Spec->getRegistry()->getById(typeId);
+  const TypeSpec::StaticField *field = type->staticField(key);
+  if ((field == nullptr) || (nativeType(field->typeId) > TypeId::uint64)
+      || type->hasComputed(key)) {
+    return false;
+  }
+
+  size_t fieldSize = TypeSpec::plainNumberSize(field->typeId);
+  size_t itemSize = static_cast<size_t>(type->getStaticSize());
+  // read at most this many adjacent items at once
+  static const ObjSize MAX_RUN = 4096;
+  std::vector<uint8_t> buffer;
+
+  ObjSize i = 0;
+  while (i < count) {
+    int64_t offset = loadSlot(array + i * sizeof(int64_t));
+    if (offset < 0) {
+      // indexed (and possibly modified) item, the index holds the current value in native byte order
+      ObjectIndex *objIndex = reinterpret_cast<ObjectIndex*>(offset * -1);
+      SubtreeScope::await(objIndex);
+      int propOffset;
+      type->propertyByKey(objIndex, key, &propOffset);
+      values[i++] = plainInteger(field->typeId, objIndex->properties + propOffset);
+      continue;
+    }
+
+    ObjSize run = 1;
+    while ((i + run < count) && (run < MAX_RUN)
+           && (loadSlot(array + (i + run) * sizeof(int64_t)) == offset + static_cast<int64_t>(run * itemSize))) {
+      ++run;
+    }
+
+    size_t length = (run - 1) * itemSize + field->dataOffset + fieldSize;
+    buffer.resize(length);
+    m_Streams.get(index()->dataStream, offset)->read(reinterpret_cast<char*>(buffer.data()), length);
+    for (ObjSize j = 0; j < run; ++j) {
+      uint8_t *pos = buffer.data() + j * itemSize + field->dataOffset;
+      if (isBigEndian(field->typeId)) {
+        swapBytesInPlace(reinterpret_cast<char*>(pos), fieldSize);
+      }
+      values[i + j] = plainInteger(field->typeId, pos);
+    }
+    i += run;
+  }
+
+  return true;
+}
+
+DynObject DynObject::indexedListItem(const char* key, ObjSize itemIndex) const {
+  auto [arrayCur, count, typeId] = accessArrayIndex(key);
+  if ((itemIndex < 0) || (itemIndex >= count)) {
+    throw std::runtime_error(fmt::format("list index out of range: {}", itemIndex));
+  }
+  // object items all take the same space in the array index
+  size_t itemSize = (typeId == TypeId::runtime) ? sizeof(uint32_t) + sizeof(int64_t) : sizeof(int64_t);
+  arrayCur += itemSize * itemIndex;
+  return getArrayItem(typeId, &arrayCur);
+}
+
+DynObject DynObject::getListItem(const char* key, ObjSize itemIndex) const {
+  size_t offset;
+  uint32_t typeId;
+
+  std::tie(typeId, offset) = getSpec(key);
+
+  if ((typeId < TypeId::custom) && (typeId != TypeId::runtime)) {
+    throw IncompatibleType(fmt::format("expected custom list, got {}", typeId).c_str());
+  }
+
+  uint8_t* arrayProp = index()->properties + offset;
+  int64_t arraySlot = loadSlot(arrayProp);
+  ObjSize count;
+  ObjSize arrayOffset;
+  memcpy(reinterpret_cast<char*>(&count), &arraySlot, sizeof(ObjSize));
+  memcpy(reinterpret_cast<char*>(&arrayOffset), reinterpret_cast<char*>(&arraySlot) + sizeof(ObjSize), sizeof(ObjSize));
+
+  if (count != COUNT_EOS) {
+    return indexedListItem(key, itemIndex);
+  }
+
+  const TypeProperty& prop = getProperty(key);
+  uint8_t* arrayData = m_IndexTable->arrayAddress(arrayOffset);
+  uint64_t arrayDataPos;
+  uint64_t streamLimit;
+  memcpy(reinterpret_cast<char*>(&arrayDataPos), arrayData, sizeof(uint64_t));
+  memcpy(reinterpret_cast<char*>(&streamLimit), arrayData + sizeof(uint64_t), sizeof(uint64_t));
+
+  if (itemIndex < 0) {
+    throw std::runtime_error(fmt::format("list index out of range: {}", itemIndex));
+  }
+
+  ObjectIndexTable::ScannedItem item;
+  if (m_IndexTable->scannedItem(arrayProp, itemIndex, item)) {
+    return scannedListItem(item.typeId, item.objOffset);
+  }
+
+  std::shared_ptr<IOWrapper> data = getDataStream();
+
+  // index the item at the current position of data. Items with a static layout would only be
+  // read lazily, without a slot to keep the index once they get modified, so they get indexed
+  // right away
+  auto indexItem = [&](ObjectIndexTable::ScannedItem &res) {
+    uint8_t itemBuffer[sizeof(uint32_t) + sizeof(int64_t)];
+    uint8_t* itemCur = itemBuffer;
+    res.offset = data->tellg();
+    prop.index(itemBuffer, this, index()->dataStream, data, streamLimit);
+    res.end = data->tellg();
+    res.typeId = typeId;
+    if (typeId == TypeId::runtime) {
+      res.typeId = *reinterpret_cast<uint32_t*>(itemCur);
+      itemCur += sizeof(uint32_t);
+    }
+    res.objOffset = *reinterpret_cast<int64_t*>(itemCur);
+    if ((res.objOffset >= 0) && (res.typeId >= TypeId::custom)) {
+      std::shared_ptr<TypeSpec> type = m_Spec->getRegistry()->getById(res.typeId);
+      ObjectIndex* objIndex = m_IndexTable->allocateObject(type, index()->dataStream, res.objOffset, index());
+      DynObject(type, m_Streams, m_IndexTable, objIndex, this).writeIndex(res.objOffset, 0, false);
+      res.objOffset = reinterpret_cast<int64_t>(objIndex) * -1;
+      data->seekg(res.end);
+    }
+  };
+
+  // resume from the closest item located before. Items in front of the requested one only get
+  // indexed if that's the only way to find where they end
+  DataOffset resumeOffset;
+  ObjSize num = m_IndexTable->scanPosition(arrayProp, itemIndex, arrayDataPos, resumeOffset);
+  data->seekg(resumeOffset);
+  std::shared_ptr<TypeSpec> itemSpec = (typeId != TypeId::runtime) ? m_Spec->getRegistry()->getById(typeId) : nullptr;
+  if ((num < itemIndex) && (itemSpec != nullptr) && itemSpec->hasBoundaries() && !prop.hasSizeFunc) {
+    std::vector<DataOffset> boundaries;
+    if (itemSpec->scanBoundaries(m_IndexTable, this, m_Streams, index()->dataStream, data, streamLimit,
+                                 boundaries, static_cast<size_t>(itemIndex - num))) {
+      boundaries.push_back(data->tellg());
+      for (size_t i = 0; i + 1 < boundaries.size(); ++i) {
+        m_IndexTable->addLocatedItem(arrayProp, num++, boundaries[i], boundaries[i + 1]);
+      }
+    } else {
+      data->seekg(resumeOffset);
+    }
+  }
+
+  for (; num <= itemIndex; ++num) {
+    if (!m_IndexTable->scannedItem(arrayProp, num, item)) {
+      if (data->tellg() >= static_cast<std::streamoff>(streamLimit)) {
+        throw std::runtime_error(fmt::format("list index out of range: {}", itemIndex));
+      }
+      indexItem(item);
+      bool recorded = m_IndexTable->addScannedItem(arrayProp, num, item);
+      if (!recorded || (loadSlot(arrayProp) != arraySlot)) {
+        // the list got indexed in the meantime, items not recorded before aren't part of it
+        if (recorded) {
+          m_IndexTable->dropScannedItems(arrayProp);
+        }
+        return indexedListItem(key, itemIndex);
+      }
+    }
+    m_IndexTable->addLocatedItem(arrayProp, num, item.offset, item.end);
+    data->seekg(item.end);
+  }
+
+  return scannedListItem(item.typeId, item.objOffset);
+}
+
+DynObject DynObject::scannedListItem(uint32_t typeId, int64_t objOffset) const {
+  if (typeId < TypeId::custom) {
+    throw WrongTypeRequestedError();
+  }
+  return getObjectAtOffset(m_Spec->getRegistry()->getById(typeId), objOffset, nullptr);
 }
 
 std::vector<std::any> DynObject::getListOfAny(const char* key) const {
   auto [arrayCur, count, typeId] = accessArrayIndex(key);
-  std::shared_ptr<IOWrapper> dataStream = m_Streams.get(m_ObjectIndex->dataStream);
+  std::shared_ptr<IOWrapper> dataStream = m_Streams.get(index()->dataStream);
   std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
 
   std::vector<std::any> res;
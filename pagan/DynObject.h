@@ -7,12 +7,17 @@
 #include "IScriptQuery.h"
 #include "TypeProperty.h"
 #include "constants.h"
+#include "ObjectHandle.h"
+#include "IndexSlot.h"
 #include <cstdint>
+#include <deque>
 #include <iostream>
+#include <optional>
 
 class TypeSpec;
 class ObjectIndex;
 class ObjectIndexTable;
+class ListView;
 
 typedef std::map<int32_t, std::string> KSYEnum;
 
@@ -45,7 +50,7 @@ public:
     , m_IndexTable(indexTable)
     , m_Parent(parent)
   {
-    m_ObjectIndex = indexTable->allocateObject(spec, -1, 0);
+    m_ObjectIndex = indexTable->allocateObject(spec, -1, 0, parent != nullptr ? parent->index() : nullptr);
 
     std::vector<T> out;
     std::copy(props.begin(), props.end(), std::back_inserter(out));
@@ -59,6 +64,29 @@ public:
     , m_IndexTable(reference.m_IndexTable)
     , m_ObjectIndex(reference.m_ObjectIndex)
     , m_Parent(reference.m_Parent)
+    , m_Parameters(reference.m_Parameters)
+    , m_LazyStream(reference.m_LazyStream)
+    , m_LazyOffset(reference.m_LazyOffset)
+    , m_LazySlot(reference.m_LazySlot)
+    , m_LazyParent(reference.m_LazyParent)
+  {
+  }
+
+  /**
+   * copy of reference that reads through different streams and allocates from a different index
+   * table, so it can be used on another thread
+   */
+  DynObject(const DynObject &reference, const StreamRegistry &streams, ObjectIndexTable *indexTable, const DynObject *parent)
+    : m_Spec(reference.m_Spec)
+    , m_Streams(streams)
+    , m_IndexTable(indexTable)
+    , m_ObjectIndex(reference.m_ObjectIndex)
+    , m_Parent(parent)
+    , m_Parameters(reference.m_Parameters)
+    , m_LazyStream(reference.m_LazyStream)
+    , m_LazyOffset(reference.m_LazyOffset)
+    , m_LazySlot(reference.m_LazySlot)
+    , m_LazyParent(reference.m_LazyParent)
   {
   }
 
@@ -73,6 +101,11 @@ public:
       m_IndexTable = reference.m_IndexTable;
       m_ObjectIndex = reference.m_ObjectIndex;
       m_Parent = reference.m_Parent;
+      m_Parameters = reference.m_Parameters;
+      m_LazyStream = reference.m_LazyStream;
+      m_LazyOffset = reference.m_LazyOffset;
+      m_LazySlot = reference.m_LazySlot;
+      m_LazyParent = reference.m_LazyParent;
     }
     return *this;
   }
@@ -92,9 +125,22 @@ public:
   void writeIndex(size_t dataOffset, std::streampos streamLimit, bool noSeek);
 
   ObjectIndex *getIndex() const {
-    return m_ObjectIndex;
+    return index();
+  }
+
+  /**
+   * pointer-sized handle to this object, indexing it first if it's still lazy
+   */
+  ObjectHandle handle() const {
+    return ObjectHandle(index());
   }
 
+  /**
+   * true if this object has not been indexed yet. This is only the case for objects with a
+   * static layout, fields get read straight from the data stream until the object gets modified
+   */
+  bool isLazy() const;
+
   uint8_t* getBitmask() const;
 
   std::shared_ptr<TypeSpec> getSpec() const {
@@ -107,6 +153,20 @@ public:
     return m_Streams.getWrite();
   }
 
+  const StreamRegistry &getStreams() const {
+    return m_Streams;
+  }
+
+  ObjectIndexTable *getIndexTable() const {
+    return m_IndexTable;
+  }
+
+  /**
+   * copy this object and all its ancestors into chain, bound to the specified streams and
+   * index table. Returns the copy of this object
+   */
+  const DynObject *rebind(const StreamRegistry &streams, ObjectIndexTable *indexTable, std::deque<DynObject> &chain) const;
+
   uint32_t getTypeId() const;
 
   std::vector<std::string> getKeys() const;
@@ -137,8 +197,28 @@ public:
 
   std::any getAny(const std::vector<std::string>::const_iterator &cur, const std::vector<std::string>::const_iterator &end) const;
 
+  /**
+   * same as getAny except that enum properties are returned as their integer value rather than
+   * the name. This is how expressions see them
+   */
+  std::any getRaw(const std::vector<std::string>::const_iterator &cur, const std::vector<std::string>::const_iterator &end) const;
+
+  std::any getAny(const PropertyPath &path) const {
+    return path.get(*this);
+  }
+
+  ScriptValue getValue(const PropertyPath &path) const {
+    return path.getValue(*this);
+  }
+
   std::string resolveEnum(const std::string& enumName, int32_t value) const;
 
+  /**
+   * value of a key of the named enum, searched in the same order as resolveEnum.
+   * nullopt if neither this object nor its parents define it
+   */
+  std::optional<int32_t> enumValue(const std::string &enumName, const std::string &key) const;
+
   void setAny(const std::vector<std::string>::const_iterator &cur,
               const std::vector<std::string>::const_iterator &end,
               const std::any &value);
@@ -147,6 +227,17 @@ public:
 
   template <typename T> std::vector<T> getList(const char *key) const;
 
+  /**
+   * list of objects at the specified key. Unlike getList<DynObject> the items are only
+   * materialized when accessed
+   */
+  ListView getListView(const char *key) const;
+
+  /**
+   * handles to all items of a list of objects. Items that haven't been indexed yet get indexed
+   */
+  std::vector<ObjectHandle> getListHandles(const char *key) const;
+
   template <typename T> void set(const char *key, const T &value) {
     LOG_BRACKET_F("set pod {0}", key);
     std::shared_ptr<IOWrapper> write = m_Streams.getWrite();
@@ -157,7 +248,7 @@ public:
     SizeFunc size;
     AssignCB onAssign;
     
-    std::tie(typeId, offset, size, onAssign) = m_Spec->getFull(m_ObjectIndex, key);
+    std::tie(typeId, offset, size, onAssign) = m_Spec->getFull(index(), key);
     uint8_t *propBuffer = m_ObjectIndex->properties + offset;
 
     if (typeId == TypeId::runtime) {
@@ -172,6 +263,7 @@ public:
     LOG_F("write at index {0:x} + {1}", (int64_t)m_ObjectIndex->properties, offset);
 
     type_write(static_cast<TypeId>(typeId), reinterpret_cast<char*>(propBuffer), write, value);
+    invalidateComputed(key);
     onAssign(*this, std::any(value));
   }
 
@@ -179,8 +271,77 @@ public:
 
   DynObject getArrayItem(uint32_t typeId, uint8_t** arrayCur) const;
 
+  /**
+   * read an integer field of count consecutive items of an object array into values without
+   * materializing the items. Items that haven't been indexed are read straight from the data
+   * stream, in one go as long as they're adjacent.
+   * Returns false if the items don't have a static layout or the field isn't a plain integer.
+   * Enums are read as their integer value, same as expressions see them
+   */
+  bool readArrayColumn(uint32_t typeId, const uint8_t *array, ObjSize count, const char *key, int64_t *values) const;
+
+  /**
+   * get a single item from a list of objects.
+   * If the list hasn't been indexed yet (repeat to end of stream) this will not index the whole list,
+   * instead the item is located by scanning from the closest item located before. The items returned
+   * become part of the list once it does get indexed
+   */
+  DynObject getListItem(const char *key, ObjSize itemIndex) const;
+
 private:
 
+  // constructor for a lazy object, slot is where the index of the object has to be stored
+  // once it gets materialized (may be null)
+  DynObject(const std::shared_ptr<TypeSpec> &spec, const StreamRegistry &streams, ObjectIndexTable *indexTable,
+            DataStreamId dataStream, DataOffset dataOffset, uint8_t *slot, const DynObject *parent)
+    : m_Spec(spec)
+    , m_Streams(streams)
+    , m_IndexTable(indexTable)
+    , m_ObjectIndex(nullptr)
+    , m_Parent(parent)
+    , m_LazyStream(dataStream)
+    , m_LazyOffset(dataOffset)
+    , m_LazySlot(slot)
+    , m_LazyParent(parent != nullptr ? parent->m_ObjectIndex : nullptr)
+  {
+  }
+
+  // the object index, creating it first if this object is still lazy
+  ObjectIndex *index() const {
+    if (m_ObjectIndex == nullptr) {
+      materialize();
+    }
+    return m_ObjectIndex;
+  }
+
+  void materialize() const;
+
+  // parent as linked in the index. Unlike m_Parent this doesn't depend on the lifetime of the
+  // object this one was created from
+  ObjectIndex *parentIndex() const;
+
+  // another object of the same parse
+  DynObject objectAt(ObjectIndex *objIndex) const;
+
+  /**
+   * read a (possibly nested) numerical field of a lazy object directly from the data stream.
+   * returns false if the path can't be resolved through static layouts, in which case the
+   * caller has to fall back to the index
+   */
+  bool readStaticPath(const std::vector<std::string>::const_iterator &cur,
+                      const std::vector<std::string>::const_iterator &end,
+                      std::any &result, bool enumNames = true) const;
+
+  std::any getAnyImpl(const std::vector<std::string>::const_iterator &cur,
+                      const std::vector<std::string>::const_iterator &end,
+                      bool enumNames) const;
+
+  /**
+   * read a field of this lazy object into buffer, in the representation it would have in the index.
+   * returns the type id of the field or TypeId::runtime if it isn't a static numerical field
+   */
+  uint32_t readStaticField(const char *key, uint8_t *buffer) const;
+
   DynObject getObjectAtOffset(std::shared_ptr<TypeSpec> type,
                               int64_t objOffset,
                               uint8_t* prop) const;
@@ -189,6 +350,9 @@ private:
 
   std::any compute(const char* key, const DynObject* obj) const;
 
+  // drop cached results of computed properties that depend on the specified property
+  void invalidateComputed(const char *key);
+
   std::tuple<uint32_t, size_t> getSpec(const char* key) const;
   std::tuple<uint32_t, size_t, SizeFunc, AssignCB> getFullSpec(const char* key) const;
   const TypeProperty& getProperty(const char* key) const;
@@ -200,15 +364,33 @@ private:
 
   std::tuple<uint8_t*, ObjSize, uint32_t> accessArrayIndex(const char *key) const;
 
+  // item of a list of objects, indexing the whole list if necessary
+  DynObject indexedListItem(const char *key, ObjSize itemIndex) const;
+
+  // item of a list of objects that isn't indexed yet, indexed on its own
+  DynObject scannedListItem(uint32_t typeId, int64_t objOffset) const;
+
+  // index a dynamic length array and publish the result to its property, unless another
+  // thread was faster. Returns the count and array offset that are in effect afterwards
+  uint64_t publishArray(uint8_t *arrayProp, uint64_t unindexed, const TypeProperty &prop,
+                        std::shared_ptr<IOWrapper> data, std::streampos streamLimit,
+                        const std::function<bool(uint8_t*)> &repeatCondition) const;
+
 private:
 
   std::shared_ptr<TypeSpec> m_Spec;
   const StreamRegistry &m_Streams;
   ObjectIndexTable *m_IndexTable;
-  ObjectIndex *m_ObjectIndex;
+  mutable ObjectIndex *m_ObjectIndex;
   const DynObject *m_Parent;
   std::vector<std::any> m_Parameters;
 
+  // location of a lazy object, only valid while m_ObjectIndex is null
+  DataStreamId m_LazyStream{ 0 };
+  DataOffset m_LazyOffset{ 0 };
+  uint8_t *m_LazySlot{ nullptr };
+  ObjectIndex *m_LazyParent{ nullptr };
+
 };
 
 template<>
@@ -222,6 +404,16 @@ inline T DynObject::get(const char* key) const {
     return flexi_cast<T>(compute(key, this));
   }
 
+  if (isLazy()) {
+    uint8_t buffer[sizeof(int64_t)];
+    uint32_t typeId = readStaticField(key, buffer);
+    if (typeId < TypeId::custom) {
+      std::shared_ptr<IOWrapper> dataStream = m_Streams.get(m_LazyStream);
+      std::shared_ptr<IOWrapper> writeStream = m_Streams.getWrite();
+      return type_read<T>(static_cast<TypeId>(typeId), reinterpret_cast<char*>(buffer), dataStream, writeStream, nullptr);
+    }
+  }
+
   uint32_t typeId;
   uint8_t* propBuffer;
   std::vector<std::string> args;
@@ -254,7 +446,7 @@ inline std::vector<T> DynObject::getList(const char *key) const {
   size_t offset;
   uint32_t typeId;
 
-  std::tie(typeId, offset) = m_Spec->get(m_ObjectIndex, key);
+  std::tie(typeId, offset) = m_Spec->get(index(), key);
   LOG_F("(2) key: \"{0}\" offset: {1}", key, offset);
   if (typeId >= TypeId::custom) {
     throw IncompatibleType("Expected POD");
@@ -271,9 +463,10 @@ inline std::vector<T> DynObject::getList(const char *key) const {
     uint64_t buff;
   };
 
-  buff = *reinterpret_cast<uint64_t*>(m_ObjectIndex->properties + offset);
+  uint8_t *propBuffer = index()->properties + offset;
+  buff = loadSlot(propBuffer);
 
-  LOG_F("(2) array index offset {0} + {1} -> count {2}, array offset {3}", reinterpret_cast<uint64_t>(m_ObjectIndex->properties), offset, arrayProp.count, arrayProp.offset);
+  LOG_F("(2) array index offset {0} + {1} -> count {2}, array offset {3}", reinterpret_cast<uint64_t>(index()->properties), offset, arrayProp.count, arrayProp.offset);
 
   uint8_t *arrayData = m_IndexTable->arrayAddress(arrayProp.offset);
 
@@ -288,12 +481,7 @@ inline std::vector<T> DynObject::getList(const char *key) const {
     memcpy(reinterpret_cast<char*>(&arrayDataPos), arrayData, sizeof(uint64_t));
     memcpy(reinterpret_cast<char*>(&streamLimit), arrayData + sizeof(uint64_t), sizeof(uint64_t));
     data->seekg(arrayDataPos);
-    m_Spec->indexEOSArray(prop, m_IndexTable, m_ObjectIndex->properties + offset,
-                          this, m_ObjectIndex->dataStream, data, streamLimit,
-                          [](uint8_t*) { return false; });
-
-    // update array info
-    buff = *reinterpret_cast<uint64_t*>(m_ObjectIndex->properties + offset);
+    buff = publishArray(propBuffer, buff, prop, data, streamLimit, nullptr);
     arrayData = m_IndexTable->arrayAddress(arrayProp.offset);
   }
 
@@ -408,5 +596,6 @@ inline void DynObject::setList(const char *key, const std::vector<T> &value) {
   for (int i = 0; i < listCount; ++i) {
     arrayPtr = type_write(static_cast<TypeId>(typeId), arrayPtr, write, value[i]);
   }
+  invalidateComputed(key);
 }
 
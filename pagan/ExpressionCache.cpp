@@ -0,0 +1,106 @@
+#include "ExpressionCache.h"
+#include "expr.h"
+#include <cctype>
+
+std::shared_ptr<const ExpressionProgram> ExpressionCache::get(const std::string &code, uint32_t scope, bool isMutable, bool *cached,
+                                                              const EnumResolver &enums) {
+  std::string normalized = normalize(code);
+  // programs bind to the type they run on by themselves, only enum literals depend on the scope
+  uint32_t keyScope = (normalized.find("::") != std::string::npos) ? scope : ANY_SCOPE;
+  auto key = std::make_tuple(keyScope, isMutable, normalized);
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto iter = m_Programs.find(key);
+  if (cached != nullptr) {
+    *cached = iter != m_Programs.end();
+  }
+  if (iter != m_Programs.end()) {
+    return iter->second;
+  }
+
+  std::shared_ptr<const ExpressionProgram> program = compile(normalized, isMutable, enums);
+  m_Programs[key] = program;
+  return program;
+}
+
+std::shared_ptr<const ExpressionProgram> ExpressionCache::compile(const std::string &code, bool isMutable, const EnumResolver &enums) {
+  try {
+    return compileExpression(code, isMutable, enums);
+  }
+  catch (const std::exception &e) {
+    throw std::runtime_error(fmt::format("failed to compile function \"{}\": {}", code, e.what()).c_str());
+  }
+}
+
+std::optional<int64_t> ExpressionCache::EnumScope::value(const std::string &enumName, const std::string &key) const {
+  for (const EnumScope *cur = this; cur != nullptr; cur = cur->outer.get()) {
+    auto enm = cur->enums.find(enumName);
+    if (enm != cur->enums.end()) {
+      // an enum hides those of the same name in enclosing types
+      auto value = enm->second.find(key);
+      return value != enm->second.end() ? std::optional<int64_t>(value->second) : std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
+void ExpressionCache::setEnumScope(uint32_t scope, std::shared_ptr<const EnumScope> enums) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_EnumScopes[scope] = std::move(enums);
+}
+
+std::optional<int64_t> ExpressionCache::enumValue(uint32_t scope, const std::string &enumName, const std::string &key) const {
+  std::shared_ptr<const EnumScope> enums;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto iter = m_EnumScopes.find(scope);
+    if (iter == m_EnumScopes.end()) {
+      return std::nullopt;
+    }
+    enums = iter->second;
+  }
+  return enums->value(enumName, key);
+}
+
+size_t ExpressionCache::size() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Programs.size();
+}
+
+std::string ExpressionCache::normalize(const std::string &code) {
+  std::string res;
+  res.reserve(code.size());
+  char quote = '\0';
+  bool space = false;
+  for (char ch : code) {
+    if (quote != '\0') {
+      res.push_back(ch);
+      if (ch == quote) {
+        quote = '\0';
+      }
+    }
+    else if (isspace(static_cast<unsigned char>(ch))) {
+      space = true;
+    }
+    else {
+      if (space && !res.empty()) {
+        res.push_back(' ');
+      }
+      space = false;
+      res.push_back(ch);
+      if ((ch == '"') || (ch == '\'')) {
+        quote = ch;
+      }
+    }
+  }
+  return res;
+}
+
+std::vector<std::string> ExpressionCache::references(const std::string &code) {
+  try {
+    return expressionReferences(code);
+  }
+  catch (const std::exception &e) {
+    throw std::runtime_error(fmt::format("failed to parse function \"{}\": {}", code, e.what()).c_str());
+  }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "ExpressionProgram.h"
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/**
+ * compiled expressions of a spec, interned by their source (ignoring insignificant whitespace),
+ * so an expression that appears many times ("size: len_data") is parsed and compiled only once,
+ * even across types. Variables keep what they resolved to for each type they ran on.
+ * The scope is the id of the type evaluating the expression, it only tells programs apart if they
+ * contain enum literals since those are resolved through the enums visible to the type
+ */
+class ExpressionCache
+{
+public:
+
+  /**
+   * the compiled expression, compiling it if it's not in the cache yet.
+   * If cached is set it receives whether the program was in the cache. enums resolves the enum
+   * literals of the expression, which should only depend on the scope
+   */
+  std::shared_ptr<const ExpressionProgram> get(const std::string &code, uint32_t scope, bool isMutable = false, bool *cached = nullptr,
+                                               const EnumResolver &enums = EnumResolver());
+
+  /**
+   * enums visible to the expressions of a type: its own, then those of each type enclosing it
+   */
+  struct EnumScope {
+    std::map<std::string, std::map<std::string, int64_t>> enums;
+    std::shared_ptr<const EnumScope> outer;
+
+    /**
+     * value of the key in the innermost enum of that name
+     */
+    std::optional<int64_t> value(const std::string &enumName, const std::string &key) const;
+  };
+
+  /**
+   * set the enums visible to the expressions of scope
+   */
+  void setEnumScope(uint32_t scope, std::shared_ptr<const EnumScope> enums);
+
+  /**
+   * value of an enum key as seen from scope, nullopt if no enum in reach has it
+   */
+  std::optional<int64_t> enumValue(uint32_t scope, const std::string &enumName, const std::string &key) const;
+
+  /**
+   * if set, expressions of a spec get compiled while it's loaded. Otherwise they are only compiled
+   * when first evaluated so loading a spec only pays for the types that actually get used
+   */
+  void setPrecompile(bool precompile) { m_Precompile = precompile; }
+
+  bool precompile() const { return m_Precompile; }
+
+  /**
+   * number of distinct programs
+   */
+  size_t size() const;
+
+  /**
+   * the expression with runs of whitespace outside of string literals collapsed and
+   * leading/trailing whitespace removed
+   */
+  static std::string normalize(const std::string &code);
+
+  /**
+   * compile without caching
+   */
+  static std::shared_ptr<const ExpressionProgram> compile(const std::string &code, bool isMutable, const EnumResolver &enums = EnumResolver());
+
+  /**
+   * dotted identifiers the expression refers to, determined from the source without compiling it.
+   * Same as ExpressionProgram::dependencies except that variables which would get folded away
+   * are included
+   */
+  static std::vector<std::string> references(const std::string &code);
+
+private:
+
+  // scope of programs that don't depend on it
+  static constexpr uint32_t ANY_SCOPE = std::numeric_limits<uint32_t>::max();
+
+  bool m_Precompile{ false };
+  mutable std::mutex m_Mutex;
+  std::map<std::tuple<uint32_t, bool, std::string>, std::shared_ptr<const ExpressionProgram>> m_Programs;
+  std::map<uint32_t, std::shared_ptr<const EnumScope>> m_EnumScopes;
+
+};
@@ -0,0 +1,51 @@
+#include "ExpressionProfiler.h"
+#include "format.h"
+#include <algorithm>
+
+std::shared_ptr<ExpressionProfiler::Site> ExpressionProfiler::addSite(const std::string &type, const std::string &property,
+                                                                      const std::string &kind, const std::string &source) {
+  std::shared_ptr<Site> site = std::make_shared<Site>();
+  site->type = type;
+  site->property = property;
+  site->kind = kind;
+  site->source = source;
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Sites.push_back(site);
+  return site;
+}
+
+std::vector<ExpressionProfiler::Record> ExpressionProfiler::report() const {
+  std::vector<Record> res;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    res.reserve(m_Sites.size());
+    for (const std::shared_ptr<Site> &site : m_Sites) {
+      res.push_back({ site->type, site->property, site->kind, site->source,
+                      site->calls.load(), site->nanoseconds.load(), site->shared.load() });
+    }
+  }
+
+  std::stable_sort(res.begin(), res.end(), [](const Record &lhs, const Record &rhs) {
+    return lhs.nanoseconds > rhs.nanoseconds;
+  });
+  return res;
+}
+
+std::string ExpressionProfiler::format() const {
+  std::string res = fmt::format("{:>12} {:>10} {:>6}  {}\n", "time (us)", "calls", "shared", "expression");
+  for (const Record &record : report()) {
+    res += fmt::format("{:>12} {:>10} {:>6}  {}.{} {}: {}\n", record.nanoseconds / 1000, record.calls, record.shared ? "yes" : "",
+                       record.type, record.property, record.kind, record.source);
+  }
+  return res;
+}
+
+void ExpressionProfiler::reset() {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const std::shared_ptr<Site> &site : m_Sites) {
+    site->calls = 0;
+    site->nanoseconds = 0;
+    site->shared = false;
+  }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <any>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class IScriptQuery;
+
+/**
+ * evaluation counts and time of the expressions of a spec, attributed to the type and property
+ * using them, so spec authors can find the expressions worth optimizing.
+ * Disabled by default, while disabled the instrumented functions only check the flag
+ */
+class ExpressionProfiler
+{
+public:
+
+  struct Site {
+    std::string type;
+    std::string property;
+    // which expression of the property ("size", "if", "repeat-expr", ...)
+    std::string kind;
+    std::string source;
+    std::atomic<uint64_t> calls{ 0 };
+    std::atomic<uint64_t> nanoseconds{ 0 };
+    // the compiled program was taken from the expression cache, so it's shared with another site
+    std::atomic<bool> shared{ false };
+  };
+
+  struct Record {
+    std::string type;
+    std::string property;
+    std::string kind;
+    std::string source;
+    uint64_t calls;
+    uint64_t nanoseconds;
+    bool shared;
+  };
+
+public:
+
+  void setEnabled(bool enabled) { m_Enabled.store(enabled, std::memory_order_relaxed); }
+
+  bool enabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+
+  std::shared_ptr<Site> addSite(const std::string &type, const std::string &property,
+                                const std::string &kind, const std::string &source);
+
+  /**
+   * all sites, the most expensive first
+   */
+  std::vector<Record> report() const;
+
+  /**
+   * report as a text table
+   */
+  std::string format() const;
+
+  /**
+   * clears the statistics of all sites
+   */
+  void reset();
+
+  /**
+   * func with its evaluations counted and timed while the profiler is enabled
+   */
+  template <typename T>
+  static std::function<T(const IScriptQuery &)> instrument(const std::function<T(const IScriptQuery &)> &func,
+                                                           const std::shared_ptr<ExpressionProfiler> &profiler,
+                                                           const std::shared_ptr<Site> &site) {
+    return [func, profiler, site](const IScriptQuery &obj) -> T {
+      if (!profiler->enabled()) {
+        return func(obj);
+      }
+      Timer timer(*site);
+      return func(obj);
+    };
+  }
+
+  template <typename T>
+  static std::function<T(IScriptQuery &, const std::any &)> instrument(const std::function<T(IScriptQuery &, const std::any &)> &func,
+                                                                       const std::shared_ptr<ExpressionProfiler> &profiler,
+                                                                       const std::shared_ptr<Site> &site) {
+    return [func, profiler, site](IScriptQuery &obj, const std::any &value) -> T {
+      if (!profiler->enabled()) {
+        return func(obj, value);
+      }
+      Timer timer(*site);
+      return func(obj, value);
+    };
+  }
+
+private:
+
+  // records one evaluation when it goes out of scope, also if the evaluation throws
+  class Timer {
+  public:
+    Timer(Site &site) : m_Site(site), m_Start(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+      auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start);
+      m_Site.calls.fetch_add(1, std::memory_order_relaxed);
+      m_Site.nanoseconds.fetch_add(static_cast<uint64_t>(duration.count()), std::memory_order_relaxed);
+    }
+  private:
+    Site &m_Site;
+    std::chrono::steady_clock::time_point m_Start;
+  };
+
+private:
+
+  std::atomic<bool> m_Enabled{ false };
+  mutable std::mutex m_Mutex;
+  std::vector<std::shared_ptr<Site>> m_Sites;
+
+};
@@ -0,0 +1,673 @@
+#include "ExpressionProgram.h"
+#include "expr.h"
+#include <algorithm>
+#include <memory>
+#include <numeric>
+
+typedef ExpressionProgram::OpCode OpCode;
+
+// programs that need no more stack than this don't allocate
+static const size_t INLINE_STACK_DEPTH = 8;
+
+static const std::map<std::string, OpCode> binaryOperators{
+  { "+", OpCode::ADD },
+  { "-", OpCode::SUB },
+  { "*", OpCode::MUL },
+  { "/", OpCode::DIV },
+  { "%", OpCode::MOD },
+  { "<<", OpCode::SHL },
+  { ">>", OpCode::SHR },
+  { "<", OpCode::LT },
+  { ">", OpCode::GT },
+  { "<=", OpCode::LE },
+  { ">=", OpCode::GE },
+  { "==", OpCode::EQ },
+  { "!=", OpCode::NE },
+  { "&", OpCode::BIT_AND },
+  { "^", OpCode::BIT_XOR },
+  { "|", OpCode::BIT_OR },
+};
+
+// functions available to setters
+static const std::map<std::string, AnyFunc> functions{
+  { "length", [](const std::any& args) -> std::any {
+    try {
+      return std::any_cast<std::string>(args).length();
+    } catch (const std::bad_any_cast&) {
+      return std::any_cast<std::vector<uint8_t>>(args).size();
+    }
+  } },
+  { "size", [](const std::any& args) -> std::any {
+    return flexi_cast<std::string>(args).length() + 1;
+  } },
+};
+
+// stands in for the object while folding constants, which never refer to it
+class NoObject : public IScriptQuery {
+public:
+  std::any getAny(char *) const override { throw std::runtime_error("not constant"); }
+  std::any getAny(std::string) const override { throw std::runtime_error("not constant"); }
+  std::any getAny(const std::vector<std::string>::const_iterator &, const std::vector<std::string>::const_iterator &) const override {
+    throw std::runtime_error("not constant");
+  }
+  void setAny(const std::vector<std::string>::const_iterator &, const std::vector<std::string>::const_iterator &, const std::any &) override {
+    throw std::runtime_error("not constant");
+  }
+};
+
+static bool dependsOnObject(OpCode op) {
+  return (op == OpCode::VARIABLE) || (op == OpCode::VALUE) || (op == OpCode::CALL) || (op == OpCode::CALL_DYNAMIC);
+}
+
+static bool isJump(OpCode op) {
+  return (op == OpCode::JUMP) || (op == OpCode::JUMP_IF_FALSE) || (op == OpCode::JUMP_IF_FALSE_OR_POP)
+      || (op == OpCode::JUMP_IF_TRUE_OR_POP) || (op == OpCode::JUMP_IF_SET_OR_POP);
+}
+
+class ExpressionCompiler {
+public:
+
+  ExpressionCompiler(ExpressionProgram &program, bool isMutable, const EnumResolver &enums)
+    : m_Program(program)
+    , m_Mutable(isMutable)
+    , m_Enums(enums)
+  {
+  }
+
+  void compileRoot(const MyNode &root) {
+    if (root.children.empty()) {
+      throw std::runtime_error("empty expression");
+    }
+    compile(*root.children.back());
+    if (root.children.size() == 2) {
+      m_Program.m_AssignTo = splitVariable(root.children.front()->content());
+    }
+  }
+
+private:
+
+  void compile(const MyNode &node) {
+    size_t start = m_Program.m_Instructions.size();
+    size_t depth = m_Depth;
+    compileNode(node);
+    fold(start, depth);
+  }
+
+  void compileNode(const MyNode &node) {
+    if (node.is<ExpressionSpec::Infix>()) {
+      compileInfix(node);
+    }
+    else if (node.is<ExpressionSpec::Function>()) {
+      std::string name = node.children.at(0)->content();
+      auto func = functions.find(name);
+      if (m_Mutable && (func != functions.end())) {
+        compile(*node.children.at(1));
+        m_Program.m_Functions.push_back(func->second);
+        emit(OpCode::CALL, static_cast<uint32_t>(m_Program.m_Functions.size() - 1));
+      }
+      else {
+        compile(*node.children.at(0));
+        compile(*node.children.at(1));
+        emit(OpCode::CALL_DYNAMIC);
+      }
+    }
+    else if (node.is<ExpressionSpec::Identifier>()) {
+      compileIdentifier(node.content());
+    }
+    else if (node.is<ExpressionSpec::EnumLiteral>()) {
+      compileEnumLiteral(node.content());
+    }
+    else if (node.is<ExpressionSpec::HexNumber>()) {
+      constant(ScriptValue::integer(strtoll(node.content().c_str(), nullptr, 16)));
+    }
+    else if (node.is<ExpressionSpec::Number>()) {
+      constant(ScriptValue::integer(strtoll(node.content().c_str(), nullptr, 10)));
+    }
+    else if (node.is<ExpressionSpec::String>()) {
+      constant(ScriptValue::string(std::string(node.m_begin.data + 1, node.m_end.data - 1)));
+    }
+    else if (node.is<ExpressionSpec::Not>()) {
+      compile(*node.children.at(0));
+      emit(OpCode::NOT);
+    }
+    else if (node.is<ExpressionSpec::Expression>()) {
+      throw std::runtime_error("unresolved expression");
+    }
+    else {
+      throw std::runtime_error(fmt::format("unexpected node \"{}\"", node.content()));
+    }
+  }
+
+  void compileInfix(const MyNode &node) {
+    std::string op = node.content();
+    const MyNode &lhs = *node.children.at(0);
+    const MyNode &rhs = *node.children.at(1);
+
+    if ((op == "&&") || (op == "and") || (op == "||") || (op == "or")) {
+      bool isAnd = (op == "&&") || (op == "and");
+      size_t start = m_Program.m_Instructions.size();
+      size_t depth = m_Depth;
+      compile(lhs);
+      bool lhsValue;
+      if (constantBool(start, lhsValue)) {
+        truncate(start, depth);
+        if (lhsValue != isAnd) {
+          // false && x, true || x
+          constant(ScriptValue::boolean(lhsValue));
+        }
+        else {
+          compile(rhs);
+          emit(OpCode::TO_BOOL);
+        }
+        return;
+      }
+
+      size_t jump = emit(isAnd ? OpCode::JUMP_IF_FALSE_OR_POP : OpCode::JUMP_IF_TRUE_OR_POP);
+      size_t rhsDepth = m_Depth;
+      compile(rhs);
+      bool rhsValue;
+      if (constantBool(jump + 1, rhsValue)) {
+        if (rhsValue != isAnd) {
+          // x && false, x || true
+          truncate(start, depth);
+          constant(ScriptValue::boolean(rhsValue));
+        }
+        else {
+          truncate(jump, rhsDepth + 1);
+          emit(OpCode::TO_BOOL);
+        }
+        return;
+      }
+      emit(OpCode::TO_BOOL);
+      patch(jump);
+    }
+    else if (op == "?") {
+      // without a matching ":" the false case produces an empty value
+      if (compileStaticCondition(lhs, &rhs, nullptr)) {
+        return;
+      }
+      size_t skipTrue = emit(OpCode::JUMP_IF_FALSE);
+      compile(rhs);
+      size_t skipFalse = emit(OpCode::JUMP);
+      patch(skipTrue);
+      --m_Depth;
+      emit(OpCode::EMPTY);
+      patch(skipFalse);
+    }
+    else if (op == ":") {
+      if (lhs.is<ExpressionSpec::Infix>() && (lhs.content() == "?")
+          && !(lhs.children.at(1)->is<ExpressionSpec::Infix>() && (lhs.children.at(1)->content() == "?"))) {
+        // regular "cond ? a : b", the true case can't produce an empty value so select directly
+        if (compileStaticCondition(*lhs.children.at(0), lhs.children.at(1).get(), &rhs)) {
+          return;
+        }
+        size_t skipTrue = emit(OpCode::JUMP_IF_FALSE);
+        compile(*lhs.children.at(1));
+        size_t skipFalse = emit(OpCode::JUMP);
+        patch(skipTrue);
+        --m_Depth;
+        compile(rhs);
+        patch(skipFalse);
+      }
+      else {
+        compile(lhs);
+        size_t jump = emit(OpCode::JUMP_IF_SET_OR_POP);
+        compile(rhs);
+        patch(jump);
+      }
+    }
+    else {
+      auto iter = binaryOperators.find(op);
+      if (iter == binaryOperators.end()) {
+        throw std::runtime_error(fmt::format("unsupported operator \"{}\"", op));
+      }
+      compile(lhs);
+      compile(rhs);
+      emit(iter->second);
+    }
+  }
+
+  void compileIdentifier(const std::string &name) {
+    if (m_Mutable && (name == "value")) {
+      emit(OpCode::VALUE);
+      return;
+    }
+
+    auto func = functions.find(name);
+    if (m_Mutable && (func != functions.end())) {
+      constant(ScriptValue::other(func->second));
+      return;
+    }
+
+    m_Program.m_Variables.push_back(std::make_shared<PropertyPath>(splitVariable(name)));
+    emit(OpCode::VARIABLE, static_cast<uint32_t>(m_Program.m_Variables.size() - 1));
+  }
+
+  // enum values are integers at runtime so the literal becomes a plain number
+  void compileEnumLiteral(const std::string &literal) {
+    size_t keyPos = literal.rfind("::");
+    size_t enumPos = literal.rfind("::", keyPos - 1);
+    std::string enumName = literal.substr(enumPos == std::string::npos ? 0 : enumPos + 2,
+                                          enumPos == std::string::npos ? keyPos : keyPos - enumPos - 2);
+    std::optional<int64_t> value = m_Enums ? m_Enums(enumName, literal.substr(keyPos + 2)) : std::nullopt;
+    if (!value.has_value()) {
+      throw std::runtime_error(fmt::format("unknown enum value \"{}\"", literal));
+    }
+    constant(ScriptValue::integer(*value));
+  }
+
+  void constant(const ScriptValue &value) {
+    m_Program.m_Constants.push_back(value);
+    emit(OpCode::CONSTANT, static_cast<uint32_t>(m_Program.m_Constants.size() - 1));
+  }
+
+  size_t emit(OpCode op, uint32_t arg = 0) {
+    switch (op) {
+      case OpCode::CONSTANT:
+      case OpCode::VARIABLE:
+      case OpCode::VALUE:
+      case OpCode::EMPTY:
+        ++m_Depth;
+        break;
+      case OpCode::CALL:
+      case OpCode::NOT:
+      case OpCode::TO_BOOL:
+      case OpCode::JUMP:
+        break;
+      default:
+        // binary operators and the conditional jumps (on the path that doesn't jump)
+        --m_Depth;
+        break;
+    }
+    m_Program.m_MaxDepth = std::max(m_Program.m_MaxDepth, m_Depth);
+    m_Program.m_Instructions.push_back({ op, arg });
+    return m_Program.m_Instructions.size() - 1;
+  }
+
+  /**
+   * compile the condition of a ternary. If it's constant, only the branch that gets taken is
+   * compiled (no branch meaning an empty value) and true is returned
+   */
+  bool compileStaticCondition(const MyNode &condition, const MyNode *ifTrue, const MyNode *ifFalse) {
+    size_t start = m_Program.m_Instructions.size();
+    size_t depth = m_Depth;
+    compile(condition);
+    bool value;
+    if (!constantBool(start, value)) {
+      return false;
+    }
+
+    truncate(start, depth);
+    const MyNode *branch = value ? ifTrue : ifFalse;
+    if (branch != nullptr) {
+      compile(*branch);
+    }
+    else {
+      emit(OpCode::EMPTY);
+    }
+    return true;
+  }
+
+  // true if the only instruction since start is a constant that can be used as a condition
+  bool constantBool(size_t start, bool &value) const {
+    const std::vector<ExpressionProgram::Instruction> &instructions = m_Program.m_Instructions;
+    if ((instructions.size() != start + 1) || (instructions[start].op != OpCode::CONSTANT)) {
+      return false;
+    }
+    const ScriptValue &constant = m_Program.m_Constants[instructions[start].arg];
+    if (!constant.isNumber()) {
+      return false;
+    }
+    value = constant.toBool();
+    return true;
+  }
+
+  // replace the instructions emitted since start with their result if they don't depend on the object
+  void fold(size_t start, size_t depth) {
+    std::vector<ExpressionProgram::Instruction> &instructions = m_Program.m_Instructions;
+    if (instructions.size() - start < 2) {
+      return;
+    }
+
+    ExpressionProgram constantPart;
+    constantPart.m_Constants = m_Program.m_Constants;
+    constantPart.m_MaxDepth = m_Program.m_MaxDepth;
+    for (size_t i = start; i < instructions.size(); ++i) {
+      ExpressionProgram::Instruction ins = instructions[i];
+      if (dependsOnObject(ins.op)) {
+        return;
+      }
+      if (isJump(ins.op)) {
+        ins.arg -= static_cast<uint32_t>(start);
+      }
+      constantPart.m_Instructions.push_back(ins);
+    }
+
+    ScriptValue value;
+    try {
+      value = constantPart.run(NoObject());
+      if (value.isString()) {
+        // don't refer to the constants of the temporary program
+        value = ScriptValue::string(value.toString());
+      }
+    }
+    catch (const std::exception&) {
+      // report errors (like a division by zero) when the expression is evaluated, as before
+      return;
+    }
+
+    truncate(start, depth);
+    constant(value);
+  }
+
+  void truncate(size_t size, size_t depth) {
+    m_Program.m_Instructions.resize(size);
+    m_Depth = depth;
+  }
+
+  // make the jump at the specified position go to the next instruction
+  void patch(size_t jump) {
+    m_Program.m_Instructions[jump].arg = static_cast<uint32_t>(m_Program.m_Instructions.size());
+  }
+
+private:
+
+  ExpressionProgram &m_Program;
+  bool m_Mutable;
+  const EnumResolver &m_Enums;
+  size_t m_Depth{ 0 };
+
+};
+
+std::shared_ptr<const ExpressionProgram> compileExpression(const MyNode &tree, bool isMutable, const EnumResolver &enums) {
+  std::shared_ptr<ExpressionProgram> res = std::make_shared<ExpressionProgram>();
+  ExpressionCompiler compiler(*res, isMutable, enums);
+  compiler.compileRoot(tree);
+  return res;
+}
+
+std::shared_ptr<const ExpressionProgram> compileExpression(const std::string &code, bool isMutable, const EnumResolver &enums) {
+  ExpressionSpec::Operators operators;
+  pegtl::string_input<> expressionString(code, "source");
+  auto tree = pegtl::parse_tree::parse<ExpressionSpec::Grammar, MyNode, ExpressionSpec::Selector>(expressionString, operators);
+  return compileExpression(*tree, isMutable, enums);
+}
+
+static void collectReferences(const MyNode &node, std::vector<std::string> &result) {
+  if (node.is<ExpressionSpec::Identifier>()) {
+    std::string name = node.content();
+    if (std::find(result.begin(), result.end(), name) == result.end()) {
+      result.push_back(name);
+    }
+    return;
+  }
+  for (const auto &child : node.children) {
+    collectReferences(*child, result);
+  }
+}
+
+std::vector<std::string> expressionReferences(const std::string &code) {
+  ExpressionSpec::Operators operators;
+  pegtl::string_input<> expressionString(code, "source");
+  auto tree = pegtl::parse_tree::parse<ExpressionSpec::Grammar, MyNode, ExpressionSpec::Selector>(expressionString, operators);
+  std::vector<std::string> res;
+  collectReferences(*tree, res);
+  return res;
+}
+
+std::optional<ScriptValue> evaluateStatic(const std::string &code) {
+  std::shared_ptr<const ExpressionProgram> program = compileExpression(code);
+  const ScriptValue *constant = program->constant();
+  if (constant == nullptr) {
+    return std::nullopt;
+  }
+  return *constant;
+}
+
+std::vector<std::string> ExpressionProgram::dependencies() const {
+  std::vector<std::string> res;
+  for (const Instruction &ins : m_Instructions) {
+    if (ins.op != OpCode::VARIABLE) {
+      continue;
+    }
+    const std::vector<std::string> &segments = m_Variables[ins.arg]->segments();
+    std::string path = std::accumulate(segments.begin() + 1, segments.end(), segments.front(),
+                                       [](const std::string &lhs, const std::string &rhs) { return lhs + "." + rhs; });
+    if (std::find(res.begin(), res.end(), path) == res.end()) {
+      res.push_back(path);
+    }
+  }
+  return res;
+}
+
+static bool isComparison(OpCode op) {
+  return (op == OpCode::LT) || (op == OpCode::GT) || (op == OpCode::LE)
+      || (op == OpCode::GE) || (op == OpCode::EQ) || (op == OpCode::NE);
+}
+
+// the comparison with its operands swapped, "5 < x" is "x > 5"
+static OpCode mirror(OpCode op) {
+  switch (op) {
+    case OpCode::LT: return OpCode::GT;
+    case OpCode::GT: return OpCode::LT;
+    case OpCode::LE: return OpCode::GE;
+    case OpCode::GE: return OpCode::LE;
+    default: return op;
+  }
+}
+
+std::optional<ExpressionProgram::ColumnPredicate> ExpressionProgram::columnPredicate() const {
+  auto isInteger = [this](const Instruction &ins) {
+    if (ins.op != OpCode::CONSTANT) {
+      return false;
+    }
+    ScriptValue::Type type = m_Constants[ins.arg].type();
+    return (type == ScriptValue::Type::INTEGER) || (type == ScriptValue::Type::BOOLEAN);
+  };
+
+  std::vector<Instruction> code = m_Instructions;
+  if (!code.empty() && (code.back().op == OpCode::TO_BOOL)) {
+    code.pop_back();
+  }
+  if (!m_AssignTo.empty() || (code.size() < 3) || !isComparison(code.back().op)) {
+    return std::nullopt;
+  }
+
+  ColumnPredicate res;
+  res.op = code.back().op;
+  code.pop_back();
+
+  // the operand that isn't the constant, either "x" or "x & mask"
+  std::vector<Instruction> operand;
+  if (isInteger(code.back())) {
+    res.constant = m_Constants[code.back().arg].toInteger();
+    operand.assign(code.begin(), code.end() - 1);
+  }
+  else if (isInteger(code.front())) {
+    res.constant = m_Constants[code.front().arg].toInteger();
+    res.op = mirror(res.op);
+    operand.assign(code.begin() + 1, code.end());
+  }
+  else {
+    return std::nullopt;
+  }
+
+  if ((operand.size() == 3) && (operand[2].op == OpCode::BIT_AND)) {
+    size_t maskPos = isInteger(operand[1]) ? 1 : 0;
+    if (!isInteger(operand[maskPos])) {
+      return std::nullopt;
+    }
+    res.masked = true;
+    res.mask = m_Constants[operand[maskPos].arg].toInteger();
+    operand.erase(operand.begin() + maskPos);
+    operand.pop_back();
+  }
+
+  if ((operand.size() != 1) || (operand[0].op != OpCode::VARIABLE)) {
+    return std::nullopt;
+  }
+  res.path = m_Variables[operand[0].arg]->segments();
+  return res;
+}
+
+template <typename Compare>
+static void compareColumn(const int64_t *values, size_t count, bool masked, int64_t mask, int64_t constant,
+                          uint8_t *results, Compare compare) {
+  // all-ones leaves the values unchanged so there's only one loop to vectorize
+  int64_t effectiveMask = masked ? mask : ~int64_t(0);
+  for (size_t i = 0; i < count; ++i) {
+    results[i] = static_cast<uint8_t>(compare(values[i] & effectiveMask, constant));
+  }
+}
+
+void ExpressionProgram::ColumnPredicate::evaluate(const int64_t *values, size_t count, uint8_t *results) const {
+  switch (op) {
+    case OpCode::LT: compareColumn(values, count, masked, mask, constant, results, std::less<int64_t>()); break;
+    case OpCode::GT: compareColumn(values, count, masked, mask, constant, results, std::greater<int64_t>()); break;
+    case OpCode::LE: compareColumn(values, count, masked, mask, constant, results, std::less_equal<int64_t>()); break;
+    case OpCode::GE: compareColumn(values, count, masked, mask, constant, results, std::greater_equal<int64_t>()); break;
+    case OpCode::EQ: compareColumn(values, count, masked, mask, constant, results, std::equal_to<int64_t>()); break;
+    case OpCode::NE: compareColumn(values, count, masked, mask, constant, results, std::not_equal_to<int64_t>()); break;
+    default: throw std::runtime_error("not a comparison");
+  }
+}
+
+ScriptValue ExpressionProgram::run(const IScriptQuery &obj, const std::any *value) const {
+  if (m_MaxDepth <= INLINE_STACK_DEPTH) {
+    ScriptValue stack[INLINE_STACK_DEPTH];
+    return execute(stack, obj, value);
+  }
+  else {
+    std::unique_ptr<ScriptValue[]> stack(new ScriptValue[m_MaxDepth]);
+    return execute(stack.get(), obj, value);
+  }
+}
+
+template <typename Op>
+static ScriptValue arithmetic(const ScriptValue &lhs, const ScriptValue &rhs, Op op) {
+  if ((lhs.type() == ScriptValue::Type::DOUBLE) || (rhs.type() == ScriptValue::Type::DOUBLE)) {
+    return ScriptValue::real(op(lhs.toDouble(), rhs.toDouble()));
+  }
+  return ScriptValue::integer(op(lhs.toInteger(), rhs.toInteger()));
+}
+
+template <typename Op>
+static ScriptValue compare(const ScriptValue &lhs, const ScriptValue &rhs, Op op) {
+  if ((lhs.type() == ScriptValue::Type::DOUBLE) || (rhs.type() == ScriptValue::Type::DOUBLE)) {
+    return ScriptValue::boolean(op(lhs.toDouble(), rhs.toDouble()));
+  }
+  return ScriptValue::boolean(op(lhs.toInteger(), rhs.toInteger()));
+}
+
+ScriptValue ExpressionProgram::execute(ScriptValue *stack, const IScriptQuery &obj, const std::any *value) const {
+  // top points at the topmost value
+  ScriptValue *top = stack - 1;
+
+  size_t pc = 0;
+  size_t count = m_Instructions.size();
+  while (pc < count) {
+    const Instruction &ins = m_Instructions[pc++];
+    switch (ins.op) {
+      case OpCode::CONSTANT: {
+        const ScriptValue &constant = m_Constants[ins.arg];
+        // the program outlives the evaluation so strings don't need to be copied
+        *++top = constant.isString() ? ScriptValue::view(constant.stringView()) : constant;
+      } break;
+      case OpCode::VARIABLE: {
+        *++top = obj.getValue(*m_Variables[ins.arg]);
+      } break;
+      case OpCode::VALUE: {
+        *++top = (value != nullptr) ? ScriptValue::fromAny(*value) : ScriptValue();
+      } break;
+      case OpCode::EMPTY: {
+        *++top = ScriptValue();
+      } break;
+      case OpCode::CALL: {
+        *top = ScriptValue::fromAny(m_Functions[ins.arg](top->toAny()));
+      } break;
+      case OpCode::CALL_DYNAMIC: {
+        ScriptValue res = ScriptValue::fromAny(std::any_cast<AnyFunc>(top[-1].otherValue())(top->toAny()));
+        --top;
+        *top = std::move(res);
+      } break;
+      case OpCode::ADD: {
+        --top;
+        if (top->isString()) {
+          // script language supports + for string concatenation
+          std::string res(top->stringView());
+          res += top[1].isString() ? std::string(top[1].stringView()) : top[1].toString();
+          *top = ScriptValue::string(std::move(res));
+        }
+        else {
+          *top = arithmetic(*top, top[1], [](auto lhs, auto rhs) { return lhs + rhs; });
+        }
+      } break;
+      case OpCode::SUB: --top; *top = arithmetic(*top, top[1], [](auto lhs, auto rhs) { return lhs - rhs; }); break;
+      case OpCode::MUL: --top; *top = arithmetic(*top, top[1], [](auto lhs, auto rhs) { return lhs * rhs; }); break;
+      case OpCode::DIV: {
+        --top;
+        if ((top[1].type() != ScriptValue::Type::DOUBLE) && (top[1].toInteger() == 0)) {
+          throw std::runtime_error("division by zero");
+        }
+        *top = arithmetic(*top, top[1], [](auto lhs, auto rhs) { return lhs / rhs; });
+      } break;
+      case OpCode::MOD: {
+        --top;
+        int64_t rhs = top[1].toInteger();
+        if (rhs == 0) {
+          throw std::runtime_error("division by zero");
+        }
+        *top = ScriptValue::integer(top->toInteger() % rhs);
+      } break;
+      case OpCode::SHL: --top; *top = ScriptValue::integer(top->toInteger() << top[1].toInteger()); break;
+      case OpCode::SHR: --top; *top = ScriptValue::integer(top->toInteger() >> top[1].toInteger()); break;
+      case OpCode::LT: --top; *top = compare(*top, top[1], [](auto lhs, auto rhs) { return lhs < rhs; }); break;
+      case OpCode::GT: --top; *top = compare(*top, top[1], [](auto lhs, auto rhs) { return lhs > rhs; }); break;
+      case OpCode::LE: --top; *top = compare(*top, top[1], [](auto lhs, auto rhs) { return lhs <= rhs; }); break;
+      case OpCode::GE: --top; *top = compare(*top, top[1], [](auto lhs, auto rhs) { return lhs >= rhs; }); break;
+      case OpCode::EQ: --top; *top = ScriptValue::boolean(top->equals(top[1])); break;
+      case OpCode::NE: --top; *top = ScriptValue::boolean(!top->equals(top[1])); break;
+      case OpCode::BIT_AND: --top; *top = ScriptValue::integer(top->toInteger() & top[1].toInteger()); break;
+      case OpCode::BIT_XOR: --top; *top = ScriptValue::integer(top->toInteger() ^ top[1].toInteger()); break;
+      case OpCode::BIT_OR: --top; *top = ScriptValue::integer(top->toInteger() | top[1].toInteger()); break;
+      case OpCode::NOT: *top = ScriptValue::boolean(!top->toBool()); break;
+      case OpCode::TO_BOOL: *top = ScriptValue::boolean(top->toBool()); break;
+      case OpCode::JUMP: pc = ins.arg; break;
+      case OpCode::JUMP_IF_FALSE: {
+        bool cond = top->toBool();
+        --top;
+        if (!cond) {
+          pc = ins.arg;
+        }
+      } break;
+      case OpCode::JUMP_IF_FALSE_OR_POP: {
+        if (!top->toBool()) {
+          *top = ScriptValue::boolean(false);
+          pc = ins.arg;
+        }
+        else {
+          --top;
+        }
+      } break;
+      case OpCode::JUMP_IF_TRUE_OR_POP: {
+        if (top->toBool()) {
+          *top = ScriptValue::boolean(true);
+          pc = ins.arg;
+        }
+        else {
+          --top;
+        }
+      } break;
+      case OpCode::JUMP_IF_SET_OR_POP: {
+        if (!top->empty()) {
+          pc = ins.arg;
+        }
+        else {
+          --top;
+        }
+      } break;
+    }
+  }
+
+  return std::move(*top);
+}
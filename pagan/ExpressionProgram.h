@@ -0,0 +1,155 @@
+#pragma once
+
+#include "PropertyPath.h"
+#include "ScriptValue.h"
+#include <any>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class IScriptQuery;
+
+typedef std::function<std::any(const std::any& args)> AnyFunc;
+
+/**
+ * integer value of a key of an enum, nullopt if the enum or key doesn't exist.
+ * Used to turn enum literals ("record_type::grup") into constants while compiling
+ */
+typedef std::function<std::optional<int64_t>(const std::string &enumName, const std::string &key)> EnumResolver;
+
+/**
+ * compiled form of an expression.
+ * The parse tree is translated once into a flat list of instructions for a small stack machine,
+ * with operators, literals and identifiers resolved up front and subexpressions that don't
+ * depend on the object folded into constants. Evaluating it is a single loop
+ * over the instructions that does no lookups by name and works on ScriptValues rather than std::any.
+ * && and || short-circuit
+ */
+class ExpressionProgram
+{
+  friend class ExpressionCompiler;
+
+public:
+
+  enum class OpCode : uint8_t {
+    // push constant #arg
+    CONSTANT,
+    // push the value of variable #arg
+    VARIABLE,
+    // push the value passed to a setter
+    VALUE,
+    // push an empty value
+    EMPTY,
+    // call function #arg with the top value as the argument
+    CALL,
+    // call the function below the top value with the top value as the argument
+    CALL_DYNAMIC,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    SHL,
+    SHR,
+    LT,
+    GT,
+    LE,
+    GE,
+    EQ,
+    NE,
+    BIT_AND,
+    BIT_XOR,
+    BIT_OR,
+    NOT,
+    TO_BOOL,
+    // continue at instruction #arg
+    JUMP,
+    // pop the top value and jump if it's false
+    JUMP_IF_FALSE,
+    // jump if the top value is false (replacing it with false), pop it otherwise
+    JUMP_IF_FALSE_OR_POP,
+    // jump if the top value is true (replacing it with true), pop it otherwise
+    JUMP_IF_TRUE_OR_POP,
+    // jump if the top value isn't empty, pop it otherwise
+    JUMP_IF_SET_OR_POP,
+  };
+
+  struct Instruction {
+    OpCode op;
+    uint32_t arg;
+  };
+
+  /**
+   * comparison of a single integer property against a constant, optionally masked:
+   * "x < 5" or "(flags & 4) != 0". Those can be evaluated over a whole column of values at once
+   */
+  struct ColumnPredicate {
+    std::vector<std::string> path;
+    OpCode op;
+    bool masked{ false };
+    int64_t mask{ 0 };
+    int64_t constant{ 0 };
+
+    /**
+     * store the result for each of count values in results (1 or 0). The loop doesn't branch
+     * so it gets vectorized
+     */
+    void evaluate(const int64_t *values, size_t count, uint8_t *results) const;
+  };
+
+public:
+
+  /**
+   * evaluate the program. value is what "value" refers to in setters
+   */
+  ScriptValue run(const IScriptQuery &obj, const std::any *value = nullptr) const;
+
+  /**
+   * variable the result gets assigned to, empty if the expression isn't an assignment
+   */
+  const std::vector<std::string> &assignTo() const {
+    return m_AssignTo;
+  }
+
+  /**
+   * the result if it doesn't depend on the object (after folding constant subexpressions),
+   * null otherwise
+   */
+  const ScriptValue *constant() const {
+    return ((m_Instructions.size() == 1) && (m_Instructions[0].op == OpCode::CONSTANT) && m_AssignTo.empty())
+      ? &m_Constants[m_Instructions[0].arg]
+      : nullptr;
+  }
+
+  /**
+   * properties the program reads, as dotted paths relative to the object it's evaluated on
+   * (including _parent/_root hops). Variables that got folded away aren't included
+   */
+  std::vector<std::string> dependencies() const;
+
+  /**
+   * the program as a column predicate if it has that form
+   */
+  std::optional<ColumnPredicate> columnPredicate() const;
+
+  const std::vector<Instruction> &instructions() const {
+    return m_Instructions;
+  }
+
+private:
+
+  ScriptValue execute(ScriptValue *stack, const IScriptQuery &obj, const std::any *value) const;
+
+private:
+
+  std::vector<Instruction> m_Instructions;
+  std::vector<ScriptValue> m_Constants;
+  std::vector<std::shared_ptr<PropertyPath>> m_Variables;
+  std::vector<AnyFunc> m_Functions;
+  std::vector<std::string> m_AssignTo;
+  size_t m_MaxDepth{ 0 };
+
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "PropertyPath.h"
 #include <string>
 
 class IScriptQuery {
@@ -8,6 +9,14 @@ public:
   virtual std::any getAny(std::string key) const = 0;
   virtual std::any getAny(const std::vector<std::string>::const_iterator &cur, const std::vector<std::string>::const_iterator &end) const = 0;
 
+  virtual std::any getAny(const PropertyPath &path) const {
+    return getAny(path.segments().cbegin(), path.segments().cend());
+  }
+
+  virtual ScriptValue getValue(const PropertyPath &path) const {
+    return ScriptValue::fromAny(getAny(path));
+  }
+
   virtual void setAny(const std::vector<std::string>::const_iterator& cur, const std::vector<std::string>::const_iterator& end, const std::any& value) = 0;
 };
 
@@ -0,0 +1,182 @@
+#include "IncrementalIndexer.h"
+#include "ObjectIndexTable.h"
+#include "TypeSpec.h"
+#include <algorithm>
+
+thread_local IncrementalIndexer *IncrementalIndexer::s_Active = nullptr;
+
+IncrementalIndexer::IncrementalIndexer(const std::shared_ptr<TypeSpec> &spec, const StreamRegistry &streams, ObjectIndexTable *indexTable,
+                                       DataStreamId dataStream, size_t offset, bool asList)
+  : m_Spec(spec)
+  , m_Streams(streams)
+  , m_IndexTable(indexTable)
+  , m_DataStream(dataStream)
+  , m_Offset(offset)
+  , m_AsList(asList)
+{
+  m_Thread = std::thread([this]() { run(); });
+}
+
+IncrementalIndexer::~IncrementalIndexer()
+{
+  cancel();
+}
+
+bool IncrementalIndexer::step(std::chrono::milliseconds slice) {
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  if (m_State == State::INDEXING) {
+    m_SliceEnd = std::chrono::steady_clock::now() + slice;
+    m_Running = true;
+    m_Wake.notify_all();
+    m_Wake.wait(lock, [this]() { return !m_Running; });
+  }
+
+  if (m_Error) {
+    std::rethrow_exception(m_Error);
+  }
+  return m_State == State::INDEXING;
+}
+
+void IncrementalIndexer::cancel() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Cancel = true;
+    m_Wake.notify_all();
+  }
+  if (m_Thread.joinable()) {
+    m_Thread.join();
+  }
+}
+
+IncrementalIndexer::State IncrementalIndexer::getState() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_State;
+}
+
+IncrementalIndexer::Progress IncrementalIndexer::getProgress() const {
+  return Progress{ m_BytesConsumed, m_BytesTotal, m_ItemsIndexed };
+}
+
+size_t IncrementalIndexer::numItems() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_AsList ? m_Items.size() : 0;
+}
+
+std::vector<DynObject> IncrementalIndexer::getItems(size_t count) const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!m_AsList) {
+    throw std::runtime_error("not indexing a list");
+  }
+  return std::vector<DynObject>(m_Items.begin(), m_Items.begin() + std::min(count, m_Items.size()));
+}
+
+DynObject IncrementalIndexer::getResult() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_AsList) {
+    throw std::runtime_error("indexing a list, use getItems");
+  }
+  if (m_State != State::DONE) {
+    throw std::runtime_error("object not indexed yet");
+  }
+  return m_Items.front();
+}
+
+void IncrementalIndexer::run() {
+  {
+    // wait for the first slice
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Wake.wait(lock, [this]() { return m_Running || m_Cancel; });
+  }
+
+  s_Active = this;
+  try {
+    if (m_Cancel) {
+      throw IndexCanceled();
+    }
+    if (m_AsList) {
+      indexList();
+    }
+    else {
+      indexObject();
+    }
+    finish(State::DONE);
+  }
+  catch (const IndexCanceled&) {
+    finish(State::CANCELED);
+  }
+  catch (const std::exception &e) {
+    LOG_F("incremental indexing failed: {}", e.what());
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Error = std::current_exception();
+    m_State = State::FAILED;
+    m_Running = false;
+    m_Wake.notify_all();
+  }
+  s_Active = nullptr;
+}
+
+void IncrementalIndexer::indexObject() {
+  std::shared_ptr<IOWrapper> data = m_Streams.get(m_DataStream, m_Offset);
+  m_BytesTotal = static_cast<uint64_t>(data->size()) - m_Offset;
+
+  ObjectIndex *index = m_IndexTable->allocateObject(m_Spec, m_DataStream, m_Offset);
+  DynObject res(m_Spec, m_Streams, m_IndexTable, index, nullptr);
+  res.writeIndex(m_Offset, data->size(), true);
+  m_BytesConsumed = static_cast<uint64_t>(data->tellg()) - m_Offset;
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Items.push_back(res);
+}
+
+void IncrementalIndexer::indexList() {
+  std::shared_ptr<IOWrapper> data = m_Streams.get(m_DataStream, m_Offset);
+  std::streampos limit = data->size();
+  m_BytesTotal = static_cast<uint64_t>(limit) - m_Offset;
+
+  DataOffset pos = m_Offset;
+  try {
+    while (static_cast<std::streampos>(pos) < limit) {
+      ObjectIndex *index = m_IndexTable->allocateObject(m_Spec, m_DataStream, pos);
+      DynObject item(m_Spec, m_Streams, m_IndexTable, index, nullptr);
+      item.writeIndex(pos, limit, true);
+      pos = data->tellg();
+      {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Items.push_back(item);
+      }
+      report(pos, 0);
+    }
+  }
+  catch (const std::ios::failure &e) {
+    // same as a dynamic length array, a truncated last item ends the list
+    LOG_F("incremental list indexing ended: {}", e.what());
+  }
+}
+
+void IncrementalIndexer::progress(std::streampos pos, uint32_t numObjects) {
+  m_ItemsIndexed += numObjects;
+  uint64_t consumed = static_cast<uint64_t>(pos) - m_Offset;
+  // subtree tasks report positions out of order
+  uint64_t prev = m_BytesConsumed;
+  while ((consumed > prev) && (consumed <= m_BytesTotal) && !m_BytesConsumed.compare_exchange_weak(prev, consumed)) {
+  }
+
+  if (!m_Cancel && (std::chrono::steady_clock::now() < m_SliceEnd)) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_Running = false;
+  m_Wake.notify_all();
+  m_Wake.wait(lock, [this]() { return m_Running || m_Cancel; });
+  if (m_Cancel) {
+    throw IndexCanceled();
+  }
+}
+
+void IncrementalIndexer::finish(State state) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_State = state;
+  m_Running = false;
+  m_Wake.notify_all();
+}
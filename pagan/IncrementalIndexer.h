@@ -0,0 +1,136 @@
+#pragma once
+
+#include "DynObject.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * thrown inside the indexer when indexing gets canceled, never reaches the caller.
+ * Deliberately not a std::exception so that handlers which recover from parse errors don't
+ * swallow it
+ */
+class IndexCanceled {
+};
+
+/**
+ * indexes a top-level object or list in bounded slices so the caller stays responsive while a
+ * large file gets indexed.
+ * Indexing happens on a thread of its own but only while the caller is inside step(), in
+ * between it's suspended, so the effect is the same as that of a resumable parse. Items of a
+ * top-level list can be used as soon as they're complete
+ */
+class IncrementalIndexer
+{
+public:
+
+  enum class State {
+    INDEXING,
+    DONE,
+    CANCELED,
+    FAILED
+  };
+
+  struct Progress {
+    // position in the data stream relative to the start of the object
+    uint64_t bytesConsumed;
+    uint64_t bytesTotal;
+    // number of objects (including nested ones) with a complete index
+    uint64_t itemsIndexed;
+  };
+
+public:
+
+  /**
+   * prepare indexing an object of type spec (or a list of them up to the end of the stream if asList
+   * is set) at the specified offset. Nothing happens until the first call to step
+   */
+  IncrementalIndexer(const std::shared_ptr<TypeSpec> &spec, const StreamRegistry &streams, ObjectIndexTable *indexTable,
+                     DataStreamId dataStream, size_t offset, bool asList);
+  ~IncrementalIndexer();
+
+  IncrementalIndexer(const IncrementalIndexer &reference) = delete;
+  IncrementalIndexer &operator=(const IncrementalIndexer &reference) = delete;
+
+  /**
+   * continue indexing for (roughly) the specified time. Returns true if there is more to do,
+   * rethrows the error if indexing failed
+   */
+  bool step(std::chrono::milliseconds slice);
+
+  /**
+   * stop indexing. The list items completed so far stay valid
+   */
+  void cancel();
+
+  State getState() const;
+
+  Progress getProgress() const;
+
+  /**
+   * number of complete items of a top-level list
+   */
+  size_t numItems() const;
+
+  /**
+   * the first (up to) count complete items of a top-level list
+   */
+  std::vector<DynObject> getItems(size_t count) const;
+
+  /**
+   * the indexed object, only available once indexing is done
+   */
+  DynObject getResult() const;
+
+  /**
+   * called by the indexing code after it advanced the data stream to pos, numObjects being the
+   * number of objects it completed. Suspends the indexer if its time slice is used up
+   */
+  static void report(std::streampos pos, uint32_t numObjects) {
+    if (s_Active != nullptr) {
+      s_Active->progress(pos, numObjects);
+    }
+  }
+
+private:
+
+  void run();
+  void indexObject();
+  void indexList();
+  void progress(std::streampos pos, uint32_t numObjects);
+  void finish(State state);
+
+private:
+
+  static thread_local IncrementalIndexer *s_Active;
+
+  std::shared_ptr<TypeSpec> m_Spec;
+  const StreamRegistry &m_Streams;
+  ObjectIndexTable *m_IndexTable;
+  DataStreamId m_DataStream;
+  size_t m_Offset;
+  bool m_AsList;
+
+  std::atomic<uint64_t> m_BytesTotal{ 0 };
+  std::atomic<uint64_t> m_BytesConsumed{ 0 };
+  std::atomic<uint64_t> m_ItemsIndexed{ 0 };
+
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_Wake;
+  // true while the indexer thread has the turn
+  bool m_Running{ false };
+  std::atomic<bool> m_Cancel{ false };
+  State m_State{ State::INDEXING };
+  std::exception_ptr m_Error;
+  // only changes while the indexer is suspended
+  std::chrono::steady_clock::time_point m_SliceEnd;
+
+  std::vector<DynObject> m_Items;
+
+  std::thread m_Thread;
+
+};
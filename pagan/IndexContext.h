@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * mutable state of one parse. Types only describe a format and don't change once loaded so
+ * any number of parses can use the same types concurrently, each with its own context
+ */
+class IndexContext
+{
+public:
+
+  /**
+   * offset into the current byte for consecutive bit fields in an object of the specified type
+   */
+  uint32_t &bitOffset(uint32_t typeId) {
+    if (m_BitOffsets.size() <= typeId) {
+      m_BitOffsets.resize(typeId + 1, 0);
+    }
+    return m_BitOffsets[typeId];
+  }
+
+private:
+
+  std::vector<uint32_t> m_BitOffsets;
+
+};
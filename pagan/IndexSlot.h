@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+/**
+ * slots referencing custom objects hold the data offset of the object until it gets indexed,
+ * after that the negated address of its ObjectIndex. Once a file is parsed, readers on several
+ * threads may index the same object lazily at the same time so slots that can change after
+ * indexing are read and published only through these functions. The first thread to publish
+ * wins, the others have to use its result and discard their own.
+ * Slots inside a property buffer aren't necessarily 8 byte aligned, those fall back to a
+ * striped spin lock
+ */
+
+static_assert(sizeof(std::atomic<int64_t>) == sizeof(int64_t), "atomic slots need to fit the index");
+
+class SlotLock {
+public:
+  explicit SlotLock(const uint8_t *slot)
+    : m_Lock(stripe(slot))
+  {
+    while (m_Lock.exchange(true, std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+
+  ~SlotLock() {
+    m_Lock.store(false, std::memory_order_release);
+  }
+
+  SlotLock(const SlotLock &reference) = delete;
+  SlotLock &operator=(const SlotLock &reference) = delete;
+
+private:
+
+  static std::atomic<bool> &stripe(const uint8_t *slot) {
+    static std::atomic<bool> s_Stripes[64];
+    return s_Stripes[(reinterpret_cast<uintptr_t>(slot) >> 3) % 64];
+  }
+
+private:
+
+  std::atomic<bool> &m_Lock;
+
+};
+
+inline bool isSlotAligned(const uint8_t *slot) {
+  return reinterpret_cast<uintptr_t>(slot) % alignof(std::atomic<int64_t>) == 0;
+}
+
+inline int64_t loadSlot(const uint8_t *slot) {
+  if (isSlotAligned(slot)) {
+    return reinterpret_cast<const std::atomic<int64_t>*>(slot)->load(std::memory_order_acquire);
+  }
+  SlotLock lock(slot);
+  int64_t res;
+  memcpy(&res, slot, sizeof(int64_t));
+  return res;
+}
+
+/**
+ * store desired in the slot unless it no longer holds expected.
+ * Returns what the slot holds afterwards, so the caller published successfully if that's desired
+ */
+inline int64_t publishSlot(uint8_t *slot, int64_t expected, int64_t desired) {
+  if (isSlotAligned(slot)) {
+    std::atomic<int64_t> *atomicSlot = reinterpret_cast<std::atomic<int64_t>*>(slot);
+    return atomicSlot->compare_exchange_strong(expected, desired, std::memory_order_acq_rel)
+      ? desired
+      : expected;
+  }
+  SlotLock lock(slot);
+  int64_t current;
+  memcpy(&current, slot, sizeof(int64_t));
+  if (current != expected) {
+    return current;
+  }
+  memcpy(slot, &desired, sizeof(int64_t));
+  return desired;
+}
@@ -0,0 +1,47 @@
+#include "ListView.h"
+#include "expr.h"
+#include "ExpressionCache.h"
+#include "TypeSpec.h"
+#include "TypeRegistry.h"
+
+std::vector<size_t> ListView::select(const std::string &expression) const {
+  // enums are looked up in the item type, then in the owner and its parents
+  std::shared_ptr<TypeSpec> itemType = (m_TypeId >= TypeId::custom) ? m_Owner.getSpec()->getRegistry()->getById(m_TypeId) : nullptr;
+  const DynObject &owner = m_Owner;
+  EnumResolver enums = [itemType, &owner](const std::string &enumName, const std::string &key) -> std::optional<int64_t> {
+    std::optional<int32_t> res = (itemType != nullptr) ? itemType->enumValue(enumName, key) : std::nullopt;
+    if (!res.has_value()) {
+      res = owner.enumValue(enumName, key);
+    }
+    return res;
+  };
+  // the same selection tends to be made repeatedly, the program is shared with the expressions
+  // of the item type
+  std::shared_ptr<ExpressionCache> cache = m_Owner.getSpec()->getRegistry()->getExpressions();
+  std::shared_ptr<const ExpressionProgram> program = (cache != nullptr)
+    ? cache->get(expression, m_TypeId, false, nullptr, enums)
+    : compileExpression(expression, false, enums);
+  std::vector<size_t> res;
+
+  std::optional<ExpressionProgram::ColumnPredicate> predicate = program->columnPredicate();
+  if (predicate.has_value() && (predicate->path.size() == 1)) {
+    std::vector<int64_t> values(size());
+    if (m_Owner.readArrayColumn(m_TypeId, m_Array, m_Count, predicate->path[0].c_str(), values.data())) {
+      std::vector<uint8_t> matches(size());
+      predicate->evaluate(values.data(), values.size(), matches.data());
+      for (size_t i = 0; i < matches.size(); ++i) {
+        if (matches[i] != 0) {
+          res.push_back(i);
+        }
+      }
+      return res;
+    }
+  }
+
+  for (size_t i = 0; i < size(); ++i) {
+    if (program->run((*this)[i]).toBool()) {
+      res.push_back(i);
+    }
+  }
+  return res;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "DynObject.h"
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * list of objects that are only materialized when accessed.
+ * Creating the view resolves the array index (which still requires indexing a dynamic length
+ * array) but unlike getList<DynObject> it doesn't create, let alone index, any of the items,
+ * so finding one item among many only pays for the ones actually looked at.
+ * Iterators share a copy of the owning object so they remain valid after the view is gone
+ */
+class ListView
+{
+public:
+
+  class const_iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = DynObject;
+    using difference_type = std::ptrdiff_t;
+    // items are produced on the fly so there is nothing to reference
+    using reference = DynObject;
+
+    struct pointer {
+      DynObject item;
+      const DynObject *operator->() const { return &item; }
+    };
+
+    const_iterator(const std::shared_ptr<const DynObject> &owner, uint8_t *array, uint32_t typeId, ObjSize index)
+      : m_Owner(owner), m_Array(array), m_TypeId(typeId), m_Index(index)
+    {
+    }
+
+    DynObject operator*() const { return item(*m_Owner, m_Array, m_TypeId, m_Index); }
+    pointer operator->() const { return pointer{ **this }; }
+    DynObject operator[](difference_type offset) const { return item(*m_Owner, m_Array, m_TypeId, m_Index + offset); }
+
+    const_iterator &operator++() { ++m_Index; return *this; }
+    const_iterator operator++(int) { const_iterator res(*this); ++m_Index; return res; }
+    const_iterator &operator--() { --m_Index; return *this; }
+    const_iterator operator--(int) { const_iterator res(*this); --m_Index; return res; }
+    const_iterator &operator+=(difference_type offset) { m_Index += static_cast<ObjSize>(offset); return *this; }
+    const_iterator &operator-=(difference_type offset) { m_Index -= static_cast<ObjSize>(offset); return *this; }
+    const_iterator operator+(difference_type offset) const { return const_iterator(m_Owner, m_Array, m_TypeId, m_Index + static_cast<ObjSize>(offset)); }
+    const_iterator operator-(difference_type offset) const { return const_iterator(m_Owner, m_Array, m_TypeId, m_Index - static_cast<ObjSize>(offset)); }
+    difference_type operator-(const const_iterator &rhs) const { return m_Index - rhs.m_Index; }
+
+    bool operator==(const const_iterator &rhs) const { return m_Index == rhs.m_Index; }
+    bool operator!=(const const_iterator &rhs) const { return m_Index != rhs.m_Index; }
+    bool operator<(const const_iterator &rhs) const { return m_Index < rhs.m_Index; }
+    bool operator>(const const_iterator &rhs) const { return m_Index > rhs.m_Index; }
+    bool operator<=(const const_iterator &rhs) const { return m_Index <= rhs.m_Index; }
+    bool operator>=(const const_iterator &rhs) const { return m_Index >= rhs.m_Index; }
+
+  private:
+    std::shared_ptr<const DynObject> m_Owner;
+    uint8_t *m_Array;
+    uint32_t m_TypeId;
+    ObjSize m_Index;
+  };
+
+  typedef const_iterator iterator;
+
+public:
+
+  ListView(const DynObject &owner, uint8_t *array, ObjSize count, uint32_t typeId)
+    : m_Owner(owner), m_Array(array), m_Count(count), m_TypeId(typeId)
+  {
+  }
+
+  size_t size() const {
+    return static_cast<size_t>(m_Count);
+  }
+
+  bool empty() const {
+    return m_Count == 0;
+  }
+
+  /**
+   * item at the specified position, no bounds check
+   */
+  DynObject operator[](size_t index) const {
+    return item(m_Owner, m_Array, m_TypeId, index);
+  }
+
+  DynObject at(size_t index) const {
+    if (index >= size()) {
+      throw std::out_of_range(fmt::format("list index out of range: {}", index));
+    }
+    return (*this)[index];
+  }
+
+  /**
+   * positions of the items for which the expression is true.
+   * Comparisons of a single integer field against a constant ("type == 3", "(flags & 1) != 0")
+   * read that field for all items in one pass and evaluate the comparison over the whole column,
+   * other expressions get evaluated item by item
+   */
+  std::vector<size_t> select(const std::string &expression) const;
+
+  const_iterator begin() const { return const_iterator(std::make_shared<DynObject>(m_Owner), m_Array, m_TypeId, 0); }
+  const_iterator end() const { return const_iterator(std::make_shared<DynObject>(m_Owner), m_Array, m_TypeId, m_Count); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+private:
+
+  static DynObject item(const DynObject &owner, uint8_t *array, uint32_t typeId, size_t index) {
+    // object items all take the same space in the array index
+    size_t itemSize = (typeId == TypeId::runtime) ? sizeof(uint32_t) + sizeof(int64_t) : sizeof(int64_t);
+    uint8_t *arrayCur = array + itemSize * index;
+    return owner.getArrayItem(typeId, &arrayCur);
+  }
+
+private:
+
+  // copy of the object owning the list, parent of all items
+  DynObject m_Owner;
+  uint8_t *m_Array;
+  ObjSize m_Count;
+  uint32_t m_TypeId;
+
+};
+
+inline ListView::const_iterator operator+(ListView::const_iterator::difference_type offset, const ListView::const_iterator &iter) {
+  return iter + offset;
+}
@@ -0,0 +1,17 @@
+#include "ObjectHandle.h"
+#include "DynObject.h"
+#include "TypeSpec.h"
+#include "TypeRegistry.h"
+#include "objectindex.h"
+
+uint32_t ObjectHandle::getTypeId() const {
+  return m_Index->typeId;
+}
+
+DynObject ObjectHandle::toObject(const DynObject &context, const DynObject *parent) const {
+  if (m_Index == nullptr) {
+    throw std::runtime_error("invalid object handle");
+  }
+  std::shared_ptr<TypeSpec> type = context.getSpec()->getRegistry()->getById(m_Index->typeId);
+  return DynObject(type, context.getStreams(), context.getIndexTable(), m_Index, parent);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+class DynObject;
+struct ObjectIndex;
+
+/**
+ * reference to an indexed object that is as cheap to copy and store as a pointer, for keeping
+ * large numbers of objects around. All the other state of a DynObject (streams, index table, type)
+ * is the same for every object of a parse, it gets supplied when the handle is turned back into
+ * a full object
+ */
+class ObjectHandle
+{
+public:
+
+  ObjectHandle() = default;
+
+  explicit ObjectHandle(ObjectIndex *index)
+    : m_Index(index)
+  {
+  }
+
+  bool isValid() const {
+    return m_Index != nullptr;
+  }
+
+  ObjectIndex *getIndex() const {
+    return m_Index;
+  }
+
+  uint32_t getTypeId() const;
+
+  /**
+   * full object for this handle, reading through the streams and index table of context which
+   * has to be an object of the same parse. Expressions referring to the parent only work if it
+   * is specified
+   */
+  DynObject toObject(const DynObject &context, const DynObject *parent = nullptr) const;
+
+  bool operator==(const ObjectHandle &rhs) const {
+    return m_Index == rhs.m_Index;
+  }
+
+  bool operator!=(const ObjectHandle &rhs) const {
+    return m_Index != rhs.m_Index;
+  }
+
+private:
+
+  ObjectIndex *m_Index{ nullptr };
+
+};
+
+static_assert(sizeof(ObjectHandle) == sizeof(void*), "object handles are supposed to be pointer-sized");
+static_assert(std::is_trivially_copyable<ObjectHandle>::value, "object handles are supposed to be trivially copyable");
@@ -1,5 +1,6 @@
 #include "objectindextable.h"
 #include "typespec.h"
+#include "constants.h"
 
 
 static const uint32_t CHUNK_SIZE = 64 * 1024;
@@ -9,22 +10,41 @@ static const uint32_t CHUNK_SIZE = 64 * 1024;
 //   8000 items
 static const uint8_t ARRAY_CHUNK_SIZE_BITS = 24;
 static const uint32_t ARRAY_CHUNK_SIZE = static_cast<uint32_t>((1 << ARRAY_CHUNK_SIZE_BITS) - 1);
+// array offsets are 32 bit, the upper bits select the chunk
+static const size_t MAX_ARRAY_CHUNKS = 1 << 8;
+// objects whose computed properties are cached at the same time
+static const size_t MAX_CACHED_OBJECTS = 64 * 1024;
 
 
 ObjectIndexTable::ObjectIndexTable()
 {
   addObjBuffer();
   addPropBuffer();
+  // the chunk list must never be reallocated since arrays may be resolved by other threads
+  // while a new chunk gets added
+  m_ArrayBuffers.reserve(MAX_ARRAY_CHUNKS);
   addArrayBuffer();
 }
 
+ObjectIndexTable::ObjectIndexTable(ObjectIndexTable *root)
+  : m_Root(root)
+{
+  addObjBuffer();
+  addPropBuffer();
+}
+
 
 ObjectIndexTable::~ObjectIndexTable()
 {
 }
 
 
-ObjectIndex *ObjectIndexTable::allocateObject(const std::shared_ptr<TypeSpec> type, DataStreamId dataStream, DataOffset dataOffset) {
+ObjectIndex *ObjectIndexTable::allocateObject(const std::shared_ptr<TypeSpec> type, DataStreamId dataStream, DataOffset dataOffset, ObjectIndex *parent) {
+  ObjectIndexTable *arena = threadArena();
+  if (arena != nullptr) {
+    return arena->allocateObject(type, dataStream, dataOffset, parent);
+  }
+
   int bitsetSize = (type->getNumProperties() + 7) / 8;
 
   uint32_t indexSize = (MIN_OBJECT_INDEX_SIZE + bitsetSize);
@@ -37,23 +57,67 @@ ObjectIndex *ObjectIndexTable::allocateObject(const std::shared_ptr<TypeSpec> ty
 
   m_NextFreeObjIndex += indexSize;
   ++m_ObjectCount;
+  account(indexSize);
 
-  return initIndex(target, type, dataStream, dataOffset);
+  return initIndex(target, type, dataStream, dataOffset, parent);
 }
 
 void ObjectIndexTable::setProperties(ObjectIndex *obj, uint8_t *buffer, size_t size) {
+  allocateProperties(obj, size);
+
+  assignProperies(obj, buffer, size);
+}
+
+uint8_t *ObjectIndexTable::allocateProperties(ObjectIndex *obj, size_t size) {
+  ObjectIndexTable *arena = threadArena();
+  if (arena != nullptr) {
+    return arena->allocateProperties(obj, size);
+  }
+
   if (CHUNK_SIZE - m_NextFreePropIndex < size) {
     addPropBuffer();
   }
 
   obj->properties = **m_PropBuffers.rbegin() + m_NextFreePropIndex;
 
-  assignProperies(obj, buffer, size);
-
   m_NextFreePropIndex += static_cast<uint32_t>(size);
+  account(size);
+
+  return obj->properties;
+}
+
+ObjectIndexTable::Mark ObjectIndexTable::mark() {
+  ObjectIndexTable *arena = threadArena();
+  if (arena != nullptr) {
+    return arena->mark();
+  }
+  return { this, m_ObjBuffers.size(), m_NextFreeObjIndex, m_ObjectCount, m_PropBuffers.size(), m_NextFreePropIndex };
+}
+
+bool ObjectIndexTable::release(const Mark &mark) {
+  if (mark.table != this) {
+    return mark.table->release(mark);
+  }
+  if ((m_ObjBuffers.size() != mark.objBuffers) || (m_PropBuffers.size() != mark.propBuffers)) {
+    return false;
+  }
+  const uint8_t *objBuffer = *m_ObjBuffers.back();
+  ObjectIndexTable *root = m_Root != nullptr ? m_Root : this;
+  root->dropComputed(objBuffer + mark.nextFreeObj, objBuffer + m_NextFreeObjIndex);
+
+  unaccount((m_NextFreeObjIndex - mark.nextFreeObj) + (m_NextFreePropIndex - mark.nextFreeProp));
+  m_NextFreeObjIndex = mark.nextFreeObj;
+  m_ObjectCount = mark.objectCount;
+  m_NextFreePropIndex = mark.nextFreeProp;
+  return true;
 }
 
 ObjSize ObjectIndexTable::allocateArray(uint32_t size) {
+  if (m_Root != nullptr) {
+    return m_Root->allocateArray(size);
+  }
+
+  std::lock_guard<std::mutex> lock(m_ArrayMutex);
   if (size > ARRAY_CHUNK_SIZE) {
     throw std::runtime_error(fmt::format("array too long: {} > {}", size, ARRAY_CHUNK_SIZE));
   }
@@ -66,17 +130,212 @@ ObjSize ObjectIndexTable::allocateArray(uint32_t size) {
 
   m_NextFreeArrayIndex += size;
   ++m_ObjectCount;
+  account(size);
 
   return offset;
 }
 
 uint8_t *ObjectIndexTable::arrayAddress(ObjSize offset) {
+  if (m_Root != nullptr) {
+    return m_Root->arrayAddress(offset);
+  }
   uint32_t idx = offset & ARRAY_CHUNK_SIZE;
   uint32_t arrayNum = (offset & (0xFFFFFFFF - ARRAY_CHUNK_SIZE)) >> ARRAY_CHUNK_SIZE_BITS;
 
   return m_ArrayBuffers[arrayNum].get()[0] + idx;
 }
 
+ObjectIndexTable *ObjectIndexTable::createArena() {
+  if (m_Root != nullptr) {
+    return m_Root->createArena();
+  }
+
+  std::lock_guard<std::mutex> lock(m_ArenaMutex);
+  m_Arenas.push_back(std::unique_ptr<ObjectIndexTable>(new ObjectIndexTable(this)));
+  return m_Arenas.rbegin()->get();
+}
+
+size_t ObjectIndexTable::memoryUsage() const {
+  return m_Root != nullptr ? m_Root->memoryUsage() : m_MemoryUsage.load();
+}
+
+uint32_t ObjectIndexTable::numObjectIndices() const {
+  uint32_t res = m_ObjectCount;
+  for (const auto &arena : m_Arenas) {
+    res += arena->numObjectIndices();
+  }
+  return res;
+}
+
+ObjSize ObjectIndexTable::scanPosition(const uint8_t *arrayProp, ObjSize num, DataOffset start, DataOffset &offset) {
+  if (m_Root != nullptr) {
+    return m_Root->scanPosition(arrayProp, num, start, offset);
+  }
+  std::lock_guard<std::mutex> lock(m_ItemScanMutex);
+  auto iter = m_ItemScans.find(arrayProp);
+  if (iter == m_ItemScans.end()) {
+    offset = start;
+    return 0;
+  }
+  const ItemScan &scan = iter->second;
+  if (num >= scan.count) {
+    offset = scan.next;
+    return scan.count;
+  }
+  size_t checkpoint = static_cast<size_t>(num / CHECKPOINT_INTERVAL);
+  offset = scan.checkpoints[checkpoint];
+  return static_cast<ObjSize>(checkpoint * CHECKPOINT_INTERVAL);
+}
+
+void ObjectIndexTable::addLocatedItem(const uint8_t *arrayProp, ObjSize num, DataOffset offset, DataOffset next) {
+  if (m_Root != nullptr) {
+    m_Root->addLocatedItem(arrayProp, num, offset, next);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_ItemScanMutex);
+  ItemScan &scan = m_ItemScans[arrayProp];
+  if (num != scan.count) {
+    return;
+  }
+  if (num % CHECKPOINT_INTERVAL == 0) {
+    scan.checkpoints.push_back(offset);
+  }
+  ++scan.count;
+  scan.next = next;
+}
+
+bool ObjectIndexTable::scannedItem(const uint8_t *arrayProp, ObjSize num, ScannedItem &item) {
+  if (m_Root != nullptr) {
+    return m_Root->scannedItem(arrayProp, num, item);
+  }
+  std::lock_guard<std::mutex> lock(m_ItemScanMutex);
+  auto iter = m_ItemScans.find(arrayProp);
+  if (iter == m_ItemScans.end()) {
+    return false;
+  }
+  auto itemIter = iter->second.items.find(num);
+  if (itemIter == iter->second.items.end()) {
+    return false;
+  }
+  item = itemIter->second;
+  return true;
+}
+
+bool ObjectIndexTable::addScannedItem(const uint8_t *arrayProp, ObjSize num, ScannedItem &item) {
+  if (m_Root != nullptr) {
+    return m_Root->addScannedItem(arrayProp, num, item);
+  }
+  std::lock_guard<std::mutex> lock(m_ItemScanMutex);
+  ItemScan &scan = m_ItemScans[arrayProp];
+  if (scan.sealed) {
+    return false;
+  }
+  item = scan.items.emplace(num, item).first->second;
+  return true;
+}
+
+ObjectIndexTable::ItemScan ObjectIndexTable::sealScannedItems(const uint8_t *arrayProp) {
+  if (m_Root != nullptr) {
+    return m_Root->sealScannedItems(arrayProp);
+  }
+  std::lock_guard<std::mutex> lock(m_ItemScanMutex);
+  auto iter = m_ItemScans.find(arrayProp);
+  if (iter == m_ItemScans.end()) {
+    return ItemScan();
+  }
+  iter->second.sealed = true;
+  return iter->second;
+}
+
+void ObjectIndexTable::dropScannedItems(const uint8_t *arrayProp) {
+  if (m_Root != nullptr) {
+    m_Root->dropScannedItems(arrayProp);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_ItemScanMutex);
+  m_ItemScans.erase(arrayProp);
+}
+
+bool ObjectIndexTable::cachedComputed(const ObjectIndex *obj, uint32_t num, bool isLocal, std::any &value) {
+  if (m_Root != nullptr) {
+    return m_Root->cachedComputed(obj, num, isLocal, value);
+  }
+  std::lock_guard<std::mutex> lock(m_ComputedMutex);
+  auto iter = m_ComputedCache.find(obj);
+  if ((iter == m_ComputedCache.end()) || (iter->second.size() <= num)) {
+    return false;
+  }
+  const CachedValue &cached = iter->second[num];
+  if (!cached.valid || (!isLocal && (cached.generation != m_ComputedGeneration))) {
+    return false;
+  }
+  value = cached.value;
+  return true;
+}
+
+void ObjectIndexTable::cacheComputed(const ObjectIndex *obj, uint32_t num, const std::any &value) {
+  if (m_Root != nullptr) {
+    m_Root->cacheComputed(obj, num, value);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_ComputedMutex);
+  if (m_ComputedCache.size() >= MAX_CACHED_OBJECTS) {
+    // this is only meant to speed up repeated access to the same objects, not to keep the results
+    // for the entire file
+    m_ComputedCache.clear();
+  }
+  std::vector<CachedValue> &values = m_ComputedCache[obj];
+  if (values.size() <= num) {
+    values.resize(num + 1);
+  }
+  values[num] = { value, m_ComputedGeneration, true };
+}
+
+void ObjectIndexTable::invalidateComputed(const ObjectIndex *obj, const std::vector<uint32_t> &nums) {
+  if (m_Root != nullptr) {
+    m_Root->invalidateComputed(obj, nums);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_ComputedMutex);
+  // computed properties of other objects may depend on this one
+  ++m_ComputedGeneration;
+  auto iter = m_ComputedCache.find(obj);
+  if (iter == m_ComputedCache.end()) {
+    return;
+  }
+  for (uint32_t num : nums) {
+    if (num < iter->second.size()) {
+      iter->second[num].valid = false;
+    }
+  }
+}
+
+void ObjectIndexTable::account(size_t bytes) {
+  ObjectIndexTable *root = m_Root != nullptr ? m_Root : this;
+  root->m_MemoryUsage.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ObjectIndexTable::unaccount(size_t bytes) {
+  ObjectIndexTable *root = m_Root != nullptr ? m_Root : this;
+  root->m_MemoryUsage.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void ObjectIndexTable::dropComputed(const uint8_t *begin, const uint8_t *end) {
+  std::lock_guard<std::mutex> lock(m_ComputedMutex);
+  for (auto iter = m_ComputedCache.begin(); iter != m_ComputedCache.end();) {
+    const uint8_t *obj = reinterpret_cast<const uint8_t*>(iter->first);
+    if ((obj >= begin) && (obj < end)) {
+      iter = m_ComputedCache.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+ObjectIndexTable *ObjectIndexTable::threadArena() {
+  return m_ThreadArenas.get([this]() { return createArena(); });
+}
+
 void ObjectIndexTable::addObjBuffer() {
   if (m_ObjBuffers.size() > 0) {
     // for debugging purposes we store how much of each chunk is actually used
@@ -106,6 +365,10 @@ std::vector<uint8_t> ObjectIndexTable::getObjectIndex() const {
   uint8_t *from = *(m_ObjBuffers.rbegin()->get());
   uint8_t* to = from + m_NextFreeObjIndex;
   result.insert(result.end(), from, to);
+  for (const auto &arena : m_Arenas) {
+    std::vector<uint8_t> arenaIndex = arena->getObjectIndex();
+    result.insert(result.end(), arenaIndex.begin(), arenaIndex.end());
+  }
   return result;
 }
 
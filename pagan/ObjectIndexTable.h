@@ -2,9 +2,15 @@
 
 #include <vector>
 #include <memory>
+#include <any>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include "objectindex.h"
 #include "types.h"
 #include "streamregistry.h"
+#include "PerThread.h"
 
 class TypeSpec;
 
@@ -15,9 +21,17 @@ public:
   ObjectIndexTable();
   ~ObjectIndexTable();
 
-  ObjectIndex *allocateObject(const std::shared_ptr<TypeSpec> type, DataStreamId dataStream, DataOffset dataOffset);
+  /**
+   * allocate the index for an object. Threads other than the one that allocated first are
+   * transparently served from an arena of their own, that goes for allocateProperties as well
+   */
+  ObjectIndex *allocateObject(const std::shared_ptr<TypeSpec> type, DataStreamId dataStream, DataOffset dataOffset, ObjectIndex *parent = nullptr);
   void setProperties(ObjectIndex *obj, uint8_t *buffer, size_t size);
 
+  // reserve space for the properties of an object without initializing it. The return value points
+  // to the property buffer (same as obj->properties after the call)
+  uint8_t *allocateProperties(ObjectIndex *obj, size_t size);
+
   // allocate space for an array of the specified size in bytes
   // The (32bit) return value can be used with "arrayAddress" to get at the concrete address of the array
   ObjSize allocateArray(uint32_t size);
@@ -25,7 +39,101 @@ public:
   // used to get the full address of the specified 32bit array
   uint8_t *arrayAddress(ObjSize offset);
 
-  uint32_t numObjectIndices() const { return m_ObjectCount; }
+  // allocation state of the table serving the calling thread
+  struct Mark {
+    ObjectIndexTable *table;
+    size_t objBuffers;
+    uint32_t nextFreeObj;
+    uint32_t objectCount;
+    size_t propBuffers;
+    uint32_t nextFreeProp;
+  };
+
+  Mark mark();
+
+  /**
+   * release the objects and properties the calling thread allocated since mark was taken, nothing
+   * may refer to them any more. Arrays aren't released and neither is anything if a new chunk was
+   * started in the meantime. Returns true if the memory was released
+   */
+  bool release(const Mark &mark);
+
+  /**
+   * create a table for use by a single thread while indexing in parallel.
+   * Objects allocated from the arena remain valid for the lifetime of this table. Arrays are
+   * always allocated from this table so array offsets resolve the same through either table.
+   * Allocating arrays is the only operation that is safe to use from several threads concurrently
+   */
+  ObjectIndexTable *createArena();
+
+  // item of an array that hasn't been indexed yet (COUNT_EOS), indexed because it was accessed
+  struct ScannedItem {
+    DataOffset offset{0};
+    DataOffset end{0};
+    // type and (negated) object index address, as they would appear in the array index
+    uint32_t typeId{0};
+    int64_t objOffset{0};
+  };
+
+  /**
+   * what is known about an array that hasn't been indexed yet (COUNT_EOS). Items are located front
+   * to back, items 0 to count - 1 have been located and item count starts at data offset next.
+   * Only the offset of every CHECKPOINT_INTERVAL-th item is kept, plus the items that were indexed
+   */
+  struct ItemScan {
+    std::vector<DataOffset> checkpoints;
+    ObjSize count{0};
+    DataOffset next{0};
+    std::map<ObjSize, ScannedItem> items;
+    // the array is being indexed, items indexed from now on wouldn't become part of it
+    bool sealed{false};
+  };
+
+  /**
+   * closest position at or before item num to locate it from, in the array identified by the
+   * address of its property in the properties index. Returns the number of that item, offset
+   * receives where it starts. That's item 0 at start if nothing was located yet
+   */
+  ObjSize scanPosition(const uint8_t *arrayProp, ObjSize num, DataOffset start, DataOffset &offset);
+
+  // record that item num starts at offset and the item after it at next
+  void addLocatedItem(const uint8_t *arrayProp, ObjSize num, DataOffset offset, DataOffset next);
+
+  // fills item and returns true if item num has been indexed before
+  bool scannedItem(const uint8_t *arrayProp, ObjSize num, ScannedItem &item);
+
+  /**
+   * record an indexed item. If another thread was first, item receives the one recorded before.
+   * Returns false without recording anything if the array is already being indexed
+   */
+  bool addScannedItem(const uint8_t *arrayProp, ObjSize num, ScannedItem &item);
+
+  /**
+   * what is known about the array, to be reused while indexing it. Items indexed after this call
+   * don't get recorded any more
+   */
+  ItemScan sealScannedItems(const uint8_t *arrayProp);
+
+  // drop what is known about an array, to be called once the array is fully indexed
+  void dropScannedItems(const uint8_t *arrayProp);
+
+  /**
+   * cached result of computed property num of an object. Results of computed properties that
+   * aren't local (depend on other objects) are only valid until the next call to
+   * invalidateComputed for any object.
+   * Returns false if there is no valid cached result
+   */
+  bool cachedComputed(const ObjectIndex *obj, uint32_t num, bool isLocal, std::any &value);
+
+  void cacheComputed(const ObjectIndex *obj, uint32_t num, const std::any &value);
+
+  // drop the cached results of the specified computed properties of an object after it was modified
+  void invalidateComputed(const ObjectIndex *obj, const std::vector<uint32_t> &nums);
+
+  // bytes of index memory handed out by this table and its arenas
+  size_t memoryUsage() const;
+
+  uint32_t numObjectIndices() const;
   uint32_t numArrayIndices() const { return m_ArrayCount; }
 
   /**
@@ -42,6 +150,14 @@ public:
 
 private:
 
+  explicit ObjectIndexTable(ObjectIndexTable *root);
+
+  ObjectIndexTable *threadArena();
+  void account(size_t bytes);
+  void unaccount(size_t bytes);
+  // drop cached computed properties of objects in the range [begin, end)
+  void dropComputed(const uint8_t *begin, const uint8_t *end);
+
   void addObjBuffer();
   void addPropBuffer();
   void addArrayBuffer();
@@ -58,5 +174,27 @@ private:
   std::vector<std::unique_ptr<uint8_t*>> m_ArrayBuffers;
   uint32_t m_NextFreeArrayIndex = {0};
   uint32_t m_ArrayCount = 0;
+
+  std::unordered_map<const uint8_t*, ItemScan> m_ItemScans;
+  std::mutex m_ItemScanMutex;
+
+  struct CachedValue {
+    std::any value;
+    // value of m_ComputedGeneration when it was cached
+    uint32_t generation;
+    bool valid;
+  };
+
+  std::unordered_map<const ObjectIndex*, std::vector<CachedValue>> m_ComputedCache;
+  uint32_t m_ComputedGeneration{ 0 };
+  std::mutex m_ComputedMutex;
+
+  // table that owns the arrays if this is an arena, nullptr otherwise
+  ObjectIndexTable *m_Root{ nullptr };
+  std::vector<std::unique_ptr<ObjectIndexTable>> m_Arenas;
+  std::mutex m_ArrayMutex;
+  std::mutex m_ArenaMutex;
+  PerThread<ObjectIndexTable> m_ThreadArenas;
+  std::atomic<size_t> m_MemoryUsage{ 0 };
 };
 
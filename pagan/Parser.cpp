@@ -1,10 +1,14 @@
 #include "Parser.h"
 #include "TypeSpec.h"
+#include "ThreadPool.h"
 
 
 Parser::Parser()
   : m_TypeRegistry(TypeRegistry::init())
+  , m_Expressions(std::make_shared<ExpressionCache>())
+  , m_Profiler(std::make_shared<ExpressionProfiler>())
 {
+  m_TypeRegistry->setExpressions(m_Expressions);
 }
 
 Parser::~Parser()
@@ -21,6 +25,25 @@ bool Parser::hasInputData() const {
   return m_HasInputData;
 }
 
+void Parser::setIndexThreads(unsigned int numThreads) {
+  m_TypeRegistry->setIndexPool(numThreads > 1
+    ? std::make_shared<ThreadPool>(numThreads)
+    : std::shared_ptr<ThreadPool>());
+}
+
+void Parser::setIndexSubtrees(bool enabled) {
+  m_TypeRegistry->setIndexSubtrees(enabled);
+}
+
+void Parser::indexInBackground(const DynObject &obj, const BackgroundIndexer::Budget &budget) {
+  m_BackgroundIndexer.reset();
+  m_BackgroundIndexer.reset(new BackgroundIndexer(obj, budget));
+}
+
+void Parser::stopBackgroundIndexing() {
+  m_BackgroundIndexer.reset();
+}
+
 void Parser::write(const char *filePath, DynObject &obj) const {
   std::shared_ptr<IOWrapper> ptr(IOWrapper::fromFile(filePath, true));
   obj.saveTo(ptr);
@@ -62,6 +85,14 @@ std::vector<DynObject> Parser::getList(const std::shared_ptr<TypeSpec>& spec, si
   return dummy.getList<DynObject>("root");
 }
 
+std::unique_ptr<IncrementalIndexer> Parser::getObjectIncremental(const std::shared_ptr<TypeSpec>& spec, size_t offset, DataStreamId dataStream) {
+  return std::unique_ptr<IncrementalIndexer>(new IncrementalIndexer(spec, m_StreamRegistry, &m_IndexTable, dataStream, offset, false));
+}
+
+std::unique_ptr<IncrementalIndexer> Parser::getListIncremental(const std::shared_ptr<TypeSpec>& spec, size_t offset, DataStreamId dataStream) {
+  return std::unique_ptr<IncrementalIndexer>(new IncrementalIndexer(spec, m_StreamRegistry, &m_IndexTable, dataStream, offset, true));
+}
+
 std::shared_ptr<TypeSpec> Parser::getType(const char *name) const {
   return m_TypeRegistry->getByName(name);
 }
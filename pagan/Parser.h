@@ -4,6 +4,10 @@
 #include "DynObject.h"
 #include "TypeRegistry.h"
 #include "iowrap.h"
+#include "BackgroundIndexer.h"
+#include "ExpressionCache.h"
+#include "ExpressionProfiler.h"
+#include "IncrementalIndexer.h"
 #include <memory>
 
 class Parser
@@ -16,6 +20,24 @@ public:
 
   bool hasInputData() const;
 
+  /**
+   * use the specified number of threads to index large arrays. 0 or 1 disables parallel indexing
+   */
+  void setIndexThreads(unsigned int numThreads);
+
+  /**
+   * also index size-delimited child objects in parallel. Only has an effect with index threads
+   */
+  void setIndexSubtrees(bool enabled);
+
+  /**
+   * keep indexing the parts of obj that would otherwise be indexed on first access on a
+   * background thread, within the specified budget. Replaces the previous background indexer
+   */
+  void indexInBackground(const DynObject &obj, const BackgroundIndexer::Budget &budget = BackgroundIndexer::Budget());
+
+  void stopBackgroundIndexing();
+
   void write(const char* filePath, DynObject& obj) const;
 
   std::shared_ptr<TypeSpec> getType(const char* name) const;
@@ -23,6 +45,13 @@ public:
   DynObject getObject(const std::shared_ptr<TypeSpec>& spec, size_t offset, DataStreamId dataStream = 0);
   std::vector<DynObject> getList(const std::shared_ptr<TypeSpec>& spec, size_t offset, DataStreamId dataStream = 0);
 
+  /**
+   * like getObject and getList but the index is only built while IncrementalIndexer::step is
+   * called, in slices of bounded length. List items become available as soon as they're complete
+   */
+  std::unique_ptr<IncrementalIndexer> getObjectIncremental(const std::shared_ptr<TypeSpec>& spec, size_t offset, DataStreamId dataStream = 0);
+  std::unique_ptr<IncrementalIndexer> getListIncremental(const std::shared_ptr<TypeSpec>& spec, size_t offset, DataStreamId dataStream = 0);
+
   std::vector<uint8_t> objectIndex() const;
   std::vector<uint8_t> arrayIndex() const;
 
@@ -35,6 +64,23 @@ public:
   template <typename T>
   DynObject createObject(const std::weak_ptr<TypeSpec> &spec, std::initializer_list<T> data);
 
+  /**
+   * compiled expressions of the spec, shared by all types of this parser
+   */
+  const std::shared_ptr<ExpressionCache> &expressions() const { return m_Expressions; }
+
+  /**
+   * count and time evaluations of the expressions of the spec. Off by default
+   */
+  void setProfiling(bool enabled) { m_Profiler->setEnabled(enabled); }
+
+  /**
+   * evaluation statistics per expression of the spec, the most expensive first
+   */
+  std::vector<ExpressionProfiler::Record> expressionProfile() const { return m_Profiler->report(); }
+
+  const std::shared_ptr<ExpressionProfiler> &profiler() const { return m_Profiler; }
+
   std::shared_ptr<TypeSpec> createType(const char *name);
   std::shared_ptr<TypeSpec> createType(const char *name, const std::initializer_list<TypeAttribute> &attributes);
 
@@ -45,6 +91,11 @@ private:
   ObjectIndexTable m_IndexTable;
   StreamRegistry m_StreamRegistry;
   std::shared_ptr<TypeRegistry> m_TypeRegistry;
+  std::shared_ptr<ExpressionCache> m_Expressions;
+  std::shared_ptr<ExpressionProfiler> m_Profiler;
+
+  // has to be destroyed first, it uses all of the above
+  std::unique_ptr<BackgroundIndexer> m_BackgroundIndexer;
 
 };
 
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * instance of T for each thread using a container, other than the thread owning it. The first
+ * thread to ask becomes the owner, it gets nullptr and is expected to use the container itself.
+ * Instances are created on demand and owned by the container, repeated lookups from the same
+ * thread don't lock
+ */
+template <typename T>
+class PerThread
+{
+public:
+
+  PerThread()
+    : m_Serial(nextSerial())
+  {
+  }
+
+  PerThread(const PerThread &reference) = delete;
+  PerThread &operator=(const PerThread &reference) = delete;
+
+  /**
+   * instance for the calling thread, nullptr if it's the owner. create is called (under lock)
+   * to produce the instance when a thread asks for the first time
+   */
+  template <typename CreateFunc>
+  T *get(CreateFunc create) {
+    std::thread::id self = std::this_thread::get_id();
+    std::thread::id owner = m_Owner.load(std::memory_order_acquire);
+    if ((owner == self)
+        || ((owner == std::thread::id()) && m_Owner.compare_exchange_strong(owner, self))) {
+      return nullptr;
+    }
+
+    Cache &cache = threadCache();
+    if (cache.serial == m_Serial) {
+      return cache.instance;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    T *&instance = m_Instances[self];
+    if (instance == nullptr) {
+      instance = create();
+    }
+    cache.serial = m_Serial;
+    cache.instance = instance;
+    return instance;
+  }
+
+private:
+
+  struct Cache {
+    uint64_t serial{ 0 };
+    T *instance{ nullptr };
+  };
+
+  // serials are never reused so a stale cache entry can't match a new container at the same address
+  static uint64_t nextSerial() {
+    static std::atomic<uint64_t> s_Next{ 1 };
+    return s_Next++;
+  }
+
+  static Cache &threadCache() {
+    static thread_local Cache s_Cache;
+    return s_Cache;
+  }
+
+private:
+
+  uint64_t m_Serial;
+  std::atomic<std::thread::id> m_Owner{ std::thread::id() };
+  std::mutex m_Mutex;
+  std::unordered_map<std::thread::id, T*> m_Instances;
+
+};
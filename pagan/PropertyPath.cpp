@@ -0,0 +1,270 @@
+#include "PropertyPath.h"
+#include "DynObject.h"
+#include "TypeSpec.h"
+#include "TypeRegistry.h"
+#include "IndexSlot.h"
+#include "typecast.h"
+#include "format.h"
+#include "SubtreeIndexer.h"
+#include "objectindex.h"
+#include <atomic>
+#include <cstring>
+#include <deque>
+
+static std::vector<std::string> splitPath(const std::string &path) {
+  std::vector<std::string> res;
+  size_t offset = 0;
+  while (true) {
+    size_t dotPos = path.find('.', offset);
+    res.push_back(path.substr(offset, dotPos == std::string::npos ? std::string::npos : dotPos - offset));
+    if (dotPos == std::string::npos) {
+      return res;
+    }
+    offset = dotPos + 1;
+  }
+}
+
+PropertyPath::PropertyPath(const std::string &path)
+  : m_Segments(splitPath(path))
+{
+}
+
+PropertyPath::PropertyPath(std::vector<std::string> segments)
+  : m_Segments(std::move(segments))
+{
+  if (m_Segments.empty()) {
+    throw std::runtime_error("empty property path");
+  }
+}
+
+PropertyPath::PropertyPath(const PropertyPath &reference)
+  : m_Segments(reference.m_Segments)
+  , m_Plan(std::atomic_load(&reference.m_Plan))
+{
+  std::lock_guard<std::mutex> lock(reference.m_PlansMutex);
+  m_Plans = reference.m_Plans;
+}
+
+PropertyPath &PropertyPath::operator=(const PropertyPath &reference) {
+  if (this != &reference) {
+    m_Segments = reference.m_Segments;
+    std::atomic_store(&m_Plan, std::atomic_load(&reference.m_Plan));
+    std::unordered_map<uint32_t, std::shared_ptr<const Plan>> plans;
+    {
+      std::lock_guard<std::mutex> lock(reference.m_PlansMutex);
+      plans = reference.m_Plans;
+    }
+    std::lock_guard<std::mutex> lock(m_PlansMutex);
+    m_Plans.swap(plans);
+  }
+  return *this;
+}
+
+std::shared_ptr<const PropertyPath::Plan> PropertyPath::plan(const DynObject &obj) const {
+  std::shared_ptr<const Plan> res = std::atomic_load(&m_Plan);
+  if ((res != nullptr) && (res->typeId == obj.getTypeId())) {
+    return res;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_PlansMutex);
+    std::shared_ptr<const Plan> &known = m_Plans[obj.getTypeId()];
+    if (known == nullptr) {
+      known = compile(obj.getSpec());
+    }
+    res = known;
+  }
+  std::atomic_store(&m_Plan, res);
+  return res;
+}
+
+std::shared_ptr<const PropertyPath::Plan> PropertyPath::compile(const std::shared_ptr<TypeSpec> &type) const {
+  std::shared_ptr<Plan> res = std::make_shared<Plan>();
+  res->typeId = type->getId();
+
+  std::shared_ptr<TypeSpec> cur = type;
+  for (size_t i = 0; i < m_Segments.size(); ++i) {
+    const char *key = m_Segments[i].c_str();
+    bool last = i == m_Segments.size() - 1;
+
+    bool isParent = strcmp(key, "_parent") == 0;
+    if (!last && (isParent || (strcmp(key, "_root") == 0))) {
+      res->steps.push_back({ isParent ? Step::PARENT : Step::ROOT, 0, -1, -1 });
+      res->rest = std::make_shared<PropertyPath>(std::vector<std::string>(m_Segments.begin() + i + 1, m_Segments.end()));
+      break;
+    }
+
+    int offset = 0;
+    int bit = ((*key != '_') && (cur->paramByKey(key, nullptr) == cur->getParameters().cend()) && !cur->hasComputed(key))
+      ? cur->propertyIndex(key, &offset)
+      : -1;
+
+    if (bit != -1) {
+      const TypeProperty &prop = cur->getProperties()[bit];
+      if (!prop.isList && (prop.typeId != TypeId::runtime)) {
+        if ((prop.typeId >= TypeId::custom) && prop.argList.empty()) {
+          res->steps.push_back({ Step::CHILD, prop.typeId, bit, offset });
+          cur = cur->getRegistry()->getById(prop.typeId);
+          continue;
+        }
+        else if (last && (prop.typeId < TypeId::custom)) {
+          res->steps.push_back({ Step::VALUE, prop.typeId, bit, offset, prop.hasEnum });
+          continue;
+        }
+      }
+    }
+
+    res->steps.push_back({ Step::FALLBACK, 0, -1, -1 });
+    break;
+  }
+
+  return res;
+}
+
+static std::any readFallback(const DynObject &obj,
+                             const std::vector<std::string>::const_iterator &cur,
+                             const std::vector<std::string>::const_iterator &end,
+                             bool enumNames) {
+  return enumNames ? obj.getAny(cur, end) : obj.getRaw(cur, end);
+}
+
+uint8_t *PropertyPath::resolve(const DynObject &obj, ObjectIndex *&cur, uint32_t &typeId, std::any &fallback, bool enumNames) const {
+  if (obj.isLazy()) {
+    // values of lazy objects are read straight from the data stream anyway
+    fallback = readFallback(obj, m_Segments.cbegin(), m_Segments.cend(), enumNames);
+    return nullptr;
+  }
+
+  std::shared_ptr<const Plan> compiled = plan(obj);
+
+  cur = obj.getIndex();
+  for (size_t i = 0; i < compiled->steps.size(); ++i) {
+    const Step &step = compiled->steps[i];
+    bool last = i == m_Segments.size() - 1;
+    if ((step.kind == Step::FALLBACK) || (last && (step.kind == Step::CHILD))) {
+      DynObject from = cur == obj.getIndex() ? obj : ObjectHandle(cur).toObject(obj);
+      fallback = readFallback(from, m_Segments.cbegin() + i, m_Segments.cend(), enumNames);
+      return nullptr;
+    }
+
+    if ((step.kind == Step::PARENT) || (step.kind == Step::ROOT)) {
+      ObjectIndex *next = cur->parent;
+      if ((next != nullptr) && (step.kind == Step::ROOT) && (next->root != nullptr)) {
+        next = next->root;
+      }
+      DynObject from = cur == obj.getIndex() ? obj : ObjectHandle(cur).toObject(obj);
+      if (next == nullptr) {
+        // object created without a link to its parent
+        fallback = readFallback(from, m_Segments.cbegin() + i, m_Segments.cend(), enumNames);
+        return nullptr;
+      }
+      return compiled->rest->resolve(ObjectHandle(next).toObject(from), cur, typeId, fallback, enumNames);
+    }
+
+    if (!isBitSet(cur, step.bit)) {
+      throw std::runtime_error(fmt::format("property not present in object: {}", m_Segments[i]));
+    }
+    uint8_t *slot = cur->properties + step.offset;
+
+    if (step.kind == Step::VALUE) {
+      if (step.isEnum && enumNames) {
+        // looking up the name is up to DynObject
+        DynObject from = cur == obj.getIndex() ? obj : ObjectHandle(cur).toObject(obj);
+        fallback = from.getAny(m_Segments.cbegin() + i, m_Segments.cend());
+        return nullptr;
+      }
+      typeId = step.typeId;
+      return slot;
+    }
+
+    int64_t objOffset = loadSlot(slot);
+    if (objOffset >= 0) {
+      // child not indexed yet, let DynObject deal with it
+      DynObject from = cur == obj.getIndex() ? obj : ObjectHandle(cur).toObject(obj);
+      fallback = readFallback(from.get<DynObject>(m_Segments[i].c_str()), m_Segments.cbegin() + i + 1, m_Segments.cend(), enumNames);
+      return nullptr;
+    }
+    cur = reinterpret_cast<ObjectIndex*>(objOffset * -1);
+    SubtreeScope::await(cur);
+  }
+
+  throw std::runtime_error("invalid property path");
+}
+
+std::any PropertyPath::get(const DynObject &obj) const {
+  ObjectIndex *cur = nullptr;
+  uint32_t typeId = 0;
+  std::any fallback;
+  uint8_t *slot = resolve(obj, cur, typeId, fallback, true);
+  if (slot == nullptr) {
+    return fallback;
+  }
+
+  std::shared_ptr<IOWrapper> dataStream = obj.getStreams().get(cur->dataStream);
+  std::shared_ptr<IOWrapper> writeStream = obj.getStreams().getWrite();
+  return type_read_any(static_cast<TypeId>(typeId), reinterpret_cast<char*>(slot), dataStream, writeStream);
+}
+
+template <typename T>
+static ScriptValue readInteger(TypeId type, char *slot, std::shared_ptr<IOWrapper> &data, std::shared_ptr<IOWrapper> &write) {
+  return ScriptValue::integer(static_cast<int64_t>(type_read<T>(type, slot, data, write, nullptr)));
+}
+
+ScriptValue PropertyPath::getValue(const DynObject &obj) const {
+  ObjectIndex *cur = nullptr;
+  uint32_t typeId = 0;
+  std::any fallback;
+  uint8_t *slot = resolve(obj, cur, typeId, fallback, false);
+  if (slot == nullptr) {
+    return ScriptValue::fromAny(fallback);
+  }
+
+  std::shared_ptr<IOWrapper> dataStream = obj.getStreams().get(cur->dataStream);
+  std::shared_ptr<IOWrapper> writeStream = obj.getStreams().getWrite();
+  TypeId type = static_cast<TypeId>(typeId);
+  char *index = reinterpret_cast<char*>(slot);
+  switch (nativeType(type)) {
+    case TypeId::int8: return readInteger<int8_t>(type, index, dataStream, writeStream);
+    case TypeId::int16: return readInteger<int16_t>(type, index, dataStream, writeStream);
+    case TypeId::int32: return readInteger<int32_t>(type, index, dataStream, writeStream);
+    case TypeId::int64: return readInteger<int64_t>(type, index, dataStream, writeStream);
+    case TypeId::uint8: return readInteger<uint8_t>(type, index, dataStream, writeStream);
+    case TypeId::uint16: return readInteger<uint16_t>(type, index, dataStream, writeStream);
+    case TypeId::uint32: return readInteger<uint32_t>(type, index, dataStream, writeStream);
+    case TypeId::uint64: return readInteger<uint64_t>(type, index, dataStream, writeStream);
+    case TypeId::float32_iee754: return ScriptValue::real(type_read<float>(type, index, dataStream, writeStream, nullptr));
+    case TypeId::string:
+    case TypeId::stringz: return ScriptValue::string(type_read<std::string>(type, index, dataStream, writeStream, nullptr));
+    default: return ScriptValue::fromAny(type_read_any(type, index, dataStream, writeStream));
+  }
+}
+
+DynObject PropertyPath::getObject(const DynObject &obj) const {
+  std::shared_ptr<const Plan> compiled = obj.isLazy() ? nullptr : plan(obj);
+
+  ObjectIndex *cur = obj.isLazy() ? nullptr : obj.getIndex();
+  size_t i = 0;
+  for (; (compiled != nullptr) && (i < compiled->steps.size()); ++i) {
+    const Step &step = compiled->steps[i];
+    if (step.kind != Step::CHILD) {
+      break;
+    }
+    if (!isBitSet(cur, step.bit)) {
+      throw std::runtime_error(fmt::format("property not present in object: {}", m_Segments[i]));
+    }
+    int64_t objOffset = loadSlot(cur->properties + step.offset);
+    if (objOffset >= 0) {
+      break;
+    }
+    cur = reinterpret_cast<ObjectIndex*>(objOffset * -1);
+    SubtreeScope::await(cur);
+  }
+
+  // the objects of the remaining segments, each one is the parent of the next
+  std::deque<DynObject> chain;
+  chain.push_back((cur == nullptr) || (cur == obj.getIndex()) ? obj : ObjectHandle(cur).toObject(obj));
+  for (; i < m_Segments.size(); ++i) {
+    chain.push_back(chain.back().get<DynObject>(m_Segments[i].c_str()));
+  }
+  return chain.back();
+}
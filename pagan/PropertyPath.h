@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ScriptValue.h"
+#include <any>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class DynObject;
+class TypeSpec;
+struct ObjectIndex;
+
+/**
+ * dotted path to a (possibly nested) value, like "data.header.label".
+ * The first time the path is used on an object it gets compiled against the type of that object:
+ * each segment is resolved to the location of the property in the index so evaluating the path
+ * only follows pointers from one index to the next instead of looking up every segment by name
+ * and creating an object for each.
+ * _parent and _root hops follow the links in the index, the rest of the path is then compiled
+ * against the type of the object they lead to.
+ * Segments that can't be resolved statically (parameters, computed values, switch types,
+ * lists, enums, _io) and children that haven't been indexed yet are evaluated the
+ * regular way from there on.
+ * The compiled form is kept for each type the path was used on, so paths should be reused and
+ * one path can serve objects of different types
+ */
+class PropertyPath
+{
+public:
+
+  explicit PropertyPath(const std::string &path);
+  explicit PropertyPath(std::vector<std::string> segments);
+
+  PropertyPath(const PropertyPath &reference);
+  PropertyPath &operator=(const PropertyPath &reference);
+
+  const std::vector<std::string> &segments() const {
+    return m_Segments;
+  }
+
+  /**
+   * value at the end of the path, relative to obj
+   */
+  std::any get(const DynObject &obj) const;
+
+  /**
+   * same as get but numbers and strings are read without boxing them in std::any and enums are
+   * their integer value
+   */
+  ScriptValue getValue(const DynObject &obj) const;
+
+  /**
+   * object at the end of the path, relative to obj. All segments have to refer to objects
+   */
+  DynObject getObject(const DynObject &obj) const;
+
+private:
+
+  struct Step {
+    enum Kind {
+      // follow the slot of an object property to the index of the child
+      CHILD,
+      // read a plain value, only ever the last step
+      VALUE,
+      // continue with the parent/root object, only ever the last step with the rest of the
+      // path compiled separately
+      PARENT,
+      ROOT,
+      // evaluate the remaining segments through DynObject
+      FALLBACK
+    };
+
+    Kind kind;
+    uint32_t typeId;
+    // position of the property in the bitmask
+    int bit;
+    // position of the value in the property index
+    int offset;
+    // value of an enum, only resolved to the name when read through get
+    bool isEnum{ false };
+  };
+
+  struct Plan {
+    uint32_t typeId;
+    std::vector<Step> steps;
+    // segments following a _parent/_root hop
+    std::shared_ptr<PropertyPath> rest;
+  };
+
+  std::shared_ptr<const Plan> plan(const DynObject &obj) const;
+  std::shared_ptr<const Plan> compile(const std::shared_ptr<TypeSpec> &type) const;
+
+  // follow the steps. Returns the slot of the value with cur being the index it's in or, if the
+  // path had to be evaluated the regular way, null with the result in fallback. enumNames
+  // determines whether enums in the fallback are the name or the integer
+  uint8_t *resolve(const DynObject &obj, ObjectIndex *&cur, uint32_t &typeId, std::any &fallback, bool enumNames) const;
+
+private:
+
+  std::vector<std::string> m_Segments;
+  // plan for the type of the last object the path was used on, replaced atomically
+  mutable std::shared_ptr<const Plan> m_Plan;
+  // plans for all types the path was used on
+  mutable std::unordered_map<uint32_t, std::shared_ptr<const Plan>> m_Plans;
+  mutable std::mutex m_PlansMutex;
+
+};
@@ -0,0 +1,140 @@
+#include "ScriptValue.h"
+#include "flexi_cast.h"
+#include "format.h"
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+template <typename T>
+static bool readInteger(const std::any &value, int64_t &result) {
+  const T *ptr = std::any_cast<T>(&value);
+  if (ptr != nullptr) {
+    result = static_cast<int64_t>(*ptr);
+    return true;
+  }
+  return false;
+}
+
+// the integer types properties get read as come first
+static bool anyInteger(const std::any &value, int64_t &result) {
+  return readInteger<uint32_t>(value, result)
+      || readInteger<uint8_t>(value, result)
+      || readInteger<uint16_t>(value, result)
+      || readInteger<int32_t>(value, result)
+      || readInteger<int64_t>(value, result)
+      || readInteger<uint64_t>(value, result)
+      || readInteger<int8_t>(value, result)
+      || readInteger<int16_t>(value, result)
+      || readInteger<char>(value, result)
+      || readInteger<long>(value, result)
+      || readInteger<unsigned long>(value, result)
+      || readInteger<long long>(value, result)
+      || readInteger<unsigned long long>(value, result);
+}
+
+ScriptValue ScriptValue::fromAny(const std::any &value) {
+  int64_t num;
+  if (anyInteger(value, num)) {
+    return integer(num);
+  }
+
+  const std::type_info &type = value.type();
+  if (type == typeid(std::string)) {
+    return string(*std::any_cast<std::string>(&value));
+  }
+  else if (type == typeid(bool)) {
+    return boolean(*std::any_cast<bool>(&value));
+  }
+  else if (type == typeid(float)) {
+    return real(*std::any_cast<float>(&value));
+  }
+  else if (type == typeid(double)) {
+    return real(*std::any_cast<double>(&value));
+  }
+  return other(value);
+}
+
+ScriptValue ScriptValue::fromAny(std::any &&value) {
+  // strings are the only values that are expensive to copy
+  std::string *str = std::any_cast<std::string>(&value);
+  if (str != nullptr) {
+    return string(std::move(*str));
+  }
+  return fromAny(static_cast<const std::any&>(value));
+}
+
+int64_t ScriptValue::toIntegerSlow() const {
+  switch (m_Type) {
+    case Type::DOUBLE: return static_cast<int64_t>(std::get<double>(m_Value));
+    case Type::OTHER: return flexi_cast<int64_t>(otherValue());
+    case Type::STRING: throw std::runtime_error(fmt::format("not a number: \"{}\"", std::string(stringView())));
+    default: throw std::runtime_error("not a number: empty value");
+  }
+}
+
+bool ScriptValue::toBoolSlow() const {
+  switch (m_Type) {
+    case Type::DOUBLE: return std::get<double>(m_Value) != 0.0;
+    case Type::OTHER: return flexi_cast<bool>(otherValue());
+    case Type::STRING: throw std::runtime_error(fmt::format("not a boolean: \"{}\"", std::string(stringView())));
+    default: return false;
+  }
+}
+
+double ScriptValue::toDouble() const {
+  if (m_Type == Type::DOUBLE) {
+    return std::get<double>(m_Value);
+  }
+  return static_cast<double>(toInteger());
+}
+
+std::string ScriptValue::toString() const {
+  switch (m_Type) {
+    case Type::INTEGER: return std::to_string(std::get<int64_t>(m_Value));
+    case Type::BOOLEAN: return std::get<int64_t>(m_Value) != 0 ? "1" : "0";
+    case Type::DOUBLE: {
+      std::ostringstream str;
+      str << std::get<double>(m_Value);
+      return str.str();
+    }
+    case Type::STRING: return std::string(stringView());
+    case Type::OTHER: return flexi_cast<std::string>(otherValue());
+    default: return std::string();
+  }
+}
+
+std::any ScriptValue::toAny() const {
+  switch (m_Type) {
+    case Type::INTEGER: return std::get<int64_t>(m_Value);
+    case Type::BOOLEAN: return std::get<int64_t>(m_Value) != 0;
+    case Type::DOUBLE: return std::get<double>(m_Value);
+    case Type::STRING: return std::string(stringView());
+    case Type::OTHER: return otherValue();
+    default: return std::any();
+  }
+}
+
+bool ScriptValue::equals(const ScriptValue &rhs) const {
+  if (m_Type == Type::STRING) {
+    // strings compare to the string representation of whatever they're compared to
+    return rhs.isString() ? stringView() == rhs.stringView() : stringView() == rhs.toString();
+  }
+
+  if (isNumber()) {
+    if (!rhs.isNumber()) {
+      return false;
+    }
+    if ((m_Type == Type::DOUBLE) || (rhs.m_Type == Type::DOUBLE)) {
+      return toDouble() == rhs.toDouble();
+    }
+    return std::get<int64_t>(m_Value) == std::get<int64_t>(rhs.m_Value);
+  }
+
+  if ((m_Type == Type::OTHER) && (rhs.m_Type == Type::OTHER)) {
+    const std::vector<uint8_t> *lhsBytes = std::any_cast<std::vector<uint8_t>>(&otherValue());
+    const std::vector<uint8_t> *rhsBytes = std::any_cast<std::vector<uint8_t>>(&rhs.otherValue());
+    return (lhsBytes != nullptr) && (rhsBytes != nullptr) && (*lhsBytes == *rhsBytes);
+  }
+
+  return false;
+}
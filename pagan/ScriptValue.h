@@ -0,0 +1,176 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+/**
+ * value as seen by expressions. Numbers, booleans and strings are stored directly so arithmetic
+ * and comparisons don't have to go through std::any and flexi_cast. Anything else (byte arrays,
+ * objects, functions) is kept as std::any.
+ * Strings can either be owned or refer to memory that outlives the value (like the constants of
+ * a compiled expression).
+ * Only one payload is stored at a time so values stay small on the evaluation stack
+ */
+class ScriptValue
+{
+public:
+
+  enum class Type : uint8_t {
+    EMPTY,
+    INTEGER,
+    DOUBLE,
+    BOOLEAN,
+    STRING,
+    OTHER
+  };
+
+public:
+
+  ScriptValue() {}
+
+  static ScriptValue integer(int64_t value) {
+    ScriptValue res;
+    res.m_Type = Type::INTEGER;
+    res.m_Value = value;
+    return res;
+  }
+
+  static ScriptValue real(double value) {
+    ScriptValue res;
+    res.m_Type = Type::DOUBLE;
+    res.m_Value = value;
+    return res;
+  }
+
+  static ScriptValue boolean(bool value) {
+    ScriptValue res;
+    res.m_Type = Type::BOOLEAN;
+    res.m_Value = static_cast<int64_t>(value ? 1 : 0);
+    return res;
+  }
+
+  static ScriptValue string(std::string value) {
+    ScriptValue res;
+    res.m_Type = Type::STRING;
+    res.m_Value.emplace<std::string>(std::move(value));
+    return res;
+  }
+
+  /**
+   * string that isn't copied, the caller has to keep the memory alive
+   */
+  static ScriptValue view(std::string_view value) {
+    ScriptValue res;
+    res.m_Type = Type::STRING;
+    res.m_Value.emplace<std::string_view>(value);
+    return res;
+  }
+
+  static ScriptValue other(std::any value) {
+    ScriptValue res;
+    if (value.has_value()) {
+      res.m_Type = Type::OTHER;
+      res.m_Value.emplace<std::any>(std::move(value));
+    }
+    return res;
+  }
+
+  /**
+   * convert from the way values are passed around outside of expressions
+   */
+  static ScriptValue fromAny(const std::any &value);
+  static ScriptValue fromAny(std::any &&value);
+
+  Type type() const { return m_Type; }
+
+  bool empty() const { return m_Type == Type::EMPTY; }
+
+  bool isString() const { return m_Type == Type::STRING; }
+
+  /**
+   * integer, boolean or double
+   */
+  bool isNumber() const { return (m_Type == Type::INTEGER) || (m_Type == Type::BOOLEAN) || (m_Type == Type::DOUBLE); }
+
+  int64_t toInteger() const {
+    if ((m_Type == Type::INTEGER) || (m_Type == Type::BOOLEAN)) {
+      return std::get<int64_t>(m_Value);
+    }
+    return toIntegerSlow();
+  }
+
+  double toDouble() const;
+
+  bool toBool() const {
+    if ((m_Type == Type::INTEGER) || (m_Type == Type::BOOLEAN)) {
+      return std::get<int64_t>(m_Value) != 0;
+    }
+    return toBoolSlow();
+  }
+
+  /**
+   * only valid for strings
+   */
+  std::string_view stringView() const {
+    const std::string_view *view = std::get_if<std::string_view>(&m_Value);
+    return view != nullptr ? *view : std::string_view(std::get<std::string>(m_Value));
+  }
+
+  /**
+   * string representation, numbers are formatted
+   */
+  std::string toString() const;
+
+  /**
+   * non-numeric, non-string values only
+   */
+  const std::any &otherValue() const {
+    static const std::any none;
+    const std::any *res = std::get_if<std::any>(&m_Value);
+    return res != nullptr ? *res : none;
+  }
+
+  std::any toAny() const;
+
+  /**
+   * comparison as done by the == operator
+   */
+  bool equals(const ScriptValue &rhs) const;
+
+  template <typename T> T as() const {
+    if constexpr (std::is_same<T, std::any>::value) {
+      return toAny();
+    }
+    else if constexpr (std::is_same<T, bool>::value) {
+      return toBool();
+    }
+    else if constexpr (std::is_integral<T>::value) {
+      return static_cast<T>(toInteger());
+    }
+    else if constexpr (std::is_floating_point<T>::value) {
+      return static_cast<T>(toDouble());
+    }
+    else if constexpr (std::is_same<T, std::string>::value) {
+      return toString();
+    }
+    else {
+      return std::any_cast<T>(otherValue());
+    }
+  }
+
+private:
+
+  int64_t toIntegerSlow() const;
+  bool toBoolSlow() const;
+
+private:
+
+  Type m_Type{ Type::EMPTY };
+  // integers and booleans, doubles, borrowed strings, owned strings, everything else
+  std::variant<int64_t, double, std::string_view, std::string, std::any> m_Value;
+
+};
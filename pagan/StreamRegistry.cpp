@@ -16,6 +16,23 @@ int StreamRegistry::add(std::shared_ptr<IOWrapper> stream) {
 }
 
 std::shared_ptr<IOWrapper> StreamRegistry::get(DataStreamId id, DataOffset offset) const {
-  m_Streams[id]->seekg(offset);
-  return m_Streams[id];
+  std::shared_ptr<IOWrapper> res = get(id);
+  res->seekg(offset);
+  return res;
+}
+
+std::unique_ptr<StreamRegistry> StreamRegistry::fork() const {
+  std::unique_ptr<StreamRegistry> res(new StreamRegistry());
+  res->m_Write = m_Write;
+  for (const auto &stream : m_Streams) {
+    res->m_Streams.push_back(std::shared_ptr<IOWrapper>(stream->reader()));
+  }
+  return res;
+}
+
+const StreamRegistry *StreamRegistry::threadCursors() const {
+  return m_ThreadCursors.get([this]() {
+    m_CursorRegistries.push_back(fork());
+    return m_CursorRegistries.back().get();
+  });
 }
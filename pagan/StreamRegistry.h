@@ -1,6 +1,8 @@
 #pragma once
 
 #include "iowrap.h"
+#include "IndexContext.h"
+#include "PerThread.h"
 
 #include <vector>
 #include <iostream>
@@ -24,7 +26,15 @@ public:
     return m_Write;
   }
 
+  /**
+   * read cursor for the specified stream. Each thread gets its own cursors so a parsed file can
+   * be read from several threads, the streams have to be added before that though
+   */
   std::shared_ptr<IOWrapper> get(DataStreamId id) const {
+    const StreamRegistry *cursors = threadCursors();
+    if (cursors != nullptr) {
+      return cursors->get(id);
+    }
     if (m_Streams.size() < id) {
       throw std::runtime_error("invalid stream id " + std::to_string(id));
     }
@@ -33,10 +43,34 @@ public:
 
   std::shared_ptr<IOWrapper> get(DataStreamId id, DataOffset offset) const;
 
+  /**
+   * create a registry with its own read cursors on the same data streams so it can be used
+   * from another thread. The write stream is shared
+   */
+  std::unique_ptr<StreamRegistry> fork() const;
+
+  /**
+   * state of the parse reading from these streams. Like the read cursors, forks get their own
+   */
+  IndexContext &getContext() const {
+    const StreamRegistry *cursors = threadCursors();
+    return cursors != nullptr ? cursors->getContext() : m_Context;
+  }
+
+private:
+
+  // registry with the cursors of the calling thread, nullptr if that's the owner of this one
+  const StreamRegistry *threadCursors() const;
+
 private:
 
   std::shared_ptr<IOWrapper> m_Write;
 
   std::vector<std::shared_ptr<IOWrapper>> m_Streams;
 
+  mutable IndexContext m_Context;
+
+  mutable PerThread<StreamRegistry> m_ThreadCursors;
+  mutable std::vector<std::unique_ptr<StreamRegistry>> m_CursorRegistries;
+
 };
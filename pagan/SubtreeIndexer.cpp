@@ -0,0 +1,359 @@
+#include "SubtreeIndexer.h"
+#include "DynObject.h"
+#include "IncrementalIndexer.h"
+#include "ObjectIndexTable.h"
+#include "ThreadPool.h"
+#include "TypeRegistry.h"
+#include "TypeSpec.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <unordered_map>
+
+enum TaskState : int {
+  TASK_DEFERRED,
+  TASK_QUEUED,
+  TASK_RUNNING,
+  TASK_DONE,
+};
+
+struct SubtreeTask {
+  std::shared_ptr<TypeSpec> spec;
+  ObjectIndex *objIndex;
+  DataStreamId dataStream;
+  std::streampos dataPos;
+  std::streampos limit;
+  std::shared_ptr<std::deque<DynObject>> parentChain;
+  std::atomic<int> state{ TASK_DEFERRED };
+};
+
+/**
+ * all the tasks spawned while indexing one root object
+ */
+class SubtreeJob : public std::enable_shared_from_this<SubtreeJob>
+{
+public:
+
+  SubtreeJob(ThreadPool *pool, const StreamRegistry &streams, ObjectIndexTable *indexTable)
+    : m_Pool(pool), m_Workers(pool->size())
+  {
+    m_Main.streams = &streams;
+    m_Main.indexTable = indexTable;
+  }
+
+  void add(const std::shared_ptr<SubtreeTask> &task) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Pending[task->objIndex] = task;
+    ++m_Outstanding;
+  }
+
+  void queue(const std::shared_ptr<SubtreeTask> &task) {
+    if (!m_Forked) {
+      // the first task gets queued by the thread that started the job, before any worker
+      // is involved, so this is the only place streams can be forked safely
+      for (Context &worker : m_Workers) {
+        worker.forked = m_Main.streams->fork();
+        worker.streams = worker.forked.get();
+        worker.indexTable = m_Main.indexTable->createArena();
+      }
+      m_Forked = true;
+    }
+    int expected = TASK_DEFERRED;
+    if (task->state.compare_exchange_strong(expected, TASK_QUEUED)) {
+      std::shared_ptr<SubtreeJob> self = shared_from_this();
+      m_Pool->post([self, task]() {
+        if (self->claim(*task)) {
+          self->run(task);
+        }
+      });
+    }
+  }
+
+  void cancel(const std::shared_ptr<SubtreeTask> &task) {
+    if (claim(*task)) {
+      // we can't tell whether the child would have indexed successfully
+      fail(task);
+      finish(*task);
+    }
+  }
+
+  void await(const ObjectIndex *objIndex) {
+    std::shared_ptr<SubtreeTask> task;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      auto iter = m_Pending.find(objIndex);
+      if (iter == m_Pending.end()) {
+        return;
+      }
+      task = iter->second;
+    }
+
+    if (claim(*task)) {
+      run(task);
+      return;
+    }
+
+    // another thread is indexing the object. Workers keep busy with other tasks in the meantime
+    while (task->state != TASK_DONE) {
+      if (!m_Pool->runPending()) {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Changed.wait(lock, [&task]() { return task->state == TASK_DONE; });
+      }
+    }
+  }
+
+  void waitAll() {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Changed.wait(lock, [this]() { return m_Outstanding == 0; });
+  }
+
+  /**
+   * index the tasks that failed again, one at a time and without deferring anything, the way
+   * they would have been indexed sequentially. To be called once the job is done and no longer
+   * active on the calling thread. Returns false if any of them still fails
+   */
+  bool retryFailed() {
+    std::vector<std::shared_ptr<SubtreeTask>> failed;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      failed.swap(m_Failed);
+    }
+    SubtreeScope::SequentialGuard sequential;
+    for (const std::shared_ptr<SubtreeTask> &task : failed) {
+      if (!index(*task, m_Main)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+
+  struct Context {
+    const StreamRegistry *streams{ nullptr };
+    ObjectIndexTable *indexTable{ nullptr };
+    std::unique_ptr<StreamRegistry> forked;
+  };
+
+  bool claim(SubtreeTask &task) {
+    int expected = task.state;
+    while ((expected == TASK_DEFERRED) || (expected == TASK_QUEUED)) {
+      if (task.state.compare_exchange_weak(expected, TASK_RUNNING)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(const std::shared_ptr<SubtreeTask> &task);
+
+  // index the child of a task through the streams and table of ctx. Returns false if it didn't
+  // index the way it would have sequentially
+  bool index(SubtreeTask &task, Context &ctx);
+
+  void fail(const std::shared_ptr<SubtreeTask> &task) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Failed.push_back(task);
+  }
+
+  void finish(SubtreeTask &task) {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      task.state = TASK_DONE;
+      m_Pending.erase(task.objIndex);
+      --m_Outstanding;
+    }
+    m_Changed.notify_all();
+  }
+
+  Context &context() {
+    int worker = m_Pool->workerIndex();
+    return worker >= 0 ? m_Workers[worker] : m_Main;
+  }
+
+private:
+
+  // owned by the root scope. Tasks keep the job alive so it may get destroyed on a worker, that
+  // must never take the pool with it
+  ThreadPool *m_Pool;
+  Context m_Main;
+  std::vector<Context> m_Workers;
+  bool m_Forked{ false };
+
+  std::mutex m_Mutex;
+  std::condition_variable m_Changed;
+  std::unordered_map<const ObjectIndex *, std::shared_ptr<SubtreeTask>> m_Pending;
+  int m_Outstanding{ 0 };
+  std::vector<std::shared_ptr<SubtreeTask>> m_Failed;
+
+};
+
+static thread_local SubtreeJob *s_Job = nullptr;
+static thread_local SubtreeScope *s_Scope = nullptr;
+static thread_local bool s_Sequential = false;
+// counts tasks deferred and run on the thread
+static thread_local uint32_t s_Activity = 0;
+
+void SubtreeJob::run(const std::shared_ptr<SubtreeTask> &task) {
+  SubtreeJob *outerJob = s_Job;
+  SubtreeScope *outerScope = s_Scope;
+  s_Job = this;
+  s_Scope = nullptr;
+
+  Context &ctx = context();
+  ObjectIndexTable::Mark mark = ctx.indexTable->mark();
+  uint32_t activity = ++s_Activity;
+  std::exception_ptr canceled;
+  bool success = false;
+  try {
+    success = index(*task, ctx);
+  }
+  catch (const IndexCanceled&) {
+    // not a problem with the subtree, the whole index gets abandoned
+    canceled = std::current_exception();
+  }
+  if (!success) {
+    if (s_Activity == activity) {
+      // nothing else got deferred or indexed on this thread in the meantime so nothing else
+      // can refer to what the task allocated
+      ctx.indexTable->release(mark);
+    }
+    fail(task);
+  }
+
+  s_Job = outerJob;
+  s_Scope = outerScope;
+  finish(*task);
+  if (canceled) {
+    std::rethrow_exception(canceled);
+  }
+}
+
+bool SubtreeJob::index(SubtreeTask &task, Context &ctx) {
+  std::shared_ptr<IOWrapper> data = ctx.streams->get(task.dataStream);
+  // the task may be run by a thread that is in the middle of indexing something else
+  std::streamoff before = data->tellg();
+  bool res = true;
+  try {
+    std::deque<DynObject> chain;
+    const DynObject *parent = task.parentChain->back().rebind(*ctx.streams, ctx.indexTable, chain);
+    DynObject child(task.spec, *ctx.streams, ctx.indexTable, task.objIndex, parent);
+    data->seekg(task.dataPos);
+    child.writeIndex(task.dataPos, task.limit, true);
+    // sequentially the parent would continue wherever the child ended
+    res = data->tellg() == task.limit;
+  }
+  catch (const IndexCanceled&) {
+    data->seekg(before);
+    throw;
+  }
+  catch (const std::exception &e) {
+    LOG_F("deferred index of {} failed: {}", task.spec->getName(), e.what());
+    res = false;
+  }
+  data->seekg(before);
+  return res;
+}
+
+SubtreeScope::SequentialGuard::SequentialGuard()
+  : m_Previous(s_Sequential)
+{
+  s_Sequential = true;
+}
+
+SubtreeScope::SequentialGuard::~SequentialGuard()
+{
+  s_Sequential = m_Previous;
+}
+
+SubtreeScope::SubtreeScope(const DynObject &obj, bool rootOnly)
+  : m_Object(obj), m_Outer(s_Scope)
+{
+  if (s_Job == nullptr) {
+    TypeRegistry *registry = obj.getSpec()->getRegistry();
+    if (s_Sequential || !registry->getIndexSubtrees()) {
+      return;
+    }
+    std::shared_ptr<ThreadPool> pool = registry->getIndexPool();
+    if ((pool == nullptr) || (pool->size() < 2) || (pool->workerIndex() != -1)) {
+      return;
+    }
+    m_Pool = pool;
+    m_Job = std::make_shared<SubtreeJob>(pool.get(), obj.getStreams(), obj.getIndexTable());
+    m_Root = true;
+    s_Job = m_Job.get();
+  }
+  else if (rootOnly) {
+    return;
+  }
+  else {
+    m_Job = s_Job->shared_from_this();
+  }
+  s_Scope = this;
+}
+
+SubtreeScope::~SubtreeScope()
+{
+  if ((m_Job == nullptr) || m_Closed) {
+    return;
+  }
+  // left through an exception, the deferred children aren't needed any more
+  s_Scope = m_Outer;
+  for (const std::shared_ptr<SubtreeTask> &task : m_Deferred) {
+    m_Job->cancel(task);
+  }
+  if (m_Root) {
+    m_Job->waitAll();
+    s_Job = nullptr;
+  }
+}
+
+bool SubtreeScope::close() {
+  if ((m_Job == nullptr) || m_Closed) {
+    return true;
+  }
+  m_Closed = true;
+  s_Scope = m_Outer;
+  for (const std::shared_ptr<SubtreeTask> &task : m_Deferred) {
+    m_Job->queue(task);
+  }
+  m_Deferred.clear();
+  if (!m_Root) {
+    return true;
+  }
+  m_Job->waitAll();
+  s_Job = nullptr;
+  return m_Job->retryFailed();
+}
+
+bool SubtreeScope::defer(const DynObject &parent, const std::shared_ptr<TypeSpec> &spec, ObjectIndex *objIndex,
+                         DataStreamId dataStream, std::streampos dataPos, std::streampos limit) {
+  SubtreeScope *scope = s_Scope;
+  if ((scope == nullptr) || (&scope->m_Object != &parent)) {
+    return false;
+  }
+
+  if (scope->m_Chain == nullptr) {
+    scope->m_Chain = std::make_shared<std::deque<DynObject>>();
+    parent.rebind(parent.getStreams(), parent.getIndexTable(), *scope->m_Chain);
+  }
+
+  std::shared_ptr<SubtreeTask> task = std::make_shared<SubtreeTask>();
+  task->spec = spec;
+  task->objIndex = objIndex;
+  task->dataStream = dataStream;
+  task->dataPos = dataPos;
+  task->limit = limit;
+  task->parentChain = scope->m_Chain;
+  scope->m_Job->add(task);
+  scope->m_Deferred.push_back(task);
+  ++s_Activity;
+  return true;
+}
+
+void SubtreeScope::await(const ObjectIndex *objIndex) {
+  if (s_Job != nullptr) {
+    s_Job->await(objIndex);
+  }
+}
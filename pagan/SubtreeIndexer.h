@@ -0,0 +1,83 @@
+#pragma once
+
+#include "StreamRegistry.h"
+#include <deque>
+#include <ios>
+#include <memory>
+#include <vector>
+
+class DynObject;
+class TypeSpec;
+class SubtreeJob;
+class ThreadPool;
+struct SubtreeTask;
+struct ObjectIndex;
+
+/**
+ * indexing scope of one object. With subtree indexing enabled, size-delimited children can be
+ * deferred: their ObjectIndex is allocated right away and stored in the parent as a placeholder,
+ * the parent continues behind them and the children get indexed as independent tasks on the
+ * index pool once the parent's own index is final. Whoever accesses a placeholder before its
+ * task ran indexes it on the spot.
+ * The outermost scope on a thread that isn't part of a job yet starts one and only returns from
+ * close() once all tasks of the job are done
+ */
+class SubtreeScope
+{
+public:
+
+  /**
+   * disables subtree indexing on the calling thread while it exists
+   */
+  class SequentialGuard {
+  public:
+    SequentialGuard();
+    ~SequentialGuard();
+  private:
+    bool m_Previous;
+  };
+
+public:
+
+  /**
+   * open a scope for indexing obj. With rootOnly the scope is inactive unless it starts a new job
+   */
+  explicit SubtreeScope(const DynObject &obj, bool rootOnly = false);
+  ~SubtreeScope();
+
+  SubtreeScope(const SubtreeScope &reference) = delete;
+  SubtreeScope &operator=(const SubtreeScope &reference) = delete;
+
+  /**
+   * queue the children deferred in this scope, a root scope also waits for the whole job and
+   * indexes children that failed once more on their own.
+   * Returns false if any child still didn't index exactly the way it would have sequentially, the
+   * caller then has to index again with a SequentialGuard in place
+   */
+  bool close();
+
+  /**
+   * defer indexing of a child of parent whose data ranges from dataPos to limit.
+   * Returns false if the child has to be indexed right away
+   */
+  static bool defer(const DynObject &parent, const std::shared_ptr<TypeSpec> &spec, ObjectIndex *objIndex,
+                    DataStreamId dataStream, std::streampos dataPos, std::streampos limit);
+
+  /**
+   * ensure a possibly deferred object is indexed before it gets accessed
+   */
+  static void await(const ObjectIndex *objIndex);
+
+private:
+
+  const DynObject &m_Object;
+  SubtreeScope *m_Outer;
+  std::shared_ptr<SubtreeJob> m_Job;
+  std::shared_ptr<ThreadPool> m_Pool;
+  bool m_Root{ false };
+  bool m_Closed{ false };
+  std::vector<std::shared_ptr<SubtreeTask>> m_Deferred;
+  // copy of the object and its ancestors the deferred children get rebound to
+  std::shared_ptr<std::deque<DynObject>> m_Chain;
+
+};
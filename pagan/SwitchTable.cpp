@@ -0,0 +1,73 @@
+#include "SwitchTable.h"
+#include <algorithm>
+
+// integer cases get a dense table if it would be at least this full
+static const size_t MIN_DENSE_FILL = 4;
+static const size_t MAX_DENSE_SIZE = 4096;
+
+SwitchTable::SwitchTable(const std::map<std::variant<std::string, int32_t>, uint32_t> &cases) {
+  for (const auto &kv : cases) {
+    if (std::holds_alternative<int32_t>(kv.first)) {
+      m_Integers.push_back({ static_cast<uint64_t>(static_cast<int64_t>(std::get<int32_t>(kv.first))), kv.second });
+      continue;
+    }
+
+    const std::string &name = std::get<std::string>(kv.first);
+    uint64_t key;
+    if (name == "_") {
+      m_Default = kv.second;
+    }
+    else if (pack(name, key)) {
+      m_ShortStrings.push_back({ key, kv.second });
+    }
+    else {
+      m_LongStrings[name] = kv.second;
+    }
+  }
+
+  std::sort(m_ShortStrings.begin(), m_ShortStrings.end());
+
+  if (!m_Integers.empty()) {
+    // the map is ordered so the integers are sorted by value
+    int64_t low = static_cast<int64_t>(m_Integers.front().first);
+    int64_t high = static_cast<int64_t>(m_Integers.back().first);
+    size_t range = static_cast<size_t>(high - low + 1);
+    if ((range <= MAX_DENSE_SIZE) && (range <= m_Integers.size() * MIN_DENSE_FILL)) {
+      m_DenseBase = low;
+      m_Dense.resize(range, NO_MATCH);
+      for (const auto &kv : m_Integers) {
+        m_Dense[static_cast<size_t>(static_cast<int64_t>(kv.first) - low)] = kv.second;
+      }
+      m_Integers.clear();
+    }
+    else {
+      std::sort(m_Integers.begin(), m_Integers.end());
+    }
+  }
+}
+
+uint32_t SwitchTable::findString(const std::string &value) const {
+  uint64_t key;
+  if (pack(value, key)) {
+    return findPacked(m_ShortStrings, key);
+  }
+  auto iter = m_LongStrings.find(value);
+  return (iter != m_LongStrings.end()) ? iter->second : NO_MATCH;
+}
+
+uint32_t SwitchTable::findPacked(const std::vector<std::pair<uint64_t, uint32_t>> &keys, uint64_t key) {
+  auto iter = std::lower_bound(keys.begin(), keys.end(), key,
+                               [](const std::pair<uint64_t, uint32_t> &lhs, uint64_t rhs) { return lhs.first < rhs; });
+  return ((iter != keys.end()) && (iter->first == key)) ? iter->second : NO_MATCH;
+}
+
+bool SwitchTable::pack(const std::string &value, uint64_t &key) {
+  if (value.size() > 7) {
+    return false;
+  }
+  key = static_cast<uint64_t>(value.size()) << 56;
+  for (size_t i = 0; i < value.size(); ++i) {
+    key |= static_cast<uint64_t>(static_cast<uint8_t>(value[i])) << (i * 8);
+  }
+  return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+ * cases of a type switch, compiled for lookups that don't allocate.
+ * Integer cases within a small range go into a table indexed by the value, other integers and
+ * strings of up to 7 bytes (like four character codes) are packed into 64-bit keys and found by
+ * binary search. Only longer strings use a map.
+ * "_" is the default case
+ */
+class SwitchTable
+{
+public:
+
+  static constexpr uint32_t NO_MATCH = UINT32_MAX;
+
+public:
+
+  SwitchTable() {}
+
+  SwitchTable(const std::map<std::variant<std::string, int32_t>, uint32_t> &cases);
+
+  /**
+   * type for the specified case, the default type if there is no such case or NO_MATCH if
+   * there is no default either
+   */
+  uint32_t find(const std::variant<std::string, int32_t> &caseId) const {
+    uint32_t res = std::holds_alternative<int32_t>(caseId)
+      ? findInteger(std::get<int32_t>(caseId))
+      : findString(std::get<std::string>(caseId));
+    return (res != NO_MATCH) ? res : m_Default;
+  }
+
+private:
+
+  uint32_t findInteger(int32_t value) const {
+    int64_t offset = static_cast<int64_t>(value) - m_DenseBase;
+    if ((offset >= 0) && (offset < static_cast<int64_t>(m_Dense.size()))) {
+      return m_Dense[static_cast<size_t>(offset)];
+    }
+    return findPacked(m_Integers, static_cast<uint64_t>(static_cast<int64_t>(value)));
+  }
+
+  uint32_t findString(const std::string &value) const;
+
+  static uint32_t findPacked(const std::vector<std::pair<uint64_t, uint32_t>> &keys, uint64_t key);
+
+  // strings of up to 7 bytes with their length in the top byte, so "AB" and "AB\0" differ
+  static bool pack(const std::string &value, uint64_t &key);
+
+private:
+
+  int64_t m_DenseBase{ 0 };
+  std::vector<uint32_t> m_Dense;
+  // sorted by key
+  std::vector<std::pair<uint64_t, uint32_t>> m_Integers;
+  std::vector<std::pair<uint64_t, uint32_t>> m_ShortStrings;
+  std::map<std::string, uint32_t> m_LongStrings;
+  uint32_t m_Default{ NO_MATCH };
+
+};
@@ -0,0 +1,115 @@
+#include "ThreadPool.h"
+
+static thread_local int s_WorkerIndex = -1;
+static thread_local ThreadPool *s_WorkerPool = nullptr;
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+  if (numThreads == 0) {
+    numThreads = 1;
+  }
+  for (unsigned int i = 0; i <= numThreads; ++i) {
+    m_Queues.push_back(std::make_unique<WorkQueue>());
+  }
+  m_Workers.reserve(numThreads);
+  for (unsigned int i = 0; i < numThreads; ++i) {
+    m_Workers.emplace_back([this, i]() { run(static_cast<int>(i)); });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+  }
+  m_Wakeup.notify_all();
+  for (std::thread &worker : m_Workers) {
+    worker.join();
+  }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task) {
+  // std::function has to be copyable, the packaged task isn't
+  auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+  std::future<void> res = packaged->get_future();
+  post([packaged]() { (*packaged)(); });
+  return res;
+}
+
+void ThreadPool::post(std::function<void()> task) {
+  WorkQueue &queue = (s_WorkerPool == this)
+    ? *m_Queues[s_WorkerIndex]
+    : *m_Queues.back();
+  {
+    // count first so a worker woken up early retries rather than going back to sleep
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_NumQueued;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  m_Wakeup.notify_one();
+}
+
+bool ThreadPool::runPending() {
+  if (s_WorkerPool != this) {
+    return false;
+  }
+  std::function<void()> task;
+  if (!pop(s_WorkerIndex, task)) {
+    return false;
+  }
+  task();
+  return true;
+}
+
+int ThreadPool::workerIndex() const {
+  return (s_WorkerPool == this) ? s_WorkerIndex : -1;
+}
+
+bool ThreadPool::pop(int index, std::function<void()> &task) {
+  {
+    // own tasks newest first, they are most likely to still be in the cache
+    WorkQueue &own = *m_Queues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      --m_NumQueued;
+      return true;
+    }
+  }
+
+  // then steal from the other workers and the shared queue, oldest first
+  size_t numQueues = m_Queues.size();
+  for (size_t i = 1; i < numQueues; ++i) {
+    WorkQueue &queue = *m_Queues[(index + i) % numQueues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      --m_NumQueued;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(int index) {
+  s_WorkerIndex = index;
+  s_WorkerPool = this;
+  while (true) {
+    std::function<void()> task;
+    if (pop(index, task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if (m_Stop && (m_NumQueued == 0)) {
+      return;
+    }
+    m_Wakeup.wait(lock, [this]() { return m_Stop || (m_NumQueued > 0); });
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * fixed set of worker threads used to index independent sections of a file concurrently.
+ * Each worker has its own queue, tasks posted by a worker go to its own queue and are run newest
+ * first, idle workers steal the oldest tasks from the others
+ */
+class ThreadPool
+{
+public:
+
+  explicit ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &reference) = delete;
+  ThreadPool &operator=(const ThreadPool &reference) = delete;
+
+  unsigned int size() const {
+    return static_cast<unsigned int>(m_Workers.size());
+  }
+
+  /**
+   * queue a task for execution on one of the workers. The future receives the exception if the
+   * task throws one
+   */
+  std::future<void> submit(std::function<void()> task);
+
+  /**
+   * queue a task without a way to wait for it, the task must not throw
+   */
+  void post(std::function<void()> task);
+
+  /**
+   * run one queued task on the calling thread, meant for workers that would otherwise block
+   * waiting for another task. Returns false if the caller isn't a worker of this pool or
+   * there was nothing to do
+   */
+  bool runPending();
+
+  // index of the worker running the calling thread or -1 if the caller isn't a worker of this pool
+  int workerIndex() const;
+
+private:
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void run(int index);
+  bool pop(int index, std::function<void()> &task);
+
+private:
+
+  std::vector<std::thread> m_Workers;
+  // one queue per worker plus one at the end for tasks posted from outside the pool
+  std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+  std::atomic<int> m_NumQueued{ 0 };
+  std::mutex m_Mutex;
+  std::condition_variable m_Wakeup;
+  bool m_Stop{ false };
+
+};
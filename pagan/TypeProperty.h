@@ -1,11 +1,13 @@
 #pragma once
 
 #include "types.h"
+#include "SwitchTable.h"
 
 #include <string>
 #include <cstdio>
 #include <map>
 #include <variant>
+#include <vector>
 
 struct TypeProperty {
   std::string key;
@@ -27,6 +29,12 @@ struct TypeProperty {
   std::string enumName;
   IndexFunc index;
   SwitchFunc switchFunc;
-  std::map<std::variant<std::string, int32_t>, uint32_t> switchCases;
+  SwitchTable switchCases;
   std::vector<std::string> argList;
+  // size if it's known when the spec is loaded, -1 otherwise
+  int32_t fixedSize{ -1 };
+  // condition is known to be false when the spec is loaded
+  bool isAbsent{ false };
+  // properties read by the expressions determining size, count, condition and type
+  std::vector<std::string> dependencies{};
 };
@@ -6,7 +6,9 @@ static const int INIT_TYPES_LENGTH = 64;
 static const char* BaseTypeNames[] = {
   "int8", "int16", "int32", "int64",
   "uint8", "uint16", "uint32", "uint64", "bits",
-  "float", "string", "stringz", "bytes", "runtime"
+  "float", "string", "stringz", "bytes",
+  "int16be", "int32be", "int64be", "uint16be", "uint32be", "uint64be", "floatbe",
+  "runtime"
 };
 
 TypeRegistry::TypeRegistry()
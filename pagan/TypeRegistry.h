@@ -5,6 +5,8 @@
 #include "types.h"
 
 class TypeSpec;
+class ThreadPool;
+class ExpressionCache;
 
 struct TypeAttribute {
   const char *key;
@@ -39,6 +41,42 @@ public:
     return m_NextId++;
   }
 
+  /**
+   * pool used to index large arrays in parallel. Without one, all indexing happens on the
+   * calling thread
+   */
+  void setIndexPool(const std::shared_ptr<ThreadPool> &pool) {
+    m_IndexPool = pool;
+  }
+
+  std::shared_ptr<ThreadPool> getIndexPool() const {
+    return m_IndexPool;
+  }
+
+  /**
+   * index children with a known size as separate tasks on the index pool while their parent
+   * continues behind them
+   */
+  void setIndexSubtrees(bool enabled) {
+    m_IndexSubtrees = enabled;
+  }
+
+  bool getIndexSubtrees() const {
+    return m_IndexSubtrees;
+  }
+
+  /**
+   * compiled expressions of the spec the types were loaded from, also used for expressions
+   * evaluated on the parsed objects
+   */
+  void setExpressions(const std::shared_ptr<ExpressionCache> &expressions) {
+    m_Expressions = expressions;
+  }
+
+  std::shared_ptr<ExpressionCache> getExpressions() const {
+    return m_Expressions;
+  }
+
   static std::tuple<std::string, std::vector<std::string>> splitTypeName(const char* name);
 
   ~TypeRegistry();
@@ -51,6 +89,9 @@ private:
   uint32_t m_NextId{ TypeId::custom };
   std::map<std::string, uint32_t> m_TypeIds;
   std::vector<std::shared_ptr<TypeSpec>> m_Types;
+  std::shared_ptr<ThreadPool> m_IndexPool;
+  bool m_IndexSubtrees{ false };
+  std::shared_ptr<ExpressionCache> m_Expressions;
   // std::map<uint32_t, std::shared_ptr<TypeSpec>> m_Types;
 
 };
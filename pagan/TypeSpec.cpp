@@ -1,9 +1,15 @@
 #include "TypeSpec.h"
 #include "DynObject.h"
+#include "byteorder.h"
+#include "ThreadPool.h"
+#include "SubtreeIndexer.h"
+#include "IncrementalIndexer.h"
+#include <algorithm>
 #include <numeric>
+#include <future>
 
 TypeSpec::TypeSpec(const char *name, uint32_t typeId, TypeRegistry *registry)
-    : m_Name(name), m_Registry(registry), m_Id(typeId), m_StaticSize(0), m_BaseBuffer()
+    : m_Name(name), m_Registry(registry), m_Id(typeId), m_StaticSize(0)
 {
 }
 
@@ -18,14 +24,53 @@ ObjSize TypeSpec::indexEOSArray(const TypeProperty &prop,
                                 DataStreamId dataStream,
                                 std::shared_ptr<IOWrapper> data,
                                 std::streampos streamLimit,
-                                std::function<bool(uint8_t *)> repeatCondition)
+                                std::function<bool(uint8_t *)> repeatCondition,
+                                const uint8_t *scanKey)
 {
 
-  uint32_t size = NUM_STATIC_PROPERTIES * 8;
-  uint8_t *tmpBuffer = m_BaseBuffer;
-  memset(tmpBuffer, 0, 8 * NUM_STATIC_PROPERTIES);
-  uint8_t *curPos = tmpBuffer;
-  uint8_t *endPos = tmpBuffer + size;
+  size_t itemSize = plainNumberSize(prop.typeId);
+  if ((repeatCondition == nullptr) && (itemSize > 0)) {
+    std::streamoff available = streamLimit - data->tellg();
+    if ((available >= 0) && (available % itemSize == 0)) {
+      // list of plain numbers, the index is just a (byte swapped) copy of the data so we can
+      // read it in one go
+      ObjSize count = static_cast<ObjSize>(available / itemSize);
+      ObjSize arrayOffset = indexTable->allocateArray(static_cast<uint32_t>(available));
+      uint8_t *arrayPos = indexTable->arrayAddress(arrayOffset);
+      if (available > 0) {
+        data->read(reinterpret_cast<char *>(arrayPos), available);
+      }
+      if (isBigEndian(prop.typeId)) {
+        swapBytesArray(arrayPos, count, itemSize);
+      }
+      memcpy(buffer, reinterpret_cast<char *>(&count), sizeof(ObjSize));
+      memcpy(buffer + sizeof(ObjSize), reinterpret_cast<char *>(&arrayOffset), sizeof(ObjSize));
+      return count;
+    }
+  }
+
+  // items accessed before the array got indexed keep their index, so changes made through them
+  // remain visible
+  ObjectIndexTable::ItemScan scan;
+  if (scanKey != nullptr)
+  {
+    scan = indexTable->sealScannedItems(scanKey);
+  }
+
+  if ((repeatCondition == nullptr)
+      && indexEOSArrayParallel(prop, indexTable, buffer, obj, dataStream, data, streamLimit, scan))
+  {
+    return *reinterpret_cast<ObjSize *>(buffer);
+  }
+
+  // all items are indexed as part of one job, otherwise each would wait for its own children
+  std::streampos arrayStart = data->tellg();
+  SubtreeScope subtrees(*obj, true);
+
+  // released when the loop gets interrupted, e.g. by a canceled incremental index
+  std::vector<uint8_t> tmpBuffer(NUM_STATIC_PROPERTIES * 8, 0);
+  uint8_t *curPos = tmpBuffer.data();
+  uint8_t *endPos = tmpBuffer.data() + tmpBuffer.size();
 
   int j = 0;
   try
@@ -33,7 +78,22 @@ ObjSize TypeSpec::indexEOSArray(const TypeProperty &prop,
     while (data->tellg() < streamLimit)
     {
       uint8_t *itemPos = curPos;
-      curPos = prop.index(curPos, obj, dataStream, data, streamLimit);
+      auto scanned = scan.items.find(j);
+      if (scanned != scan.items.end())
+      {
+        if (prop.typeId == TypeId::runtime)
+        {
+          memcpy(curPos, &scanned->second.typeId, sizeof(uint32_t));
+          curPos += sizeof(uint32_t);
+        }
+        memcpy(curPos, &scanned->second.objOffset, sizeof(int64_t));
+        curPos += sizeof(int64_t);
+        data->seekg(scanned->second.end);
+      }
+      else
+      {
+        curPos = prop.index(curPos, obj, dataStream, data, streamLimit);
+      }
       // repeatCondition returns true if the loop should be canceled
       if ((repeatCondition != nullptr) && repeatCondition(itemPos))
       {
@@ -47,18 +107,15 @@ ObjSize TypeSpec::indexEOSArray(const TypeProperty &prop,
       {
         LOG_F("{} - continue repeat", prop.debug);
       }
+      IncrementalIndexer::report(data->tellg(), 0);
       if (curPos + 8 >= endPos)
       {
         // reallocate buffer if necessary
-        const size_t offset = curPos - tmpBuffer;
-        // tmpArrayBuffer.resize(tmpArrayBuffer.size() * 2);
-        size *= 2;
-        uint8_t *newBuffer = new uint8_t[size];
-        memcpy(newBuffer, tmpBuffer, offset);
-        tmpBuffer = newBuffer;
-
-        curPos = tmpBuffer + offset;
-        endPos = tmpBuffer + size;
+        const size_t offset = curPos - tmpBuffer.data();
+        tmpBuffer.resize(tmpBuffer.size() * 2);
+
+        curPos = tmpBuffer.data() + offset;
+        endPos = tmpBuffer.data() + tmpBuffer.size();
       }
       ++j;
     }
@@ -70,26 +127,255 @@ ObjSize TypeSpec::indexEOSArray(const TypeProperty &prop,
   }
 
   ObjSize count = j;
-  uint32_t arraySize = static_cast<uint32_t>(curPos - tmpBuffer);
+  uint32_t arraySize = static_cast<uint32_t>(curPos - tmpBuffer.data());
   LOG_F("indexed eos array with {} items to {:x}", count, (uint64_t)buffer);
   // std::cout << "array size " << arraySize << std::endl;
   // create a sufficiently sized array index
   ObjSize arrayOffset = indexTable->allocateArray(arraySize);
 
   // store the array index
-  memcpy(indexTable->arrayAddress(arrayOffset), tmpBuffer, arraySize);
+  memcpy(indexTable->arrayAddress(arrayOffset), tmpBuffer.data(), arraySize);
 
   // buffer receives the effective number of items and the offset into the array index
   memcpy(buffer, reinterpret_cast<char *>(&count), sizeof(ObjSize));
   memcpy(buffer + sizeof(ObjSize), reinterpret_cast<char *>(&arrayOffset), sizeof(ObjSize));
-  if (tmpBuffer != m_BaseBuffer)
+
+  if (!subtrees.close())
   {
-    delete[] tmpBuffer;
+    SubtreeScope::SequentialGuard sequential;
+    data->seekg(arrayStart);
+    return indexEOSArray(prop, indexTable, buffer, obj, dataStream, data, streamLimit, repeatCondition, scanKey);
   }
 
   return count;
 }
 
+bool TypeSpec::indexEOSArrayParallel(const TypeProperty &prop,
+                                     ObjectIndexTable *indexTable,
+                                     uint8_t *buffer,
+                                     const DynObject *obj,
+                                     DataStreamId dataStream,
+                                     std::shared_ptr<IOWrapper> data,
+                                     std::streampos streamLimit,
+                                     const ObjectIndexTable::ItemScan &scan)
+{
+  std::shared_ptr<ThreadPool> pool = m_Registry->getIndexPool();
+  // items with a size of their own would each need a limit, nested parallel indexing
+  // could starve the pool
+  if ((pool == nullptr) || (pool->size() < 2) || (pool->workerIndex() != -1)
+      || (prop.typeId < TypeId::custom) || prop.hasSizeFunc)
+  {
+    return false;
+  }
+
+  std::shared_ptr<TypeSpec> itemType = m_Registry->getById(prop.typeId);
+  if (!itemType->hasBoundaries())
+  {
+    return false;
+  }
+
+  // phase one: a sequential scan over the item headers to find where each item starts. Items
+  // located before only need to be indexed, starting from their checkpoints
+  std::streamoff arrayStart = data->tellg();
+  ObjSize located = scan.count;
+  std::vector<DataOffset> boundaries;
+  data->seekg((located > 0) ? scan.next : static_cast<DataOffset>(arrayStart));
+  if (!itemType->scanBoundaries(indexTable, obj, obj->getStreams(), dataStream, data, streamLimit, boundaries)
+      || (located + boundaries.size() < PARALLEL_INDEX_MIN_ITEMS))
+  {
+    data->seekg(arrayStart);
+    return false;
+  }
+  ObjSize count = located + static_cast<ObjSize>(boundaries.size());
+  boundaries.push_back(static_cast<DataOffset>(streamLimit));
+  LOG_F("index {} items of type {} in parallel", count, itemType->getName());
+
+  // each run of items is indexed front to back by one worker, starting at offset start and
+  // ending at offset end. Only items scanned in phase one have their own boundaries
+  struct Run {
+    size_t begin;
+    size_t end;
+    DataOffset start;
+    DataOffset stop;
+  };
+
+  std::vector<Run> runs;
+  for (size_t i = 0; i < scan.checkpoints.size(); ++i)
+  {
+    size_t begin = i * CHECKPOINT_INTERVAL;
+    size_t end = std::min<size_t>(begin + CHECKPOINT_INTERVAL, located);
+    DataOffset stop = (i + 1 < scan.checkpoints.size()) ? scan.checkpoints[i + 1] : scan.next;
+    runs.push_back({ begin, end, scan.checkpoints[i], stop });
+  }
+  // a few batches per worker so that items of uneven size still get spread evenly
+  size_t numBatches = pool->size() * 4;
+  size_t batchSize = (boundaries.size() - 1 + numBatches - 1) / numBatches;
+  for (size_t begin = 0; begin + 1 < boundaries.size(); begin += batchSize)
+  {
+    size_t end = std::min<size_t>(begin + batchSize, boundaries.size() - 1);
+    runs.push_back({ located + begin, located + end, boundaries[begin], boundaries[end] });
+  }
+
+  // phase two: index the items on the pool. Each worker reads through its own streams and
+  // allocates from its own arena, only the array itself is shared
+  ObjSize arrayOffset = indexTable->allocateArray(count * sizeof(int64_t));
+  uint8_t *arrayPos = indexTable->arrayAddress(arrayOffset);
+
+  struct Worker {
+    std::unique_ptr<StreamRegistry> streams;
+    ObjectIndexTable *arena;
+    // copy of the object owning the array and its ancestors, for use in expressions
+    std::deque<DynObject> chain;
+    const DynObject *parent;
+  };
+
+  std::vector<Worker> workers(pool->size());
+  for (Worker &worker : workers)
+  {
+    worker.streams = obj->getStreams().fork();
+    worker.arena = indexTable->createArena();
+    worker.parent = obj->rebind(*worker.streams, worker.arena, worker.chain);
+  }
+
+  std::atomic<bool> mismatch{false};
+  std::vector<std::future<void>> batches;
+  for (const Run &run : runs)
+  {
+    batches.push_back(pool->submit([&, run]() {
+      Worker &worker = workers[pool->workerIndex()];
+      std::shared_ptr<IOWrapper> itemData = worker.streams->get(dataStream);
+      itemData->seekg(run.start);
+      for (size_t i = run.begin; (i < run.end) && !mismatch; ++i)
+      {
+        int64_t objPtr;
+        auto scanned = scan.items.find(static_cast<ObjSize>(i));
+        if (scanned != scan.items.end())
+        {
+          // indexed when it was accessed on its own
+          objPtr = scanned->second.objOffset;
+          itemData->seekg(scanned->second.end);
+        }
+        else
+        {
+          DataOffset offset = itemData->tellg();
+          ObjectIndex *itemIndex = worker.arena->allocateObject(itemType, dataStream, offset, obj->getIndex());
+          DynObject item(itemType, *worker.streams, worker.arena, itemIndex, worker.parent);
+          item.writeIndex(offset, streamLimit, true);
+          objPtr = reinterpret_cast<int64_t>(itemIndex) * -1;
+        }
+        if ((i >= static_cast<size_t>(located))
+            && (static_cast<DataOffset>(itemData->tellg()) != boundaries[i - located + 1]))
+        {
+          // the item didn't consume exactly what the header announced
+          mismatch = true;
+          break;
+        }
+        memcpy(arrayPos + i * sizeof(int64_t), &objPtr, sizeof(int64_t));
+      }
+      if (static_cast<DataOffset>(itemData->tellg()) != run.stop)
+      {
+        mismatch = true;
+      }
+    }));
+  }
+
+  for (std::future<void> &batch : batches)
+  {
+    try
+    {
+      batch.get();
+    }
+    catch (const std::exception &e)
+    {
+      LOG_F("parallel indexing failed: {}", e.what());
+      mismatch = true;
+    }
+  }
+
+  if (mismatch)
+  {
+    // the sequential run produces the same result it always did, including how errors are
+    // handled. What the workers indexed so far is simply unused
+    data->seekg(arrayStart);
+    return false;
+  }
+
+  memcpy(buffer, reinterpret_cast<char *>(&count), sizeof(ObjSize));
+  memcpy(buffer + sizeof(ObjSize), reinterpret_cast<char *>(&arrayOffset), sizeof(ObjSize));
+  data->seekg(streamLimit);
+  return true;
+}
+
+bool TypeSpec::scanBoundaries(ObjectIndexTable *indexTable,
+                              const DynObject *parent,
+                              const StreamRegistry &streams,
+                              DataStreamId dataStream,
+                              std::shared_ptr<IOWrapper> data,
+                              std::streampos streamLimit,
+                              std::vector<DataOffset> &boundaries,
+                              size_t maxCount)
+{
+  if (!hasBoundaries())
+  {
+    return false;
+  }
+
+  // a single index, reused for each object, holds the header fields so the size of the
+  // boundary property can be evaluated
+  std::shared_ptr<TypeSpec> self = m_Registry->getById(m_Id);
+  size_t bitsetBytes = (m_Sequence.size() + 7) / 8;
+  std::vector<uint64_t> indexMemory((MIN_OBJECT_INDEX_SIZE + bitsetBytes + 7) / 8);
+  ObjectIndex *header = initIndex(reinterpret_cast<uint8_t *>(indexMemory.data()), self, dataStream, 0, parent->getIndex());
+  uint8_t staticBuffer[8 * NUM_STATIC_PROPERTIES];
+  uint8_t *headerBuffer = staticBuffer;
+  std::unique_ptr<uint8_t[]> dynamicBuffer;
+  size_t headerSize = m_SlotOffsets[m_BoundaryProp];
+  if (headerSize > sizeof(staticBuffer))
+  {
+    dynamicBuffer.reset(new uint8_t[headerSize]);
+    headerBuffer = dynamicBuffer.get();
+  }
+  header->properties = headerBuffer;
+  DynObject headerObj(self, streams, indexTable, header, parent);
+
+  const TypeProperty &boundaryProp = m_Sequence[m_BoundaryProp];
+  DataOffset limit = static_cast<DataOffset>(streamLimit);
+
+  try
+  {
+    DataOffset offset = data->tellg();
+    size_t count = 0;
+    while ((offset < limit) && (count < maxCount))
+    {
+      boundaries.push_back(offset);
+      ++count;
+      header->dataOffset = offset;
+      memset(header->bitmask, 0x00, bitsetBytes);
+      data->seekg(offset);
+
+      for (int i = 0; i < m_BoundaryProp; ++i)
+      {
+        header->bitmask[i / 8] |= 1 << (i % 8);
+        readPropToBuffer(m_Sequence[i], indexTable, headerBuffer + m_SlotOffsets[i], &headerObj, streams, dataStream, data, streamLimit);
+      }
+
+      ObjSize size = boundaryProp.size(headerObj);
+      if (size < 0)
+      {
+        return false;
+      }
+      offset = static_cast<DataOffset>(data->tellg()) + size + m_TrailerSize;
+    }
+    data->seekg(offset);
+    return (offset == limit) || ((count == maxCount) && (offset < limit));
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F("failed to scan boundaries of {}: {}", m_Name, e.what());
+    return false;
+  }
+}
+
 /**
  * index the specified property for this object to the buffer.
  * After this call the read pointer of the data stream has to be positioned after the
@@ -133,6 +419,7 @@ uint8_t *TypeSpec::readPropToBuffer(const TypeProperty &prop, ObjectIndexTable *
       {
         LOG_F("testing repeat condition at {} - type {}", (uint64_t)pos, itemType->getName());
         int64_t objIndex = *reinterpret_cast<int64_t *>(pos);
+        SubtreeScope::await(reinterpret_cast<ObjectIndex *>(objIndex * -1));
         DynObject tmp(itemType, streams, indexTable, reinterpret_cast<ObjectIndex *>(objIndex * -1), obj);
 
         return prop.repeatCondition(tmp);
@@ -150,10 +437,24 @@ uint8_t *TypeSpec::readPropToBuffer(const TypeProperty &prop, ObjectIndexTable *
 
       uint8_t *curPos = indexTable->arrayAddress(arrayOffset);
 
-      for (int j = 0; j < count; ++j)
+      size_t itemSize = plainNumberSize(prop.typeId);
+      if ((itemSize > 0) && (count > 0))
       {
-        LOG_F("index array item {}/{}", j, count);
-        curPos = prop.index(curPos, obj, dataStream, data, streamLimit);
+        // plain numbers get copied to the index verbatim so read them all at once
+        data->read(reinterpret_cast<char *>(curPos), count * itemSize);
+        if (isBigEndian(prop.typeId))
+        {
+          swapBytesArray(curPos, count, itemSize);
+        }
+      }
+      else
+      {
+        for (int j = 0; j < count; ++j)
+        {
+          LOG_F("index array item {}/{}", j, count);
+          curPos = prop.index(curPos, obj, dataStream, data, streamLimit);
+          IncrementalIndexer::report(data->tellg(), 0);
+        }
       }
     }
     return buffer + sizeof(ObjSize) * 2;
@@ -166,8 +467,160 @@ uint8_t *TypeSpec::readPropToBuffer(const TypeProperty &prop, ObjectIndexTable *
   }
 }
 
+void TypeSpec::appendBoundary(const TypeProperty &prop)
+{
+  if (m_BoundaryProp == BOUNDARY_INVALID)
+  {
+    return;
+  }
+
+  bool isFixed = !(prop.isConditional || prop.isList || prop.hasSizeFunc || prop.isSwitch
+                   || (prop.typeId == TypeId::stringz) || !prop.processing.empty());
+  int32_t size = isFixed ? staticSize(prop.typeId) : -1;
+  if (prop.isAbsent && (m_BoundaryProp != BOUNDARY_NONE))
+  {
+    // the header is read property by property so absent properties can only be skipped in the trailer
+    size = 0;
+  }
+  else if ((prop.fixedSize >= 0) && !(prop.isConditional || prop.isList || prop.isSwitch))
+  {
+    size = prop.fixedSize;
+  }
+
+  if (size >= 0)
+  {
+    if (m_BoundaryProp != BOUNDARY_NONE)
+    {
+      m_TrailerSize += size;
+    }
+  }
+  else if ((m_BoundaryProp == BOUNDARY_NONE) && prop.hasSizeFunc && !prop.isConditional && !prop.isList)
+  {
+    m_BoundaryProp = static_cast<int>(m_Sequence.size()) - 1;
+  }
+  else
+  {
+    m_BoundaryProp = BOUNDARY_INVALID;
+  }
+}
+
+void TypeSpec::appendLayout(const TypeProperty &prop, int32_t dataOffset, uint32_t indexOffset)
+{
+  size_t width = plainNumberSize(prop.typeId);
+  LayoutStep step;
+  if (!prop.processing.empty())
+  {
+    // leave reporting the error to the regular code path
+    m_LayoutValid = false;
+    return;
+  }
+  else if (width > 0)
+  {
+    step = { isBigEndian(prop.typeId) ? LayoutStep::SWAP : LayoutStep::COPY, static_cast<uint8_t>(width),
+             static_cast<uint32_t>(dataOffset), indexOffset, static_cast<uint32_t>(width) };
+  }
+  else if (prop.typeId >= TypeId::custom)
+  {
+    step = { LayoutStep::OBJECT, sizeof(int64_t), static_cast<uint32_t>(dataOffset), indexOffset, sizeof(int64_t) };
+  }
+  else
+  {
+    m_LayoutValid = false;
+    return;
+  }
+
+  m_StaticFields[prop.key] = { prop.typeId, static_cast<uint32_t>(dataOffset) };
+
+  if (!m_Layout.empty())
+  {
+    // merge with the previous step if both are contiguous runs of the same kind
+    LayoutStep &prev = *m_Layout.rbegin();
+    bool contiguous = (prev.dataOffset + prev.size == step.dataOffset)
+                   && (prev.indexOffset + prev.size == step.indexOffset);
+    if (contiguous
+        && (((prev.kind == LayoutStep::COPY) && (step.kind == LayoutStep::COPY))
+            || ((prev.kind == LayoutStep::SWAP) && (step.kind == LayoutStep::SWAP) && (prev.width == step.width))))
+    {
+      prev.size += step.size;
+      return;
+    }
+  }
+
+  m_Layout.push_back(step);
+}
+
+const TypeSpec::StaticField *TypeSpec::staticField(const char *key) const
+{
+  if (!hasStaticLayout())
+  {
+    return nullptr;
+  }
+  auto iter = m_StaticFields.find(key);
+  return iter != m_StaticFields.end() ? &iter->second : nullptr;
+}
+
+void TypeSpec::writeStaticIndex(ObjectIndexTable *indexTable, ObjectIndex *objIndex, std::shared_ptr<IOWrapper> data)
+{
+  DataOffset dataOffset = data->tellg();
+
+  uint8_t staticBuffer[8 * NUM_STATIC_PROPERTIES];
+  uint8_t *raw = staticBuffer;
+  std::unique_ptr<uint8_t[]> dynamicBuffer;
+  if ((m_StaticSize > 0) && (static_cast<size_t>(m_StaticSize) > sizeof(staticBuffer)))
+  {
+    dynamicBuffer.reset(new uint8_t[m_StaticSize]);
+    raw = dynamicBuffer.get();
+  }
+
+  if (m_StaticSize > 0)
+  {
+    data->read(reinterpret_cast<char *>(raw), m_StaticSize);
+  }
+
+  // all properties are present, otherwise the size wouldn't be static, except those that never are
+  size_t numProps = m_Sequence.size();
+  memset(objIndex->bitmask, 0xFF, numProps / 8);
+  if (numProps % 8 != 0)
+  {
+    objIndex->bitmask[numProps / 8] = static_cast<uint8_t>((1 << (numProps % 8)) - 1);
+  }
+  for (int idx : m_AbsentProps)
+  {
+    objIndex->bitmask[idx / 8] &= ~static_cast<uint8_t>(1 << (idx % 8));
+  }
+
+  uint8_t *properties = indexTable->allocateProperties(objIndex, m_IndexSize);
+
+  for (const LayoutStep &step : m_Layout)
+  {
+    switch (step.kind)
+    {
+    case LayoutStep::COPY:
+      memcpy(properties + step.indexOffset, raw + step.dataOffset, step.size);
+      break;
+    case LayoutStep::SWAP:
+      memcpy(properties + step.indexOffset, raw + step.dataOffset, step.size);
+      swapBytesArray(properties + step.indexOffset, step.size / step.width, step.width);
+      break;
+    case LayoutStep::OBJECT:
+    {
+      int64_t objOffset = static_cast<int64_t>(dataOffset) + step.dataOffset;
+      memcpy(properties + step.indexOffset, &objOffset, sizeof(int64_t));
+    }
+    break;
+    }
+  }
+}
+
 void TypeSpec::writeIndex(ObjectIndexTable *indexTable, ObjectIndex *objIndex, std::shared_ptr<IOWrapper> data, const StreamRegistry &streams, DynObject *obj, std::streampos streamLimit)
 {
+  if (hasStaticLayout())
+  {
+    writeStaticIndex(indexTable, objIndex, data);
+    IncrementalIndexer::report(data->tellg(), 1);
+    return;
+  }
+
   // first: base data offset of the object
   // TODO: this should be the id of the data stream
   DataStreamId dataStream = 0;
@@ -184,14 +637,17 @@ void TypeSpec::writeIndex(ObjectIndexTable *indexTable, ObjectIndex *objIndex, s
   uint8_t staticBuffer[8 * NUM_STATIC_PROPERTIES];
   uint8_t *buffer = staticBuffer;
   std::unique_ptr<uint8_t[]> dynamicBuffer;
-  if (m_Sequence.size() > NUM_STATIC_PROPERTIES)
+  if (m_IndexSize > sizeof(staticBuffer))
   {
-    dynamicBuffer.reset(new uint8_t[m_Sequence.size() * 8]);
+    dynamicBuffer.reset(new uint8_t[m_IndexSize]);
     buffer = dynamicBuffer.get();
   }
   DataOffset dataMax = dataOffset;
   uint8_t *propertiesEnd = buffer;
 
+  // size-delimited children may get deferred, they're queued once this index is final
+  SubtreeScope subtrees(*obj);
+
   objIndex->properties = buffer;
 
   // third: create properties index
@@ -200,14 +656,7 @@ void TypeSpec::writeIndex(ObjectIndexTable *indexTable, ObjectIndex *objIndex, s
     LOG_F("index seq {0}/{1}", i, m_Sequence.size());
     int imod8 = i % 8;
     // LogBracket::log(fmt::format("seq {0} {1} {2:x} (vs {3:x})", i, m_Sequence[i].key, reinterpret_cast<int64_t>(propertiesEnd), reinterpret_cast<int64_t>(buffer)));
-    TypeProperty &prop = m_Sequence[i];
-
-    if (!prop.index)
-    {
-      std::string typeName = m_Registry->getById(prop.typeId)->getName();
-      LOG_F("make index func for {0} - list: {1}", typeName, prop.isList);
-      prop.index = makeIndexFunc(prop, streams, indexTable);
-    }
+    const TypeProperty &prop = m_Sequence[i];
 
     bool isPresent = !prop.isConditional || prop.condition(*obj);
     if (isPresent)
@@ -222,7 +671,7 @@ void TypeSpec::writeIndex(ObjectIndexTable *indexTable, ObjectIndex *objIndex, s
 
     if (isPresent)
     {
-      propertiesEnd = readPropToBuffer(prop, indexTable, propertiesEnd, obj, streams, dataStream, data, streamLimit);
+      propertiesEnd = readPropToBuffer(prop, indexTable, buffer + m_SlotOffsets[i], obj, streams, dataStream, data, streamLimit);
     }
     DataOffset dataNow = data->tellg();
     if (dataNow > dataMax)
@@ -231,7 +680,18 @@ void TypeSpec::writeIndex(ObjectIndexTable *indexTable, ObjectIndex *objIndex, s
     }
   }
 
-  indexTable->setProperties(objIndex, buffer, propertiesEnd - buffer);
+  indexTable->setProperties(objIndex, buffer, std::max<size_t>(propertiesEnd - buffer, m_IndexSize));
+
+  if (!subtrees.close())
+  {
+    // a deferred child didn't index the way it would have in sequence, start over without deferring
+    SubtreeScope::SequentialGuard sequential;
+    data->seekg(dataOffset);
+    writeIndex(indexTable, objIndex, data, streams, obj, streamLimit);
+    return;
+  }
+
+  IncrementalIndexer::report(data->tellg(), 1);
 }
 
 std::vector<TypeProperty>::const_iterator TypeSpec::paramByKey(const char *key, int *offset) const
@@ -253,40 +713,132 @@ std::vector<TypeProperty>::const_iterator TypeSpec::paramByKey(const char *key,
   return m_Params.begin() + off;
 }
 
-std::function<std::vector<TypeProperty>::const_iterator(ObjectIndex*)> TypeSpec::propertyByKeyFunc(const char *key, int *offset) const
+// first segment of a dotted path
+static std::string pathHead(const std::string &path)
 {
-  if (offset != nullptr)
+  return path.substr(0, path.find('.'));
+}
+
+void TypeSpec::insertComputed(const char *key, ComputeFunc func, const std::vector<std::string> *dependencies)
+{
+  LOG_F("add computed {0} - {1}", m_Id, key);
+  auto existing = m_Computed.find(key);
+  uint32_t num = existing != m_Computed.end() ? existing->second.num : static_cast<uint32_t>(m_Computed.size());
+
+  Computed computed{ func, {}, num, dependencies != nullptr, true };
+  if (dependencies != nullptr)
   {
-    *offset = 0;
+    computed.dependencies = *dependencies;
   }
-  int idx = 0;
+  m_Computed[key] = computed;
 
-  auto iter = std::find_if(m_Sequence.cbegin(), m_Sequence.cend(), [&idx, key, offset, this](const TypeProperty& prop) {
-    bool res = prop.key == key;
-    if (!res) {
-      ++idx;
-      if (offset != nullptr) {
-        if (prop.isList) {
-          // lists store the item count and offset into the array index here
-          *offset += sizeof(ObjSize) * 2;
-        }
-        else {
-          *offset += indexSize(prop.typeId);
-        }
+  // a computed property is local if it only reads plain properties of its object or other
+  // local computed properties. Instances may refer to ones added later so this is redone each time
+  for (auto &iter : m_Computed)
+  {
+    const std::vector<std::string> &deps = iter.second.dependencies;
+    iter.second.isLocal = std::none_of(deps.begin(), deps.end(), [](const std::string &path) {
+      return (path[0] == '_') || (path.find('.') != std::string::npos);
+    });
+  }
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto &iter : m_Computed)
+    {
+      if (!iter.second.isLocal)
+      {
+        continue;
+      }
+      const std::vector<std::string> &deps = iter.second.dependencies;
+      bool readsNonLocal = std::any_of(deps.begin(), deps.end(), [this](const std::string &path) {
+        auto dep = m_Computed.find(path);
+        return (dep != m_Computed.end()) && !dep->second.isLocal;
+      });
+      if (readsNonLocal)
+      {
+        iter.second.isLocal = false;
+        changed = true;
       }
     }
-    return res;
-  });
+  }
+}
 
-  if (iter == m_Sequence.cend()) {
-    return [key](ObjectIndex*) -> std::vector<TypeProperty>::const_iterator {
-      throw std::runtime_error(fmt::format("property not present in object: {}", key));
+std::vector<uint32_t> TypeSpec::getComputedDependents(const char *key) const
+{
+  std::vector<uint32_t> res;
+  std::vector<std::string> changed{ key };
+  while (!changed.empty())
+  {
+    std::string cur = changed.back();
+    changed.pop_back();
+    for (const auto &iter : m_Computed)
+    {
+      const Computed &computed = iter.second;
+      if (!computed.cacheable || (std::find(res.begin(), res.end(), computed.num) != res.end()))
+      {
+        continue;
+      }
+      bool depends = std::any_of(computed.dependencies.begin(), computed.dependencies.end(), [&cur](const std::string &path) {
+        return pathHead(path) == cur;
+      });
+      if (depends)
+      {
+        res.push_back(computed.num);
+        changed.push_back(iter.first);
+      }
+    }
+  }
+  return res;
+}
+
+std::vector<std::string> TypeSpec::getDependents(const char *key) const
+{
+  size_t keyLength = strlen(key);
+  std::vector<std::string> res;
+  for (const TypeProperty &prop : m_Sequence)
+  {
+    bool depends = std::any_of(prop.dependencies.begin(), prop.dependencies.end(), [key, keyLength](const std::string &path) {
+      return (path.compare(0, keyLength, key) == 0) && ((path.length() == keyLength) || (path[keyLength] == '.'));
+    });
+    if (depends)
+    {
+      res.push_back(prop.key);
+    }
+  }
+  return res;
+}
+
+int TypeSpec::propertyIndex(const char *key, int *offset) const
+{
+  auto iter = m_SequenceIdx.find(key);
+  if (iter == m_SequenceIdx.cend())
+  {
+    return -1;
+  }
+
+  if (offset != nullptr)
+  {
+    *offset = m_SlotOffsets[iter->second];
+  }
+  return iter->second;
+}
+
+std::function<std::vector<TypeProperty>::const_iterator(ObjectIndex*)> TypeSpec::propertyByKeyFunc(const char *key, int *offset) const
+{
+  int idx = propertyIndex(key, offset);
+
+  std::string name(key);
+  if (idx == -1) {
+    return [name](ObjectIndex*) -> std::vector<TypeProperty>::const_iterator {
+      throw std::runtime_error(fmt::format("property not present in object: {}", name));
     };
   }
 
-  return [idx, key, this](ObjectIndex* objectIndex) {
+  return [idx, name, this](ObjectIndex* objectIndex) {
     if (!isBitSet(objectIndex, idx)) {
-      throw std::runtime_error(fmt::format("property not present in object: {}", key));
+      throw std::runtime_error(fmt::format("property not present in object: {}", name));
     }
     return m_Sequence.cbegin() + idx;
   };
@@ -294,28 +846,12 @@ std::function<std::vector<TypeProperty>::const_iterator(ObjectIndex*)> TypeSpec:
 
 std::vector<TypeProperty>::const_iterator TypeSpec::propertyByKey(ObjectIndex *objIndex, const char *key, int *offset) const
 {
-  if (offset != nullptr)
+  int idx = propertyIndex(key, offset);
+  if ((idx == -1) || !isBitSet(objIndex, idx))
   {
-    *offset = 0;
+    return m_Sequence.cend();
   }
-  int idx = 0;
-  return std::find_if(m_Sequence.cbegin(), m_Sequence.cend(), [&idx, objIndex, key, offset, this](const TypeProperty &prop)
-                      {
-    bool isPresent = isBitSet(objIndex, idx);
-    bool res = (prop.key == key) && isPresent;
-    if (!res) {
-      ++idx;
-      if (isPresent && (offset != nullptr)) {
-        if (prop.isList) {
-          // lists store the item count and offset into the array index here
-          *offset += sizeof(ObjSize) * 2;
-        }
-        else {
-          *offset += indexSize(prop.typeId);
-        }
-      }
-    }
-    return res; });
+  return m_Sequence.cbegin() + idx;
 }
 
 std::function<std::tuple<uint32_t, int, int>(ObjectIndex*)> TypeSpec::getPorPImpl(const char* key) const
@@ -332,7 +868,8 @@ std::function<std::tuple<uint32_t, int, int>(ObjectIndex*)> TypeSpec::getPorPImp
 
     if (iter != m_Params.cend())
     {
-      return [=](ObjectIndex*) -> std::tuple<uint32_t, int, int> { return std::make_tuple(iter->typeId, -1, propertyOffset); };
+      uint32_t typeId = iter->typeId;
+      return [=](ObjectIndex*) -> std::tuple<uint32_t, int, int> { return std::make_tuple(typeId, -1, propertyOffset); };
     }
   }
 
@@ -352,14 +889,12 @@ std::tuple<uint32_t, size_t> TypeSpec::get(ObjectIndex *objIndex, const char *ke
   size_t bitsetBytes = (m_Sequence.size() + 7) / 8;
   size_t offset = sizeof(DataStreamId) + sizeof(DataOffset);
 
-  int idx = 0;
-
   { // property?
     auto iter = propertyByKey(objIndex, key, &propertyOffset);
 
     if (iter != m_Sequence.cend())
     {
-      if (!isBitSet(objIndex, idx))
+      if (!isBitSet(objIndex, static_cast<int>(iter - m_Sequence.cbegin())))
       {
         throw std::runtime_error(fmt::format("Property not set: {0}", key));
       }
@@ -374,23 +909,13 @@ std::tuple<uint32_t, size_t> TypeSpec::get(ObjectIndex *objIndex, const char *ke
 
 std::tuple<uint32_t, int, int> TypeSpec::getPorP(ObjectIndex *objIndex, const char *key) const
 {
-  auto iter = m_PoPCache.find(key);
-
-  if (iter != m_PoPCache.cend()) {
-    return iter->second(objIndex);
-  }
+  auto iter = m_PoPIndex.find(key);
 
-  try {
-    m_PoPCache[key] = getPorPImpl(key);
-    return m_PoPCache[key](objIndex);
-  }
-  catch (const std::exception& e) {
-    m_PoPCache[key] = [key](ObjectIndex*) -> std::tuple<uint32_t, int, int> {
-      throw std::runtime_error(fmt::format("Property not found: {0}", key));
-    };
+  if (iter == m_PoPIndex.cend()) {
+    throw std::runtime_error(fmt::format("Property not found: {0}", key));
   }
 
-  return m_PoPCache[key](objIndex);
+  return iter->second(objIndex);
 }
 
 std::tuple<uint32_t, size_t, std::vector<std::string>, bool> TypeSpec::getWithArgs(ObjectIndex *objIndex, const char *key) const
@@ -400,14 +925,12 @@ std::tuple<uint32_t, size_t, std::vector<std::string>, bool> TypeSpec::getWithAr
   size_t bitsetBytes = (m_Sequence.size() + 7) / 8;
   size_t offset = sizeof(DataStreamId) + sizeof(DataOffset);
 
-  int idx = 0;
-
   { // property?
     auto iter = propertyByKey(objIndex, key, &propertyOffset);
 
     if (iter != m_Sequence.cend())
     {
-      if (!isBitSet(objIndex, idx))
+      if (!isBitSet(objIndex, static_cast<int>(iter - m_Sequence.cbegin())))
       {
         throw std::runtime_error(fmt::format("Property not set: {0}", key));
       }
@@ -470,9 +993,7 @@ uint8_t *TypeSpec::indexCustom(const TypeProperty &prop, uint32_t typeId,
   else
   {
     // unknown size. to read past the object we have to index it recursively
-    ObjectIndex *propObjIndex = indexTable->allocateObject(spec, dataStream, dataPos);
-
-    DynObject newObj(spec, streams, indexTable, propObjIndex, obj);
+    ObjectIndex *propObjIndex = indexTable->allocateObject(spec, dataStream, dataPos, obj->getIndex());
 
     ObjSize size = prop.hasSizeFunc ? prop.size(*obj) : 0;
 
@@ -484,17 +1005,22 @@ uint8_t *TypeSpec::indexCustom(const TypeProperty &prop, uint32_t typeId,
                                   ? (dataPos + std::streamoff(size))
                                   : streamLimit;
 
-    if (newLimit != streamLimit)
+    if (prop.hasSizeFunc
+        && ((static_cast<int64_t>(streamLimit) == 0) || (newLimit <= streamLimit))
+        && (newLimit <= data->size())
+        && SubtreeScope::defer(*obj, spec, propObjIndex, dataStream, dataPos, newLimit))
     {
-      int64_t lim = newLimit;
-      if (lim < 0)
-      {
-        ObjSize again = prop.size(*obj);
-        LOG_F("new limit unknown, determine size (of {}) {}", m_Registry->getById(prop.typeId)->getName(), again);
-      }
-      LOG_F("new stream limit {} (has size: {})", lim, prop.hasSizeFunc);
-      lim += 1;
+      // we know where the child ends so it can be indexed independently. The index allocated
+      // for it serves as the placeholder until then
+      int64_t objPtr = reinterpret_cast<int64_t>(propObjIndex) * -1;
+      memcpy(index, reinterpret_cast<char *>(&objPtr), sizeof(int64_t));
+      data->seekg(newLimit);
+      return index + sizeof(int64_t);
     }
+
+    DynObject newObj(spec, streams, indexTable, propObjIndex, obj);
+
+    LOG_F("new stream limit {} (has size: {}, size {})", static_cast<int64_t>(newLimit), prop.hasSizeFunc, size);
     newObj.writeIndex(dataPos, newLimit, true);
 
     std::streamoff dynSize = data->tellg() - dataPos;
@@ -514,25 +1040,24 @@ uint8_t *TypeSpec::indexCustom(const TypeProperty &prop, uint32_t typeId,
   return reinterpret_cast<uint8_t *>(res);
 }
 
-auto TypeSpec::makeIndexFunc(const TypeProperty &prop,
-                             const StreamRegistry &streams,
-                             ObjectIndexTable *indexTable)
-    -> IndexFunc
+uint32_t &TypeSpec::bitmaskOffset(const DynObject *obj) const
+{
+  return obj->getStreams().getContext().bitOffset(m_Id);
+}
+
+auto TypeSpec::makeIndexFunc(const TypeProperty &prop) -> IndexFunc
 {
+  // the index table and streams are taken from the object being indexed, not captured, so the
+  // same function can index into different tables on different threads
   if (prop.typeId == TypeId::runtime)
   {
-    return [this, prop, indexTable, streams](uint8_t *index, const DynObject *obj, DataStreamId dataStream, std::shared_ptr<IOWrapper> data, std::streampos streamLimit) -> uint8_t *
+    return [this, prop](uint8_t *index, const DynObject *obj, DataStreamId dataStream, std::shared_ptr<IOWrapper> data, std::streampos streamLimit) -> uint8_t *
     {
       // TODO: currently assumes a runtime type never resolves to bit - which I really hope is true
       LOG_F("reset bitmask offset (1)");
-      this->m_BitmaskOffset = 0;
-      std::variant<std::string, int32_t> caseId = prop.switchFunc(*obj);
-      auto iter = prop.switchCases.find(caseId);
-      if (iter == prop.switchCases.end())
-      {
-        iter = prop.switchCases.find("_");
-      }
-      if (iter == prop.switchCases.end())
+      this->bitmaskOffset(obj) = 0;
+      uint32_t typeId = prop.switchCases.find(prop.switchFunc(*obj));
+      if (typeId == SwitchTable::NO_MATCH)
       {
         // apparently it's ok for there to not be a match, in this case ignore the content, consume nothing
         // if there is no size field
@@ -544,7 +1069,6 @@ auto TypeSpec::makeIndexFunc(const TypeProperty &prop,
         }
         return index;
       }
-      uint32_t typeId = iter->second;
       LOG_F("index runtime type: \"{}\" - {} at {}", m_Registry->getById(typeId)->getName(), typeId, reinterpret_cast<int64_t>(index));
 
       memcpy(index, reinterpret_cast<uint8_t *>(&typeId), sizeof(uint32_t));
@@ -553,7 +1077,7 @@ auto TypeSpec::makeIndexFunc(const TypeProperty &prop,
       if (typeId >= TypeId::custom)
       {
         auto before = data->tellg();
-        auto res = this->indexCustom(prop, typeId, streams, indexTable, index, obj, dataStream, data, streamLimit);
+        auto res = this->indexCustom(prop, typeId, obj->getStreams(), obj->getIndexTable(), index, obj, dataStream, data, streamLimit);
         auto after = data->tellg();
         if ((after - before) == 0)
         {
@@ -571,12 +1095,12 @@ auto TypeSpec::makeIndexFunc(const TypeProperty &prop,
   else if (prop.typeId >= TypeId::custom)
   {
     // index custom type
-    return [this, prop, indexTable, streams](uint8_t *index, const DynObject *obj, DataStreamId dataStream, std::shared_ptr<IOWrapper> data, std::streampos streamLimit) -> uint8_t *
+    return [this, prop](uint8_t *index, const DynObject *obj, DataStreamId dataStream, std::shared_ptr<IOWrapper> data, std::streampos streamLimit) -> uint8_t *
     {
-      LOG_F("reset bitmask offset (2) -> {}", this->m_BitmaskOffset);
-      this->m_BitmaskOffset = 0;
+      LOG_F("reset bitmask offset (2) -> {}", this->bitmaskOffset(obj));
+      this->bitmaskOffset(obj) = 0;
       LOG_F("index custom type {}", m_Registry->getById(prop.typeId)->getName());
-      return this->indexCustom(prop, prop.typeId, streams, indexTable, index, obj, dataStream, data, streamLimit);
+      return this->indexCustom(prop, prop.typeId, obj->getStreams(), obj->getIndexTable(), index, obj, dataStream, data, streamLimit);
     };
   }
   else if (prop.typeId == TypeId::bits)
@@ -584,16 +1108,17 @@ auto TypeSpec::makeIndexFunc(const TypeProperty &prop,
     return [=](uint8_t *index, const DynObject *obj, DataStreamId dataStream, std::shared_ptr<IOWrapper> data, std::streampos streamLimit) -> uint8_t *
     {
       uint32_t size = prop.size(*obj);
-      LOG_F("index bitmask off {}, size {}", this->m_BitmaskOffset, size);
-      if ((static_cast<uint64_t>(this->m_BitmaskOffset) + size) > sizeof(uint32_t) * 8)
+      uint32_t &bitmaskOffset = this->bitmaskOffset(obj);
+      LOG_F("index bitmask off {}, size {}", bitmaskOffset, size);
+      if ((static_cast<uint64_t>(bitmaskOffset) + size) > sizeof(uint32_t) * 8)
       {
         LOG_F("reset bitmask offset (3)");
-        this->m_BitmaskOffset = 0;
+        bitmaskOffset = 0;
       }
 
       LOG_F("index bitmask {}", data->tellg());
-      char *res = type_index_bits(static_cast<TypeId>(prop.typeId), this->m_BitmaskOffset, size, reinterpret_cast<char *>(index), data, obj, prop.debug);
-      this->m_BitmaskOffset = (this->m_BitmaskOffset + size) % 8;
+      char *res = type_index_bits(static_cast<TypeId>(prop.typeId), bitmaskOffset, size, reinterpret_cast<char *>(index), data, obj, prop.debug);
+      bitmaskOffset = (bitmaskOffset + size) % 8;
       return reinterpret_cast<uint8_t *>(res);
     };
   }
@@ -603,7 +1128,7 @@ auto TypeSpec::makeIndexFunc(const TypeProperty &prop,
     return [=](uint8_t *index, const DynObject *obj, DataStreamId dataStream, std::shared_ptr<IOWrapper> data, std::streampos streamLimit) -> uint8_t *
     {
       LOG_F("reset bitmask offset (4)");
-      this->m_BitmaskOffset = 0;
+      this->bitmaskOffset(obj) = 0;
       LOG_F("index pod type {}", m_Registry->getById(prop.typeId)->getName());
       char *res = type_index(static_cast<TypeId>(prop.typeId), prop.size, reinterpret_cast<char *>(index), data, obj, prop.debug);
       return reinterpret_cast<uint8_t *>(res);
@@ -655,6 +1180,38 @@ TypePropertyBuilder &TypePropertyBuilder::withSize(SizeFunc func)
   return *this;
 }
 
+TypePropertyBuilder &TypePropertyBuilder::withStaticSize(ObjSize size)
+{
+  m_Wrappee->size = [size](const IScriptQuery &) -> ObjSize { return size; };
+  m_Wrappee->hasSizeFunc = true;
+  m_Wrappee->fixedSize = static_cast<int32_t>(size);
+  return *this;
+}
+
+TypePropertyBuilder &TypePropertyBuilder::withStaticCondition(bool present)
+{
+  if (!present)
+  {
+    m_Wrappee->condition = [](const IScriptQuery &) -> bool { return false; };
+    m_Wrappee->isConditional = true;
+    m_Wrappee->isAbsent = true;
+  }
+  return *this;
+}
+
+TypePropertyBuilder &TypePropertyBuilder::withDependencies(const std::vector<std::string> &paths)
+{
+  std::vector<std::string> &deps = m_Wrappee->dependencies;
+  for (const std::string &path : paths)
+  {
+    if (std::find(deps.begin(), deps.end(), path) == deps.end())
+    {
+      deps.push_back(path);
+    }
+  }
+  return *this;
+}
+
 TypePropertyBuilder &TypePropertyBuilder::withEnum(const std::string &enumName)
 {
   m_Wrappee->enumName = enumName;
@@ -687,7 +1244,7 @@ TypePropertyBuilder &TypePropertyBuilder::withRepeatCondition(ConditionFunc func
 TypePropertyBuilder &TypePropertyBuilder::withTypeSwitch(SwitchFunc func, const std::map<std::variant<std::string, int32_t>, uint32_t> &cases)
 {
   m_Wrappee->switchFunc = func;
-  m_Wrappee->switchCases = cases;
+  m_Wrappee->switchCases = SwitchTable(cases);
   m_Wrappee->isSwitch = true;
   return *this;
 }
@@ -7,6 +7,8 @@
 #include <sstream>
 #include <functional>
 #include <any>
+#include <optional>
+#include <limits>
 #include <cassert>
 #include <variant>
 #include "types.h"
@@ -72,6 +74,20 @@ static ValidationFunc validFunc = [](const std::any& value) -> bool {
 static AssignCB nop = [] (IScriptQuery &object, const std::any& value) {
 };
 
+// property with nothing set beyond key and type. Fields not assigned here keep their default
+static TypeProperty defaultProperty(const char *key, uint32_t type) {
+  TypeProperty res{};
+  res.key = key;
+  res.typeId = type;
+  res.size = nullSize;
+  res.count = nullSize;
+  res.repeatCondition = trueFunc;
+  res.validation = validFunc;
+  res.condition = trueFunc;
+  res.onAssign = nop;
+  return res;
+}
+
 class TypePropertyBuilder {
 public:
   TypePropertyBuilder(TypeProperty *wrappee, std::function<void()> cb);
@@ -81,6 +97,15 @@ public:
 
   TypePropertyBuilder &withCondition(ConditionFunc func);
   TypePropertyBuilder &withSize(SizeFunc func);
+  /**
+   * size that doesn't depend on the object, so objects of this type can still have a static size
+   */
+  TypePropertyBuilder &withStaticSize(ObjSize size);
+  /**
+   * condition that doesn't depend on the object. Properties that are never present take no space
+   * and leave the size of the object static
+   */
+  TypePropertyBuilder &withStaticCondition(bool present);
   TypePropertyBuilder &withEnum(const std::string &enumName);
   TypePropertyBuilder &withRepeatToEOS();
   TypePropertyBuilder &withCount(SizeFunc func);
@@ -91,6 +116,10 @@ public:
   TypePropertyBuilder &withValidation(ValidationFunc func);
   TypePropertyBuilder &withDebug(const std::string &debugMessage);
   TypePropertyBuilder &withArguments(const std::vector<std::string> &args);
+  /**
+   * record properties the expressions of this property read
+   */
+  TypePropertyBuilder &withDependencies(const std::vector<std::string> &paths);
 
 private:
   TypeProperty *m_Wrappee;
@@ -137,23 +166,48 @@ public:
 
   void appendParameter(const char* key, uint32_t type) {
     m_ParamIdx[key] = static_cast<int>(m_Params.size());
-    m_Params.push_back({ key, type, nullSize, nullSize, trueFunc, validFunc, trueFunc, nop, false, false, false, false });
+    m_Params.push_back(defaultProperty(key, type));
+    // parameters take precedence over properties of the same name
+    m_PoPIndex[key] = getPorPImpl(key);
   }
 
   TypePropertyBuilder appendProperty(const char *key, uint32_t type) {
     LOG_F("append prop to {0} - {1} size index {2}, size data {3}", m_Id, key, m_IndexSize, m_StaticSize);
     m_SequenceIdx[key] = static_cast<int>(m_Sequence.size());
-    m_Sequence.push_back({ key, type, nullSize, nullSize, trueFunc, validFunc, trueFunc, nop, false, false, false, false });
+    m_Sequence.push_back(defaultProperty(key, type));
     TypeProperty *prop = &*m_Sequence.rbegin();
     return TypePropertyBuilder(prop, [this, type, prop]() {
-      m_IndexSize += prop->isList ? (sizeof(ObjSize) * 2) : indexSize(type);
-      if (prop->isConditional || prop->isList || prop->hasSizeFunc || prop->isSwitch || (prop->typeId == TypeId::stringz)) {
+      uint32_t indexOffset = m_IndexSize;
+      m_SlotOffsets.push_back(static_cast<uint16_t>(indexOffset));
+      if (!prop->isAbsent) {
+        // like any property that isn't present, absent ones take no space in the index
+        m_IndexSize += prop->isList ? (sizeof(ObjSize) * 2) : indexSize(type);
+      }
+      appendBoundary(*prop);
+      if (prop->isAbsent) {
+        m_AbsentProps.push_back(static_cast<int>(m_Sequence.size()) - 1);
+      }
+      else if (prop->isConditional || prop->isList || prop->isSwitch || (prop->typeId == TypeId::stringz)
+               || (prop->hasSizeFunc && (prop->fixedSize < 0))) {
         m_StaticSize = -1;
       }
+      else if (prop->hasSizeFunc) {
+        // objects can be skipped without indexing them but sized properties aren't part of the layout
+        if (m_StaticSize >= 0) {
+          m_StaticSize += prop->fixedSize;
+        }
+        m_LayoutValid = false;
+      }
       else {
+        int32_t dataOffset = m_StaticSize;
         addStaticSize(type);
+        if (m_StaticSize >= 0) {
+          appendLayout(*prop, dataOffset, indexOffset);
+        }
       }
       LOG_F("size after append {0}", m_StaticSize);
+      prop->index = makeIndexFunc(*prop);
+      m_PoPIndex.emplace(prop->key, getPorPImpl(prop->key.c_str()));
     });
   }
 
@@ -162,8 +216,15 @@ public:
   }
 
   void addComputed(const char* key, ComputeFunc func) {
-    LOG_F("add computed {0} - {1}", m_Id, key);
-    m_Computed[key] = func;
+    insertComputed(key, func, nullptr);
+  }
+
+  /**
+   * add a computed property reading the specified properties. Knowing what it reads, its result
+   * can be cached per object until one of them changes
+   */
+  void addComputed(const char* key, ComputeFunc func, const std::vector<std::string> &dependencies) {
+    insertComputed(key, func, &dependencies);
   }
 
   void addEnums(const std::map<std::string, KSYEnum>& enums) {
@@ -174,6 +235,11 @@ public:
     return m_StaticSize;
   }
 
+  /**
+   * index a dynamic length array to buffer. If scanKey is set, items that were indexed on their own
+   * while the array was unindexed (see DynObject::getListItem) are recorded for that property and
+   * become part of the array instead of being indexed again
+   */
   ObjSize indexEOSArray(const TypeProperty &prop,
                         ObjectIndexTable *indexTable,
                         uint8_t *buffer,
@@ -181,7 +247,8 @@ public:
                         DataStreamId dataStream,
                         std::shared_ptr<IOWrapper> data,
                         std::streampos streamLimit,
-                        std::function<bool(uint8_t*)> repeatCondition);
+                        std::function<bool(uint8_t*)> repeatCondition,
+                        const uint8_t *scanKey = nullptr);
 
   /**
     * index the specified property for this object to the buffer.
@@ -199,10 +266,63 @@ public:
 
   void writeIndex(ObjectIndexTable *index, ObjectIndex *objIndex, std::shared_ptr<IOWrapper> data, const StreamRegistry &streams, DynObject *obj, std::streampos streamLimit);
 
+  /**
+   * true if the extent of objects of this type can be determined from a header of fixed size
+   * followed by a single size-delimited property, without indexing the object
+   */
+  bool hasBoundaries() const {
+    return m_BoundaryProp >= 0;
+  }
+
+  /**
+   * locate consecutive objects of this type from the current position of data up to streamLimit,
+   * reading only the header of each. The start offset of each object gets appended to boundaries.
+   * The scan stops after maxCount objects, data is left positioned after the last one located.
+   * Returns false if the objects can't be located this way or, unless the scan stopped early, don't
+   * end exactly at streamLimit
+   */
+  bool scanBoundaries(ObjectIndexTable *indexTable,
+                      const DynObject *parent,
+                      const StreamRegistry &streams,
+                      DataStreamId dataStream,
+                      std::shared_ptr<IOWrapper> data,
+                      std::streampos streamLimit,
+                      std::vector<DataOffset> &boundaries,
+                      size_t maxCount = std::numeric_limits<size_t>::max());
+
+  /**
+   * true if objects of this type can be indexed with a single read using the precompiled layout
+   */
+  bool hasStaticLayout() const {
+    return (m_StaticSize >= 0) && m_LayoutValid;
+  }
+
+  struct StaticField {
+    uint32_t typeId;
+    // offset of the field relative to the start of the object in the data stream
+    uint32_t dataOffset;
+  };
+
+  /**
+   * location of a property within the raw data of an object with static layout.
+   * Returns nullptr if the type has no static layout or no such property
+   */
+  const StaticField *staticField(const char *key) const;
+
   const std::vector<TypeProperty> &getProperties() const {
     return m_Sequence;
   }
 
+  const std::vector<TypeProperty> &getParameters() const {
+    return m_Params;
+  }
+
+  /**
+   * properties whose size, count, condition or type depend on the specified property of the same
+   * object, these need to be indexed again if it changes
+   */
+  std::vector<std::string> getDependents(const char *key) const;
+
   const TypeProperty& getProperty(const char* key) const {
     auto iter = m_SequenceIdx.find(key);
     if (iter == m_SequenceIdx.end()) {
@@ -220,14 +340,50 @@ public:
     return iter->second;
   }
 
+  /**
+   * value of a key in one of the enums of this type, nullopt if this type doesn't define it
+   */
+  std::optional<int32_t> enumValue(const std::string &enumName, const std::string &key) const {
+    auto iter = m_Enums.find(enumName);
+    if (iter != m_Enums.end()) {
+      for (const auto &value : iter->second) {
+        if (value.second == key) {
+          return value.first;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  struct Computed {
+    ComputeFunc func;
+    std::vector<std::string> dependencies;
+    // position among the computed properties of this type
+    uint32_t num;
+    // the result can be cached, that requires the dependencies to be known
+    bool cacheable;
+    // the result only depends on properties of the same object
+    bool isLocal;
+  };
+
   bool hasComputed(const char* key) const {
     return m_Computed.find(key) != m_Computed.end();
   }
 
+  const Computed &getComputed(const char* key) const {
+    return m_Computed.at(key);
+  }
+
   std::any compute(const char* key, const IScriptQuery* obj) const {
-    return m_Computed.at(key)(*obj);
+    return m_Computed.at(key).func(*obj);
   }
 
+  /**
+   * numbers of the cacheable computed properties that depend, directly or through other computed
+   * properties, on the specified property of the same object
+   */
+  std::vector<uint32_t> getComputedDependents(const char *key) const;
+
   std::tuple<uint32_t, size_t> get(ObjectIndex *objIndex, const char *key) const;
   std::tuple<uint32_t, size_t, std::vector<std::string>, bool> getWithArgs(ObjectIndex *objIndex, const char *key) const;
 
@@ -238,6 +394,12 @@ public:
   std::vector<TypeProperty>::const_iterator paramByKey(const char* key, int* offset) const;
   std::vector<TypeProperty>::const_iterator propertyByKey(ObjectIndex *objIndex, const char *key, int *offset = nullptr) const;
 
+  /**
+   * position of a property in the sequence (which is also its bit in the bitmask) and, through
+   * offset, of its value in the index. Returns -1 if there is no such property
+   */
+  int propertyIndex(const char *key, int *offset) const;
+
   uint32_t getId() const {
     return m_Id;
   }
@@ -246,6 +408,32 @@ public:
     return m_Name;
   }
 
+  /**
+   * size of a numerical value that gets copied to the index verbatim (save for byte order),
+   * 0 for any other type. Lists of these types can be read in bulk
+   */
+  static size_t plainNumberSize(uint32_t type) {
+    switch (type) {
+      case TypeId::int8:
+      case TypeId::uint8: return 1;
+      case TypeId::int16:
+      case TypeId::uint16:
+      case TypeId::int16be:
+      case TypeId::uint16be: return 2;
+      case TypeId::int32:
+      case TypeId::uint32:
+      case TypeId::float32_iee754:
+      case TypeId::int32be:
+      case TypeId::uint32be:
+      case TypeId::float32be: return 4;
+      case TypeId::int64:
+      case TypeId::uint64:
+      case TypeId::int64be:
+      case TypeId::uint64be: return 8;
+      default: return 0;
+    }
+  }
+
 private:
 
   /*
@@ -289,6 +477,14 @@ private:
       case TypeId::uint64: return sizeof(uint64_t);
       case TypeId::bits: return sizeof(uint64_t);
       case TypeId::float32_iee754: return sizeof(float);
+      // big endian values are stored swapped to native order
+      case TypeId::int16be: return sizeof(int16_t);
+      case TypeId::int32be: return sizeof(int32_t);
+      case TypeId::int64be: return sizeof(int64_t);
+      case TypeId::uint16be: return sizeof(uint16_t);
+      case TypeId::uint32be: return sizeof(uint32_t);
+      case TypeId::uint64be: return sizeof(uint64_t);
+      case TypeId::float32be: return sizeof(float);
       // string stored as offset in the data stream from the beginning of the object
       case TypeId::stringz: return sizeof(int32_t);
       // string stored as offset in the data stream and its size
@@ -299,42 +495,78 @@ private:
     throw std::runtime_error("invalid type id");
   }
 
+  /**
+   * extend the static layout by the specified property which has to have a static size,
+   * located at dataOffset in the data stream (relative to the object start) and indexOffset in the
+   * property buffer
+   */
+  void appendLayout(const TypeProperty &prop, int32_t dataOffset, uint32_t indexOffset);
+
+  void writeStaticIndex(ObjectIndexTable *indexTable, ObjectIndex *objIndex, std::shared_ptr<IOWrapper> data);
+
+  /**
+   * track whether objects of this type still consist of a fixed size header, a single
+   * size-delimited property and a fixed size trailer after appending prop
+   */
+  void appendBoundary(const TypeProperty &prop);
+
+  void insertComputed(const char *key, ComputeFunc func, const std::vector<std::string> *dependencies);
+
+  /**
+   * index an eos array of objects with boundaries on the thread pool of the registry.
+   * Items already located in scan don't get scanned again.
+   * Returns false without having indexed anything if that isn't possible, in which case the
+   * array has to be indexed sequentially
+   */
+  bool indexEOSArrayParallel(const TypeProperty &prop,
+                             ObjectIndexTable *indexTable,
+                             uint8_t *buffer,
+                             const DynObject *obj,
+                             DataStreamId dataStream,
+                             std::shared_ptr<IOWrapper> data,
+                             std::streampos streamLimit,
+                             const ObjectIndexTable::ItemScan &scan);
+
+  // size of a value of the specified type if it's always the same, -1 otherwise
+  int32_t staticSize(uint32_t typeId) const {
+    if (typeId == TypeId::bits) {
+      return -1;
+    }
+
+    if (typeId < TypeId::custom) {
+      return indexSize(typeId);
+    }
+
+    return m_Registry->getById(typeId)->getStaticSize();
+  }
+
   void addStaticSize(uint32_t typeId) {
     if (m_StaticSize < 0) {
       // the size can already not be determined statically
       return;
     }
 
-    if (typeId == TypeId::bits) {
+    int32_t size = staticSize(typeId);
+    if (size < 0) {
       m_StaticSize = -1;
-      return;
-    }
-
-    if (typeId < TypeId::custom) {
-      m_StaticSize += indexSize(typeId);
     }
     else {
-      int32_t size = m_Registry->getById(typeId)->getStaticSize();
-      if (size < 0) {
-        m_StaticSize = -1;
-      }
-      else {
-        m_StaticSize += size;
-      }
-      LOG_F("obj size {0} - {1} now {2}", typeId, size, m_StaticSize);
+      m_StaticSize += size;
     }
+    LOG_F("obj size {0} - {1} now {2}", typeId, size, m_StaticSize);
   }
 
+  // offset of the bit reader while indexing bit fields, part of the context of the parse obj
+  // belongs to
+  uint32_t &bitmaskOffset(const DynObject *obj) const;
+
   uint8_t *indexCustom(const TypeProperty &prop, uint32_t typeId,
     const StreamRegistry &streams,
     ObjectIndexTable *indexTable,
     uint8_t *index, const DynObject *obj,
     DataStreamId dataStream, std::shared_ptr<IOWrapper> data, std::streampos streamLimit);
 
-  auto makeIndexFunc(const TypeProperty &prop,
-                     const StreamRegistry &streams,
-                     ObjectIndexTable *index)
-                     -> IndexFunc;
+  auto makeIndexFunc(const TypeProperty &prop) -> IndexFunc;
 
   std::function<std::tuple<uint32_t, int, int>(ObjectIndex*)> getPorPImpl(const char* key) const;
   std::function<std::vector<TypeProperty>::const_iterator(ObjectIndex*)> propertyByKeyFunc(const char* key, int* offset) const;
@@ -347,16 +579,46 @@ private:
   std::map<std::string, int> m_ParamIdx;
   std::vector<TypeProperty> m_Sequence;
   std::map<std::string, int> m_SequenceIdx;
-  std::map<std::string, ComputeFunc> m_Computed;
+  std::map<std::string, Computed> m_Computed;
   std::map<std::string, KSYEnum> m_Enums;
-  mutable std::unordered_map<std::string, std::function<std::tuple<uint32_t, int, int>(ObjectIndex*)>> m_PoPCache;
+  // property or parameter lookup by key, filled in as they get appended
+  std::unordered_map<std::string, std::function<std::tuple<uint32_t, int, int>(ObjectIndex*)>> m_PoPIndex;
   uint16_t m_IndexSize{0};
+  // position of each property in the property index. Every property has a slot of its own,
+  // whether it's present in an object or not, so the position doesn't depend on the object
+  std::vector<uint16_t> m_SlotOffsets;
   uint32_t m_Id;
   int32_t m_StaticSize;
 
-  uint32_t m_BitmaskOffset{0};
-
-  uint8_t m_BaseBuffer[8 * NUM_STATIC_PROPERTIES];
+  // precompiled layout for types of static size. Each step moves one run of fields from the raw
+  // object data to the property buffer
+  struct LayoutStep {
+    enum Kind : uint8_t {
+      // numbers in native byte order, copied verbatim
+      COPY,
+      // big endian numbers, all of the same width
+      SWAP,
+      // nested object of static size, stored as its (unindexed) data offset
+      OBJECT,
+    };
+    Kind kind;
+    uint8_t width;
+    uint32_t dataOffset;
+    uint32_t indexOffset;
+    uint32_t size;
+  };
+  std::vector<LayoutStep> m_Layout;
+  std::map<std::string, StaticField> m_StaticFields;
+  bool m_LayoutValid{true};
+  // properties whose condition is statically false
+  std::vector<int> m_AbsentProps;
+
+  static const int BOUNDARY_NONE = -1;
+  static const int BOUNDARY_INVALID = -2;
+  // index of the size-delimited property that determines the extent of objects of this type
+  int m_BoundaryProp{BOUNDARY_NONE};
+  // size of the fixed size properties following the boundary property
+  int32_t m_TrailerSize{0};
 
 };
 
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+// the shuffle kernel is compiled for ssse3 regardless of the target flags of the build and only
+// used if the cpu supports it
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PAGAN_SSSE3_TARGET
+#else
+#define PAGAN_SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+#define PAGAN_SIMD_BSWAP
+#endif
+
+/**
+ * byte order helpers.
+ * The index always stores numerical values in native (little endian) byte order, values of the
+ * big endian types get swapped while they are read from and written back to the data stream.
+ */
+
+inline uint16_t byteswap16(uint16_t value) {
+#ifdef _MSC_VER
+  return _byteswap_ushort(value);
+#else
+  return __builtin_bswap16(value);
+#endif
+}
+
+inline uint32_t byteswap32(uint32_t value) {
+#ifdef _MSC_VER
+  return _byteswap_ulong(value);
+#else
+  return __builtin_bswap32(value);
+#endif
+}
+
+inline uint64_t byteswap64(uint64_t value) {
+#ifdef _MSC_VER
+  return _byteswap_uint64(value);
+#else
+  return __builtin_bswap64(value);
+#endif
+}
+
+// swap the bytes of a single value of the specified width in-place
+inline void swapBytesInPlace(char *data, size_t width) {
+  switch (width) {
+    case 2: {
+      uint16_t val;
+      memcpy(&val, data, 2);
+      val = byteswap16(val);
+      memcpy(data, &val, 2);
+    } break;
+    case 4: {
+      uint32_t val;
+      memcpy(&val, data, 4);
+      val = byteswap32(val);
+      memcpy(data, &val, 4);
+    } break;
+    case 8: {
+      uint64_t val;
+      memcpy(&val, data, 8);
+      val = byteswap64(val);
+      memcpy(data, &val, 8);
+    } break;
+  }
+}
+
+template <typename T>
+T swapBytes(T value) {
+  swapBytesInPlace(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+
+template <typename T, T (*Swap)(T)>
+void swapBytesLoop(uint8_t *data, size_t offset, size_t count) {
+  for (size_t idx = offset; idx < count; ++idx) {
+    T val;
+    memcpy(&val, data + idx * sizeof(T), sizeof(T));
+    val = Swap(val);
+    memcpy(data + idx * sizeof(T), &val, sizeof(T));
+  }
+}
+
+// swap the bytes of the items from offset to count one at a time
+inline void swapBytesArrayScalar(uint8_t *data, size_t offset, size_t count, size_t width) {
+  switch (width) {
+    case 2: swapBytesLoop<uint16_t, byteswap16>(data, offset, count); break;
+    case 4: swapBytesLoop<uint32_t, byteswap32>(data, offset, count); break;
+    case 8: swapBytesLoop<uint64_t, byteswap64>(data, offset, count); break;
+  }
+}
+
+/**
+ * whether swapBytesArraySIMD can be used on this cpu
+ */
+inline bool hasSIMDByteSwap() {
+#if !defined(PAGAN_SIMD_BSWAP)
+  return false;
+#elif defined(_MSC_VER)
+  static const bool res = []() {
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+  }();
+  return res;
+#else
+  static const bool res = __builtin_cpu_supports("ssse3");
+  return res;
+#endif
+}
+
+#ifdef PAGAN_SIMD_BSWAP
+/**
+ * swap the bytes of the items of the array 16 bytes at a time. Returns the number of items
+ * processed, the remainder (less than 16 bytes) is left to the caller.
+ * Only call this if hasSIMDByteSwap() is true
+ */
+PAGAN_SSSE3_TARGET inline size_t swapBytesArraySIMD(uint8_t *data, size_t count, size_t width) {
+  __m128i mask;
+  switch (width) {
+    case 2: mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14); break;
+    case 4: mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12); break;
+    case 8: mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8); break;
+    default: return 0;
+  }
+
+  size_t perVector = 16 / width;
+  size_t idx = 0;
+  for (; idx + perVector <= count; idx += perVector) {
+    __m128i *pos = reinterpret_cast<__m128i*>(data + idx * width);
+    _mm_storeu_si128(pos, _mm_shuffle_epi8(_mm_loadu_si128(pos), mask));
+  }
+  return idx;
+}
+#endif
+
+/**
+ * swap the bytes of all items in an array of count values, each width bytes large.
+ * This is used when bulk-reading lists of big endian numbers, on cpus with SSSE3 this swaps
+ * 16 bytes per instruction
+ */
+inline void swapBytesArray(uint8_t *data, size_t count, size_t width) {
+  size_t idx = 0;
+#ifdef PAGAN_SIMD_BSWAP
+  if (hasSIMDByteSwap()) {
+    idx = swapBytesArraySIMD(data, count, width);
+  }
+#endif
+  swapBytesArrayScalar(data, idx, count, width);
+}
@@ -2,3 +2,9 @@
 
 static const int COUNT_EOS = -2;
 static const int COUNT_MORE = -3;
+
+// number of items between two checkpoints recorded while locating items in unindexed arrays
+static const int CHECKPOINT_INTERVAL = 64;
+
+// minimum number of items in an eos array for it to be indexed on the thread pool
+static const int PARALLEL_INDEX_MIN_ITEMS = 128;
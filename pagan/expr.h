@@ -8,16 +8,16 @@
 #include <functional>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <vector>
 
+#include "ExpressionProgram.h"
 #include "IScriptQuery.h"
 #include "flexi_cast.h"
 #include "format.h"
 
 namespace pegtl = tao::TAO_PEGTL_NAMESPACE;
 
-typedef std::function<std::any(const std::any& args)> AnyFunc;
-
 /* This does not work correctly for some reason, Expression are not replaced by Infix nodes
 struct MyNode : public pegtl::parse_tree::node {
   template< typename Rule, typename Input, typename... States >
@@ -197,7 +197,7 @@ namespace ExpressionSpec {
     Operators()
     {
       // TODO: The functions here aren't currently used, this code is only used to parse the operations into a tree, the evaluation happens
-      //   in evalNode
+      //   in ExpressionProgram
       insert("*", Order(5), [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) * flexi_cast<int64_t>(rhs); });
       insert("/", Order(5), [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) / flexi_cast<int64_t>(rhs); });
       insert("%", Order(5), [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) % flexi_cast<int64_t>(rhs); });
@@ -300,11 +300,14 @@ namespace ExpressionSpec {
   struct HexNumber : seq<one<'0'>, one<'x'>, plus<xdigit>> {};
   struct String : sor<seq<one<'"'>, star<not_one<'"'>>, one<'"'>>, seq<one<'\''>, star<not_one<'\''>>, one<'\''>>> {};
   struct Identifier : seq<sor<alpha, one<'_'>>, star<sor<alnum, one<'.'>, one<'_'>>>> {};
+  struct EnumName : seq<sor<alpha, one<'_'>>, star<sor<alnum, one<'_'>>>> {};
+  // enum_name::key, optionally prefixed by the type defining the enum
+  struct EnumLiteral : seq<EnumName, plus<seq<one<':'>, one<':'>, EnumName>>> {};
   struct Expression;
   struct Function;
   struct Not;
   struct Bracket : if_must<one<'('>, star<Ignored>, Expression, star<Ignored>, one<')'>> {};
-  struct Atomic : sor<HexNumber, Not, Number, String, Function, Identifier, Bracket> {};
+  struct Atomic : sor<HexNumber, Not, Number, String, Function, EnumLiteral, Identifier, Bracket> {};
   struct Not : seq<sor<istring<'n', 'o', 't', ' '>, one<'!'>>, Atomic> {};
   struct Assignment : seq<Identifier, star<Ignored>, one<'='>, star<Ignored>, Expression> {};
   struct Function : seq<Identifier, one<'('>, Atomic, one<')'>> {};
@@ -386,7 +389,7 @@ namespace ExpressionSpec {
   template <typename Rule>
   using Selector = pegtl::parse_tree::selector<
     Rule,
-    pegtl::parse_tree::apply_store_content::to<Number, Not, HexNumber, String, Identifier, Function, Infix>,
+    pegtl::parse_tree::apply_store_content::to<Number, Not, HexNumber, String, EnumLiteral, Identifier, Function, Infix>,
     pegtl::parse_tree::apply_remove_content::to<>,
     pegtl::parse_tree::apply<Rearrange>::to<Expression>
   >;
@@ -411,230 +414,92 @@ static void printNode(const MyNode &node, const std::string &indent = "") {
   }
 }
 
-static std::map<std::string, std::function<std::any(const std::any&, const std::any&)>> operators = {
-  { "*", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) * flexi_cast<int64_t>(rhs); } },
-  { "/", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) / flexi_cast<int64_t>(rhs); }},
-  { "%", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) % flexi_cast<int64_t>(rhs); }},
-  { "+", [](const std::any &lhs, const std::any &rhs) -> std::any {
-    // script language supports + for string concatenation
-    if (lhs.type() == typeid(std::string)) {
-      return flexi_cast<std::string>(lhs) + flexi_cast<std::string>(rhs);
-    }
-    else {
-      return flexi_cast<int64_t>(lhs) + flexi_cast<int64_t>(rhs);
-    }
-  }},
-  { "-", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) - flexi_cast<int64_t>(rhs); }},
-  { "<<", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) << flexi_cast<int64_t>(rhs); }},
-  { ">>", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) >> flexi_cast<int64_t>(rhs); }},
-  { "<", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) < flexi_cast<int64_t>(rhs); }},
-  { ">", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) > flexi_cast<int64_t>(rhs); }},
-  { "<=", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) <= flexi_cast<int64_t>(rhs); }},
-  { ">=", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) >= flexi_cast<int64_t>(rhs); }},
-  { "==", [](const std::any &lhs, const std::any &rhs) { return any_equal(lhs, rhs); }},
-  { "!=", [](const std::any &lhs, const std::any &rhs) { return !any_equal(lhs, rhs); }},
-  { "&", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) & flexi_cast<int64_t>(rhs); }},
-  { "^", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) ^ flexi_cast<int64_t>(rhs); }},
-  { "|", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<int64_t>(lhs) | flexi_cast<int64_t>(rhs); }},
-  { "&&", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<bool>(lhs) && flexi_cast<bool>(rhs); }},
-  { "and", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<bool>(lhs) && flexi_cast<bool>(rhs); }},
-  { "||", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<bool>(lhs) || flexi_cast<bool>(rhs); }},
-  { "or", [](const std::any &lhs, const std::any &rhs) { return flexi_cast<bool>(lhs) || flexi_cast<bool>(rhs); }},
-  { "?", [](const std::any& lhs, const std::any& rhs) -> std::any { throw std::runtime_error("ternary operation should be handled directly"); }},
-  { ":", [](const std::any& lhs, const std::any& rhs) -> std::any { throw std::runtime_error("ternary operation should be handled directly"); }},
-};
-
-
-static std::any evalNode(const MyNode& node, const ExpressionSpec::VariableResolver& resolver, const ExpressionSpec::VariableAssigner& assigner, std::map<std::pair<uint64_t, uint64_t>, std::string> &identifiers) {
-  if (node.is_root()) {
-    std::any res = evalNode(**node.children.rbegin(), resolver, assigner, identifiers);
-    if (node.children.size() == 2) {
-      std::any varAny = evalNode(*node.children.front(), [](const std::string& key, uint64_t id) { return key; }, assigner, identifiers);
-      std::string var = flexi_cast<std::string>(varAny);
-      assigner(var, res);
-    }
-
-    return res;
-  }
-
-  if (node.is<ExpressionSpec::Expression>()) {
-    throw std::runtime_error("unresolved expression");
-  }
-
-  std::pair<uint64_t, uint64_t> idKey(node.begin().byte, node.end().byte);
-  auto id = identifiers.find(idKey);
-  if (id == identifiers.end()) {
-    identifiers[idKey] = node.content();
-    id = identifiers.find(idKey);
-  }
-
-  if (node.is<ExpressionSpec::Infix>()) {
-    const auto& iter = operators.find(id->second);
-    if (iter->first == ":") {
-      // infix operator. first node contains the expression ? true-value part
-      std::any lhs = evalNode(*(node.children.at(0)), resolver, assigner, identifiers);
-      if (lhs.has_value()) {
-        return lhs;
-      } else {
-        return evalNode(*(node.children.at(1)), resolver, assigner, identifiers);
-      }
-    }
-    else if (iter->first == "?") {
-      std::any cond = evalNode(*(node.children.at(0)), resolver, assigner, identifiers);
-      if (std::any_cast<bool>(cond)) {
-        return evalNode(*(node.children.at(1)), resolver, assigner, identifiers);
-      }
-      else {
-        return std::any();
-      }
-    }
+std::vector<std::string> splitVariable(const std::string &input);
 
-    std::any lhs = evalNode(*(node.children.at(0)), resolver, assigner, identifiers);
-    std::any rhs = evalNode(*(node.children.at(1)), resolver, assigner, identifiers);
+/**
+ * translate the parse tree of an expression to a program. Setters (isMutable) can refer to the
+ * value being assigned and to functions. Enum literals are resolved through enums, without it
+ * they are an error
+ */
+std::shared_ptr<const ExpressionProgram> compileExpression(const MyNode &tree, bool isMutable, const EnumResolver &enums = EnumResolver());
+
+/**
+ * parse and compile an expression
+ */
+std::shared_ptr<const ExpressionProgram> compileExpression(const std::string &code, bool isMutable = false, const EnumResolver &enums = EnumResolver());
+
+/**
+ * dotted identifiers an expression refers to, in order of appearance. The expression is only
+ * parsed, not compiled
+ */
+std::vector<std::string> expressionReferences(const std::string &code);
+
+/**
+ * the value of the expression if it doesn't depend on the object it gets evaluated on
+ */
+std::optional<ScriptValue> evaluateStatic(const std::string &code);
+
+/**
+ * function evaluating an already compiled read-only expression
+ */
+template <typename T>
+std::function<T(const IScriptQuery &)> makeFunc(const std::shared_ptr<const ExpressionProgram> &program) {
+  const ScriptValue *constant = program->constant();
+  if (constant != nullptr) {
     try {
-      return (iter->second)(lhs, rhs);
+      T value = constant->template as<T>();
+      return [value](const IScriptQuery &) -> T { return value; };
     }
-    catch (const std::exception &err) {
-      throw;
+    catch (const std::exception&) {
+      // not convertible, leave it to the program to report that when it's called
     }
-  } else if (node.is<ExpressionSpec::Function>()) {
-    std::any arg = evalNode(*(node.children.at(1)), resolver, assigner, identifiers);
-    AnyFunc func = std::any_cast<AnyFunc>(evalNode(*(node.children.at(0)), resolver, assigner, identifiers));
-    return func(arg);
-  } else if (node.is<ExpressionSpec::Identifier>()) {
-    return resolver(id->second, reinterpret_cast<uint64_t>(node.m_begin.data));
-  } else if (node.is<ExpressionSpec::HexNumber>()) {
-    return strtol(id->second.c_str(), nullptr, 16);
-  } else if (node.is<ExpressionSpec::Number>()) {
-    return strtol(id->second.c_str(), nullptr, 10);
-  } else if (node.is<ExpressionSpec::String>()) {
-    return std::string(node.m_begin.data + 1, node.m_end.data - 1);
-  } else if (node.is<ExpressionSpec::Not>()) {
-    std::any result = evalNode(*(node.children.at(0)), resolver, assigner, identifiers);
-    return !std::any_cast<bool>(result);
-  } else {
-    return node.content();
   }
-}
-
-std::vector<std::string> splitVariable(const std::string &input);
-
-template <typename T>
-std::function<T(const IScriptQuery &)> makeFuncImpl(const std::string &code) {
-  ExpressionSpec::Operators operators;
-  // TODO these are raw pointers that will never get cleaned. Since they are required in the
-  // function we return, to clean up we'd have to wrap std::function I think, which probably isn't
-  // worth it since we don't expect the function to be cleaned until the process ends
-  pegtl::string_input<> *expressionString = new pegtl::string_input<>(code, "source");
-  auto tree =
-    pegtl::parse_tree::parse<ExpressionSpec::Grammar, MyNode, ExpressionSpec::Selector>(*expressionString, operators).release();
-
-  std::map<uint64_t, std::vector<std::string>> variables;
-  std::map<std::pair<uint64_t, uint64_t>, std::string> identifiers;
-
-  return [&code, tree, variables, identifiers](const IScriptQuery &obj) mutable -> T {
-    ExpressionSpec::VariableResolver resolver = [&code, &obj, &variables](const std::string &key, uint64_t id) -> std::any {
-      auto varIter = variables.find(id);
-      if (varIter == variables.end()) {
-        variables.insert(std::pair<uint64_t, std::vector<std::string>>(id, splitVariable(key)));
-        // variables[id] = splitVariable(key);
-        varIter = variables.find(id);
-        // varIter = variables.insert(std::make_pair(id, splitVariable(key))).first;
-      }
-      // ObjectIndex *idx = obj.getIndex();
-      return obj.getAny(varIter->second.begin(), varIter->second.end());
-    };
 
-    ExpressionSpec::VariableAssigner assigner = [&obj, &variables](const std::string &key, const std::any &value) {
+  return [program](const IScriptQuery &obj) -> T {
+    if (!program->assignTo().empty()) {
       throw std::runtime_error("attempt to assign in read-only function");
-    };
-
-    std::any res = evalNode(*tree, resolver, assigner, identifiers);
-    return flexi_cast<T>(res);
+    }
+    return program->run(obj).template as<T>();
   };
 }
 
+/**
+ * function evaluating an already compiled setter
+ */
 template <typename T>
-std::function<T(IScriptQuery &, const std::any&)> makeFuncMutableImpl(const std::string &code) {
-  ExpressionSpec::Operators operators;
-  // TODO these are raw pointers that will never get cleaned. Since they are required in the
-  // function we return, to clean up we'd have to wrap std::function I think, which probably isn't
-  // worth it since we don't expect the function to be cleaned until the process ends
-  pegtl::string_input<> *expressionString = new pegtl::string_input<>(code, "source");
-  auto tree =
-    pegtl::parse_tree::parse<ExpressionSpec::Grammar, MyNode, ExpressionSpec::Selector>(*expressionString, operators).release();
-
-  // printNode(*tree);
-
-  static std::map<std::string, AnyFunc> functions = {
-    { "length", [](const std::any& args) {
-      try {
-        return std::any_cast<std::string>(args).length();
-      } catch (const std::bad_any_cast&) {
-        return std::any_cast<std::vector<uint8_t>>(args).size();
-      }
-    } },
-    { "size", [](const std::any& args) {
-      return flexi_cast<std::string>(args).length() + 1;
-    } },
-  };
-
-  std::map<uint64_t, std::vector<std::string>> variables;
-  std::map<std::pair<uint64_t, uint64_t>, std::string> identifiers;
-
-  return [code, tree, variables, identifiers](IScriptQuery &obj, const std::any& value) mutable -> T {
-    ExpressionSpec::VariableResolver resolver = [&code, &obj, &variables, &value](const std::string &key, uint64_t id) -> std::any {
-      if (key == "value") {
-        return value;
-      }
-
-      auto funcIter = functions.find(key);
-      if (funcIter != functions.end()) {
-        return funcIter->second;
-      }
-
-      auto varIter = variables.find(id);
-      if (varIter == variables.end()) {
-        variables.insert(std::pair<uint64_t, std::vector<std::string>>(id, splitVariable(key)));
-        // variables[id] = splitVariable(key);
-        varIter = variables.find(id);
-        // varIter = variables.insert(std::make_pair(id, splitVariable(key))).first;
-      }
-      // ObjectIndex *idx = obj.getIndex();
-      return obj.getAny(varIter->second.begin(), varIter->second.end());
-    };
-
-    ExpressionSpec::VariableAssigner assigner = [&obj, &variables](const std::string &key, const std::any &value) {
-      std::vector<std::string> keySegments = splitVariable(key);
-      // ObjectIndex *idx = obj.getIndex();
-      return obj.setAny(keySegments.begin(), keySegments.end(), value);
-    };
-
-    std::any res = evalNode(*tree, resolver, assigner, identifiers);
-    return flexi_cast<T>(res);
+std::function<T(IScriptQuery &, const std::any&)> makeFuncMutable(const std::shared_ptr<const ExpressionProgram> &program) {
+  return [program](IScriptQuery &obj, const std::any& value) -> T {
+    ScriptValue res = program->run(obj, &value);
+    const std::vector<std::string> &assignTo = program->assignTo();
+    if (!assignTo.empty()) {
+      obj.setAny(assignTo.begin(), assignTo.end(), res.toAny());
+    }
+    return res.template as<T>();
   };
 }
 
 template <typename T>
-inline std::function<T(const IScriptQuery &)> makeFunc(const std::string &code) {
-  try {
-    return makeFuncImpl<T>(code);
-  }
-  catch (const std::exception& e) {
-    throw std::runtime_error(fmt::format("failed to compile function \"{}\": {}", code, e.what()).c_str());
+std::function<T(const IScriptQuery &)> makeFuncImpl(const std::string &code, std::vector<std::string> *dependencies) {
+  std::shared_ptr<const ExpressionProgram> program = compileExpression(code, false);
+  if (dependencies != nullptr) {
+    *dependencies = program->dependencies();
   }
+  return makeFunc<T>(program);
 }
 
-template <>
-inline std::function<int32_t(const IScriptQuery &)> makeFunc(const std::string &code) {
-  char *endPtr = nullptr;
-  long num = std::strtol(code.c_str(), &endPtr, 10);
-  if (*endPtr == '\0') {
-    return [num](const IScriptQuery &) -> int32_t { return num; };
-  }
+template <typename T>
+std::function<T(IScriptQuery &, const std::any&)> makeFuncMutableImpl(const std::string &code) {
+  return makeFuncMutable<T>(compileExpression(code, true));
+}
 
+/**
+ * compile a read-only expression. If dependencies is set it receives the properties the
+ * expression reads
+ */
+template <typename T>
+inline std::function<T(const IScriptQuery &)> makeFunc(const std::string &code, std::vector<std::string> *dependencies = nullptr) {
   try {
-    return makeFuncImpl<int32_t>(code);
+    return makeFuncImpl<T>(code, dependencies);
   }
   catch (const std::exception& e) {
     throw std::runtime_error(fmt::format("failed to compile function \"{}\": {}", code, e.what()).c_str());
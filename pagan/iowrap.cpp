@@ -2,6 +2,57 @@
 
 static const int FILE_BUFFER_SIZE = 128 * 1024;
 
+/**
+ * read-only stream buffer over memory shared with other readers, each reader keeps its own
+ * position
+ */
+class SharedBuffer : public std::streambuf {
+public:
+  explicit SharedBuffer(std::shared_ptr<const std::string> data)
+    : m_Data(std::move(data))
+  {
+    char *begin = const_cast<char*>(m_Data->data());
+    setg(begin, begin, begin + m_Data->size());
+  }
+
+protected:
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+    if ((which & std::ios_base::in) == 0) {
+      return pos_type(off_type(-1));
+    }
+    off_type base = (dir == std::ios_base::beg) ? 0
+                  : (dir == std::ios_base::cur) ? gptr() - eback()
+                  : egptr() - eback();
+    off_type pos = base + off;
+    if ((pos < 0) || (pos > egptr() - eback())) {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), eback() + pos, egptr());
+    return pos_type(pos);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+private:
+  std::shared_ptr<const std::string> m_Data;
+};
+
+class SharedStream : public std::iostream {
+public:
+  explicit SharedStream(std::shared_ptr<const std::string> data)
+    : std::iostream(nullptr)
+    , m_Buffer(std::move(data))
+  {
+    rdbuf(&m_Buffer);
+  }
+
+private:
+  SharedBuffer m_Buffer;
+};
+
 IOWrapper *IOWrapper::memoryBuffer() {
   return new IOWrapper(new std::stringstream(), -1);
 }
@@ -16,16 +67,38 @@ IOWrapper *IOWrapper::fromFile(const char *filePath, bool out) {
     throw std::runtime_error(fmt::format("failed to open \"{}\"", filePath));
   }
 
-  return new IOWrapper(str, static_cast<int64_t>(fileSize), FILE_BUFFER_SIZE);
+  IOWrapper *res = new IOWrapper(str, static_cast<int64_t>(fileSize), FILE_BUFFER_SIZE);
+  res->m_FilePath = filePath;
+  return res;
+}
+
+IOWrapper *IOWrapper::reader() const {
+  if (!m_FilePath.empty()) {
+    return fromFile(m_FilePath.c_str());
+  }
+
+  std::lock_guard<std::mutex> lock(m_SharedMutex);
+  if (m_Shared == nullptr) {
+    std::stringstream *source = dynamic_cast<std::stringstream*>(m_Stream);
+    if (source == nullptr) {
+      throw std::runtime_error("stream can't be shared");
+    }
+    m_Shared = std::make_shared<const std::string>(source->str());
+  }
+  IOWrapper *res = new IOWrapper(new SharedStream(m_Shared), m_Size);
+  res->m_Shared = m_Shared;
+  return res;
 }
 
 IOWrapper::IOWrapper(const IOWrapper &reference)
   : m_Stream(reference.m_Stream)
+  , m_FilePath(reference.m_FilePath)
   , m_Size(reference.m_Size)
   , m_PosG(reference.m_PosG)
   , m_PosP(reference.m_PosP)
   , m_Buffer(reference.m_Buffer)
   , m_BufferPos(0)
+  , m_Shared(reference.m_Shared)
 {
   const_cast<IOWrapper&>(reference).m_Stream = nullptr;
   const_cast<IOWrapper&>(reference).m_Buffer = nullptr;
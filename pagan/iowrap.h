@@ -5,6 +5,9 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
 
 /**
  * stream-like wrapper around memory sections or files.
@@ -21,6 +24,13 @@ public:
 
   static IOWrapper *fromFile(const char *filePath, bool out = false);
 
+  /**
+   * open an independent read cursor on the same data, for use by another thread.
+   * Files get opened a second time. The content of a memory buffer is copied once and shared by
+   * all its readers, writing to the buffer afterwards isn't visible to existing readers
+   */
+  IOWrapper *reader() const;
+
   IOWrapper() = delete;
   IOWrapper(const IOWrapper &reference);
 
@@ -71,6 +81,10 @@ public:
   }
 
   void write(const char *data, std::streamsize count) {
+    if (m_Shared != nullptr) {
+      // readers opened from now on need to see the change
+      m_Shared.reset();
+    }
     commitSeekP();
     m_Stream->write(data, count);
     m_PosP += count;
@@ -157,6 +171,8 @@ private:
 private:
 
   std::iostream *m_Stream;
+  // empty for memory buffers
+  std::string m_FilePath;
   int64_t m_Size;
   std::streamoff m_PosG { 0 };
   std::streamoff m_PosP { 0 };
@@ -167,5 +183,10 @@ private:
   std::streamoff m_BufferPos;
   char *m_Buffer{ nullptr };
 
+  // content of a memory buffer shared with its readers. Threads may open readers on the same
+  // buffer concurrently, writing still requires exclusive access
+  mutable std::shared_ptr<const std::string> m_Shared;
+  mutable std::mutex m_SharedMutex;
+
 };
 
@@ -1,6 +1,7 @@
 #include "typespec.h"
 #include "typeregistry.h"
 #include "dynobject.h"
+#include "ListView.h"
 #include "streamregistry.h"
 #include "membuf.h"
 #include "parser.h"
@@ -11,7 +12,7 @@
 #include <fstream>
 #include <any>
 #include <memory>
-#include <ctime>
+#include <chrono>
 
 std::function<bool(const DynObject&)> findGRUP(const char *groupName) {
   return [groupName](const DynObject &obj) {
@@ -31,14 +32,16 @@ int main(int argc, char **argv) {
     parser->addFileStream(argv[1]);
 
     std::cout << "create root element" << std::endl;
-    time_t start = time(nullptr);
+    auto start = std::chrono::steady_clock::now();
 
     // create an object
     DynObject obj = parser->getObject(parser->getType("root"), 0);
 
-    std::cout << "parsing done in " << (int)std::difftime(time(nullptr), start) << " seconds" << std::endl;
+    std::cout << "parsing done in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+              << " ms" << std::endl;
 
-    auto recList = obj.getList<DynObject>("root");
+    auto recList = obj.getListView("root");
     std::cout << "# items at root: " << recList.size() << std::endl;
 
     auto tes4 = std::find_if(recList.cbegin(), recList.cend(), [](const DynObject &obj) { return obj.get<std::string>("type") == "TES4"; });
@@ -60,7 +63,7 @@ int main(int argc, char **argv) {
     */
 
     auto armorGroup = std::find_if(recList.cbegin(), recList.cend(), findGRUP("ARMO"));
-    auto armorRecs = armorGroup->get<DynObject>("data").get<DynObject>("records").getList<DynObject>("entries");
+    auto armorRecs = armorGroup->get<DynObject>("data").get<DynObject>("records").getListView("entries");
 
     std::cout << "# armor recs: " << armorRecs.size() << std::endl;
 
@@ -37,7 +37,7 @@ bool isBitSet(const ObjectIndex *index, int bits) {
   return index->bitmask[bits / 8] & (1 << (bits % 8));
 }
 
-ObjectIndex *initIndex(uint8_t *memory, const std::shared_ptr<TypeSpec> type, uint16_t dataStream, uint64_t dataOffset) {
+ObjectIndex *initIndex(uint8_t *memory, const std::shared_ptr<TypeSpec> type, uint16_t dataStream, uint64_t dataOffset, ObjectIndex *parent) {
   ObjectIndex *res = reinterpret_cast<ObjectIndex*>(memory);
 
   uint16_t numProperties = type->getNumProperties();
@@ -50,6 +50,8 @@ ObjectIndex *initIndex(uint8_t *memory, const std::shared_ptr<TypeSpec> type, ui
   res->dataStream = dataStream;
   res->dataOffset = dataOffset;
   res->properties = nullptr;
+  res->parent = parent;
+  res->root = (parent == nullptr) || (parent->root == nullptr) ? parent : parent->root;
 
   return res;
 }
@@ -10,6 +10,10 @@ struct ObjectIndex
   uint64_t dataOffset;
   // reference to the index of the object properties
   uint8_t *properties;
+  // the object containing this one, null for top-level objects
+  ObjectIndex *parent;
+  // the top-level object this one is part of, null if that's the object itself
+  ObjectIndex *root;
   // specifies the type of object
   uint32_t typeId;
   // specifies which data stream this object is found in
@@ -24,6 +28,6 @@ static const int MIN_OBJECT_INDEX_SIZE = sizeof(ObjectIndex) - 1;
 
 bool isBitSet(const ObjectIndex *index, int bits);
 
-ObjectIndex *initIndex(uint8_t *memory, const std::shared_ptr<TypeSpec> type, uint16_t dataStream, uint64_t dataOffset);
+ObjectIndex *initIndex(uint8_t *memory, const std::shared_ptr<TypeSpec> type, uint16_t dataStream, uint64_t dataOffset, ObjectIndex *parent);
 
 void assignProperies(ObjectIndex *index, uint8_t *buffer, size_t size);
@@ -5,8 +5,10 @@
 #define _NOEXCEPT noexcept
 #endif
 #include <yaml-cpp/yaml.h>
+#include <atomic>
 #include <charconv>
-#include <regex>
+#include <mutex>
+#include <optional>
 
 typedef std::map<std::string, uint32_t> NamedTypes;
 
@@ -48,7 +50,8 @@ std::map<std::string, KSYEnum> enumsFromYAML(const YAML::Node &spec) {
   return result;
 }
 
-std::map<std::variant<std::string, int32_t>, uint32_t> makeCases(const YAML::Node &spec, NamedTypes &types, Parser &parser) {
+std::map<std::variant<std::string, int32_t>, uint32_t> makeCases(const YAML::Node &spec, NamedTypes &types, Parser &parser,
+                                                                 const EnumResolver &enums) {
   if (!spec.IsMap()) {
     throw std::runtime_error("expected a map");
   }
@@ -57,7 +60,19 @@ std::map<std::variant<std::string, int32_t>, uint32_t> makeCases(const YAML::Nod
     std::map<std::variant<std::string, int32_t>, uint32_t> result;
 
     for (YAML::const_iterator it = spec.begin(); it != spec.end(); ++it) {
-      result[it->first.as<int32_t>()] = getNamedType(types, parser, it->second.as<std::string>());
+      std::string key = it->first.as<std::string>();
+      // the default case doesn't stop the other cases from being numbers
+      if (key == "_") {
+        result["_"] = getNamedType(types, parser, it->second.as<std::string>());
+      }
+      else if (key.find("::") != std::string::npos) {
+        // enum literal, the switch value is the integer
+        std::shared_ptr<const ExpressionProgram> program = ExpressionCache::compile(key, false, enums);
+        result[static_cast<int32_t>(program->constant()->toInteger())] = getNamedType(types, parser, it->second.as<std::string>());
+      }
+      else {
+        result[it->first.as<int32_t>()] = getNamedType(types, parser, it->second.as<std::string>());
+      }
     }
 
     return result;
@@ -77,18 +92,143 @@ std::map<std::variant<std::string, int32_t>, uint32_t> makeCases(const YAML::Nod
   }
 }
 
-std::string trimRight(const std::string& input) {
-  static std::regex expr(R"(\s+$)");
-  return std::regex_replace(input, expr, std::string(""));
+// function that's only created once it's first called
+template <typename Func>
+class LazyFunc {
+public:
+  template <typename Make>
+  const Func &get(const Make &make) {
+    if (!m_Ready.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (!m_Ready.load(std::memory_order_relaxed)) {
+        m_Func = make();
+        m_Ready.store(true, std::memory_order_release);
+      }
+    }
+    return m_Func;
+  }
+
+private:
+  std::atomic<bool> m_Ready{ false };
+  std::mutex m_Mutex;
+  Func m_Func;
+};
+
+/**
+ * resolves the enum literals in expressions of a type through the enums of the type and those
+ * enclosing it
+ */
+EnumResolver enumResolver(Parser &parser, const std::shared_ptr<TypeSpec> &type) {
+  uint32_t scope = type->getId();
+  std::weak_ptr<ExpressionCache> weakCache(parser.expressions());
+  return [scope, weakCache](const std::string &enumName, const std::string &key) -> std::optional<int64_t> {
+    std::shared_ptr<ExpressionCache> cache = weakCache.lock();
+    return (cache != nullptr) ? cache->enumValue(scope, enumName, key) : std::nullopt;
+  };
 }
 
+/**
+ * expression from the spec, compiled once per type it's used in (see ExpressionCache).
+ * Unless the parser precompiles the spec, compilation is deferred until the expression is
+ * first evaluated. Only expressions that don't refer to anything are compiled right away since
+ * they may be constant.
+ * The functions created from it report to the profiler of the parser
+ */
+class KSYExpression {
+public:
+  KSYExpression(Parser &parser, const std::shared_ptr<TypeSpec> &type, const std::string &property,
+                const char *kind, const std::string &code, bool isMutable = false)
+    : m_Cache(parser.expressions())
+    , m_Profiler(parser.profiler())
+    , m_Site(parser.profiler()->addSite(type->getName(), property, kind, code))
+    , m_Scope(type->getId())
+    , m_Enums(enumResolver(parser, type))
+    , m_Code(code)
+    , m_Mutable(isMutable)
+  {
+    if (parser.expressions()->precompile() || ExpressionCache::references(code).empty()) {
+      m_Program = program();
+    }
+  }
+
+  // numeric value of expressions that don't refer to the object, nullopt otherwise
+  std::optional<ScriptValue> staticValue() const {
+    const ScriptValue *res = (m_Program != nullptr) ? m_Program->constant() : nullptr;
+    if ((res != nullptr) && res->isNumber()) {
+      return *res;
+    }
+    return std::nullopt;
+  }
+
+  std::vector<std::string> dependencies() const {
+    return (m_Program != nullptr) ? m_Program->dependencies() : ExpressionCache::references(m_Code);
+  }
+
+  template <typename T>
+  std::function<T(const IScriptQuery &)> func() const {
+    typedef std::function<T(const IScriptQuery &)> Func;
+    if (m_Program != nullptr) {
+      return ExpressionProfiler::instrument(makeFunc<T>(m_Program), m_Profiler, m_Site);
+    }
+    std::shared_ptr<LazyFunc<Func>> lazy = std::make_shared<LazyFunc<Func>>();
+    KSYExpression expression(*this);
+    Func func = [lazy, expression](const IScriptQuery &obj) -> T {
+      return lazy->get([&expression]() { return makeFunc<T>(expression.program()); })(obj);
+    };
+    return ExpressionProfiler::instrument(func, m_Profiler, m_Site);
+  }
+
+  template <typename T>
+  std::function<T(IScriptQuery &, const std::any &)> mutableFunc() const {
+    typedef std::function<T(IScriptQuery &, const std::any &)> Func;
+    if (m_Program != nullptr) {
+      return ExpressionProfiler::instrument(makeFuncMutable<T>(m_Program), m_Profiler, m_Site);
+    }
+    std::shared_ptr<LazyFunc<Func>> lazy = std::make_shared<LazyFunc<Func>>();
+    KSYExpression expression(*this);
+    Func func = [lazy, expression](IScriptQuery &obj, const std::any &value) -> T {
+      return lazy->get([&expression]() { return makeFuncMutable<T>(expression.program()); })(obj, value);
+    };
+    return ExpressionProfiler::instrument(func, m_Profiler, m_Site);
+  }
+
+private:
+
+  std::shared_ptr<const ExpressionProgram> program() const {
+    std::shared_ptr<ExpressionCache> cache = m_Cache.lock();
+    if (cache == nullptr) {
+      // objects can outlive the parser and with it the cache
+      return ExpressionCache::compile(m_Code, m_Mutable, m_Enums);
+    }
+    bool cached;
+    std::shared_ptr<const ExpressionProgram> res = cache->get(m_Code, m_Scope, m_Mutable, &cached, m_Enums);
+    if (cached) {
+      m_Site->shared.store(true, std::memory_order_relaxed);
+    }
+    return res;
+  }
+
+private:
+
+  std::weak_ptr<ExpressionCache> m_Cache;
+  std::shared_ptr<ExpressionProfiler> m_Profiler;
+  std::shared_ptr<ExpressionProfiler::Site> m_Site;
+  uint32_t m_Scope;
+  EnumResolver m_Enums;
+  std::string m_Code;
+  bool m_Mutable;
+  std::shared_ptr<const ExpressionProgram> m_Program;
+};
+
 void addInstances(Parser& parser, std::shared_ptr<TypeSpec> &type, const YAML::Node& spec) {
   if (!spec.IsDefined() || !spec.IsMap()) {
     return;
   }
 
   for (YAML::const_iterator it = spec.begin(); it != spec.end(); ++it) {
-    type->addComputed(it->first.as<std::string>().c_str(), makeFunc<std::any>(trimRight(it->second["value"].as<std::string>())));
+    std::string name = it->first.as<std::string>();
+    KSYExpression value(parser, type, name, "value", it->second["value"].as<std::string>());
+    type->addComputed(name.c_str(), value.func<std::any>(), value.dependencies());
   }
 }
 
@@ -100,6 +240,25 @@ void addEnums(Parser &parser, std::shared_ptr<TypeSpec> &type, const YAML::Node
   type->addEnums(enumsFromYAML(spec));
 }
 
+/**
+ * the enums of a type in front of those of the types enclosing it. This is set up before the
+ * nested types are created so they can refer to the enums of their enclosing types
+ */
+std::shared_ptr<const ExpressionCache::EnumScope> enumScope(const YAML::Node &spec,
+                                                            const std::shared_ptr<const ExpressionCache::EnumScope> &outer) {
+  std::shared_ptr<ExpressionCache::EnumScope> res = std::make_shared<ExpressionCache::EnumScope>();
+  res->outer = outer;
+  if (spec.IsDefined() && spec.IsMap()) {
+    for (const auto &enm : enumsFromYAML(spec)) {
+      std::map<std::string, int64_t> &keys = res->enums[enm.first];
+      for (const auto &value : enm.second) {
+        keys[value.second] = value.first;
+      }
+    }
+  }
+  return res;
+}
+
 uint32_t determineType(Parser &parser, NamedTypes &types, YAML::Node typeNode, uint32_t &fixedSize, std::vector<std::string> &argList) {
   uint32_t typeId;
   if (!typeNode.IsDefined()) {
@@ -183,7 +342,15 @@ void addProperties(Parser &parser, NamedTypes &types, std::shared_ptr<TypeSpec>
 
     TypePropertyBuilder prop = type->appendProperty(name.c_str(), typeId);
     if (entry["size"].IsDefined()) {
-      prop.withSize(makeFunc<ObjSize>(entry["size"].as<std::string>()));
+      KSYExpression size(parser, type, name, "size", entry["size"].as<std::string>());
+      std::optional<ScriptValue> value = size.staticValue();
+      if (value.has_value() && (value->toInteger() >= 0)) {
+        prop.withStaticSize(static_cast<ObjSize>(value->toInteger()));
+      }
+      else {
+        prop.withSize(size.func<ObjSize>());
+        prop.withDependencies(size.dependencies());
+      }
     }
     else if (fixedSize > 0) {
       prop.withSize(makeFunc<ObjSize>(std::to_string(fixedSize)));
@@ -236,7 +403,7 @@ void addProperties(Parser &parser, NamedTypes &types, std::shared_ptr<TypeSpec>
 
       if (!entry["size"].IsDefined()) {
         size_t len = value.size();
-        prop.withSize([len](const IScriptQuery &obj) -> ObjSize { return static_cast<ObjSize>(len); });
+        prop.withStaticSize(static_cast<ObjSize>(len));
       }
       prop.withValidation([value](const std::any &in) {
         try {
@@ -255,10 +422,18 @@ void addProperties(Parser &parser, NamedTypes &types, std::shared_ptr<TypeSpec>
     if (entry["assign"].IsDefined()) {
       // TODO return value is just a workaround since makeFunc is written to require one, we neither expect
       // the cb to return something nor do we make use of the return value
-      prop.onAssign(makeFuncMutable<bool>(entry["assign"].as<std::string>()));
+      prop.onAssign(KSYExpression(parser, type, name, "assign", entry["assign"].as<std::string>(), true).mutableFunc<bool>());
     }
     if (entry["if"].IsDefined()) {
-      prop.withCondition(makeFunc<bool>(entry["if"].as<std::string>()));
+      KSYExpression condition(parser, type, name, "if", entry["if"].as<std::string>());
+      std::optional<ScriptValue> value = condition.staticValue();
+      if (value.has_value()) {
+        prop.withStaticCondition(value->toBool());
+      }
+      else {
+        prop.withCondition(condition.func<bool>());
+        prop.withDependencies(condition.dependencies());
+      }
     }
     if (entry["process"].IsDefined()) {
       prop.withProcessing(entry["process"].as<std::string>());
@@ -269,33 +444,42 @@ void addProperties(Parser &parser, NamedTypes &types, std::shared_ptr<TypeSpec>
         prop.withRepeatToEOS();
       }
       else if (repeatType == "expr") {
-        prop.withCount(makeFunc<int32_t>(entry["repeat-expr"].as<std::string>()));
+        KSYExpression count(parser, type, name, "repeat-expr", entry["repeat-expr"].as<std::string>());
+        prop.withCount(count.func<int32_t>());
+        prop.withDependencies(count.dependencies());
       }
       else if (repeatType == "until") {
-        prop.withRepeatCondition(makeFunc<bool>(entry["repeat-until"].as<std::string>()));
+        KSYExpression until(parser, type, name, "repeat-until", entry["repeat-until"].as<std::string>());
+        prop.withRepeatCondition(until.func<bool>());
+        prop.withDependencies(until.dependencies());
       }
       else {
         throw std::runtime_error("unsupported repeat function");
       }
     }
     if (typeId == TypeId::runtime) {
-      std::map<std::variant<std::string, int32_t>, uint32_t> cases = makeCases(typeNode["cases"], types, parser);
+      std::map<std::variant<std::string, int32_t>, uint32_t> cases = makeCases(typeNode["cases"], types, parser, enumResolver(parser, type));
+      KSYExpression switchOn(parser, type, name, "switch-on", typeNode["switch-on"].as<std::string>());
 
       try {
-        // makeCases either has all keys as strings or all as numbers, so it's enough to check the first
-        int32_t dummy = std::get<int32_t>(cases.begin()->first);
-        prop.withTypeSwitch(makeFunc<int32_t>(typeNode["switch-on"].as<std::string>()), cases);
+        // makeCases either has all keys (except the default) as strings or all as numbers. Strings
+        // sort first so it's enough to check the last
+        int32_t dummy = std::get<int32_t>(cases.rbegin()->first);
+        prop.withTypeSwitch(switchOn.func<int32_t>(), cases);
       }
       catch (const std::bad_variant_access&) {
-        prop.withTypeSwitch(makeFunc<std::string>(typeNode["switch-on"].as<std::string>()), cases);
+        prop.withTypeSwitch(switchOn.func<std::string>(), cases);
       }
+      prop.withDependencies(switchOn.dependencies());
     }
   }
 }
 
-void createTypeFromYAML(Parser &parser, NamedTypes &types, const char *name, const YAML::Node &spec);
+void createTypeFromYAML(Parser &parser, NamedTypes &types, const char *name, const YAML::Node &spec,
+                        const std::shared_ptr<const ExpressionCache::EnumScope> &outerEnums);
 
-void addSubTypes(Parser &parser, NamedTypes &types, const YAML::Node &spec) {
+void addSubTypes(Parser &parser, NamedTypes &types, const YAML::Node &spec,
+                 const std::shared_ptr<const ExpressionCache::EnumScope> &outerEnums) {
   if (!spec.IsDefined()) {
     return;
   }
@@ -305,23 +489,59 @@ void addSubTypes(Parser &parser, NamedTypes &types, const YAML::Node &spec) {
   }
 
   for (YAML::const_iterator it = spec.begin(); it != spec.end(); ++it) {
-    createTypeFromYAML(parser, types, it->first.as<std::string>().c_str(), it->second);
+    createTypeFromYAML(parser, types, it->first.as<std::string>().c_str(), it->second, outerEnums);
   }
 }
 
+// the multi-byte types without explicit byte order suffix, their meaning depends on meta/endian
+static const std::vector<std::string> DEFAULT_ENDIAN_TYPES{ "u2", "u4", "u8", "s2", "s4", "s8", "f4" };
+
+/**
+ * applies the default byte order set in meta/endian of a type by pointing the unsuffixed
+ * type names to the corresponding le/be types.
+ * returns the previous mapping so it can be restored once the type (and its subtypes, which
+ * inherit the setting) are done
+ */
+NamedTypes applyEndian(NamedTypes &types, const YAML::Node &meta) {
+  NamedTypes previous;
+  if (!meta.IsDefined() || !meta["endian"].IsDefined()) {
+    return previous;
+  }
+
+  std::string endian = meta["endian"].as<std::string>();
+  if ((endian != "le") && (endian != "be")) {
+    throw std::runtime_error(fmt::format("unsupported endian \"{}\"", endian));
+  }
+
+  for (const std::string &typeName : DEFAULT_ENDIAN_TYPES) {
+    previous[typeName] = types[typeName];
+    types[typeName] = types[typeName + endian];
+  }
+  return previous;
+}
+
 void createTypeFromYAML(Parser &parser,
                         NamedTypes &types,
                         const char *name,
-                        const YAML::Node &spec) {
-  addSubTypes(parser, types, spec["types"]);
+                        const YAML::Node &spec,
+                        const std::shared_ptr<const ExpressionCache::EnumScope> &outerEnums) {
+  NamedTypes previousEndian = applyEndian(types, spec["meta"]);
+  std::shared_ptr<const ExpressionCache::EnumScope> enums = enumScope(spec["enums"], outerEnums);
+  addSubTypes(parser, types, spec["types"], enums);
   std::shared_ptr<TypeSpec> type = parser.createType(name);
   types[name] = type->getId();
   LOG_F("create type {0} ({1})", name, type->getId());
+  // before any expressions get compiled, those may refer to the enums
+  parser.expressions()->setEnumScope(type->getId(), enums);
+  addEnums(parser, type, spec["enums"]);
   addParams(parser, types, type, spec["params"]);
   LOG_F("add properties {0}", type->getId());
   addProperties(parser, types, type, spec["seq"]);
   addInstances(parser, type, spec["instances"]);
-  addEnums(parser, type, spec["enums"]);
+
+  for (const auto &iter : previousEndian) {
+    types[iter.first] = iter.second;
+  }
 }
 
 void initBaseTypes(NamedTypes &types) {
@@ -336,11 +556,25 @@ void initBaseTypes(NamedTypes &types) {
   types["s4"] = TypeId::int32;
   types["s8"] = TypeId::int64;
   types["f4"] = TypeId::float32;
+  types["u2le"] = TypeId::uint16;
+  types["u4le"] = TypeId::uint32;
+  types["u8le"] = TypeId::uint64;
+  types["s2le"] = TypeId::int16;
+  types["s4le"] = TypeId::int32;
+  types["s8le"] = TypeId::int64;
+  types["f4le"] = TypeId::float32;
+  types["u2be"] = TypeId::uint16be;
+  types["u4be"] = TypeId::uint32be;
+  types["u8be"] = TypeId::uint64be;
+  types["s2be"] = TypeId::int16be;
+  types["s4be"] = TypeId::int32be;
+  types["s8be"] = TypeId::int64be;
+  types["f4be"] = TypeId::float32be;
   types["b*"] = TypeId::bits;
   types["bytes"] = TypeId::bytes;
 }
 
-std::shared_ptr<Parser> parserFromKSY(const char *specFileName) {
+std::shared_ptr<Parser> parserFromKSY(const char *specFileName, bool precompile) {
   std::ifstream specStream(specFileName);
   if (!specStream.is_open()) {
     throw std::runtime_error("failed to open spec file");
@@ -352,11 +586,12 @@ std::shared_ptr<Parser> parserFromKSY(const char *specFileName) {
   }
 
   std::shared_ptr<Parser> parser(new Parser());
+  parser->expressions()->setPrecompile(precompile);
 
   NamedTypes namedTypes;
   initBaseTypes(namedTypes);
 
-  createTypeFromYAML(*parser, namedTypes, "root", spec);
+  createTypeFromYAML(*parser, namedTypes, "root", spec, nullptr);
 
   return parser;
 }
@@ -2,4 +2,9 @@
 
 #include "Parser.h"
 
-std::shared_ptr<Parser> parserFromKSY(const char *specFileName);
+/**
+ * create a parser for the kaitai struct spec. Expressions of the spec are compiled when first
+ * evaluated unless precompile is set, which moves all the compilation (and reporting of errors
+ * in expressions) to the load
+ */
+std::shared_ptr<Parser> parserFromKSY(const char *specFileName, bool precompile = false);
@@ -2,13 +2,14 @@
 #include "util.h"
 #include "format.h"
 #include "dynobject.h"
+#include "byteorder.h"
 #include <iostream>
 #include <cassert>
 #include <windows.h>
 
 #define DEF_TYPE(VAL_TYPE, TYPE_ID) \
 template <> VAL_TYPE type_read(TypeId type, char *index, std::shared_ptr<IOWrapper> &data, std::shared_ptr<IOWrapper> &write, char **indexAfter) { \
-  if (type != TYPE_ID) {\
+  if (nativeType(type) != TYPE_ID) {\
     throw IncompatibleType(fmt::format("Expected {}, got {}", TYPE_ID, type).c_str());\
   }\
   VAL_TYPE result;\
@@ -19,7 +20,7 @@ template <> VAL_TYPE type_read(TypeId type, char *index, std::shared_ptr<IOWrapp
   return result;\
 }\
 template <> char *type_write(TypeId type, char *index, std::shared_ptr<IOWrapper> &write, const VAL_TYPE &value) {\
-  if (type != TYPE_ID) {\
+  if (nativeType(type) != TYPE_ID) {\
     throw IncompatibleType(fmt::format("Expected {}, got {}", TYPE_ID, type).c_str());\
   }\
   memcpy(index, reinterpret_cast<const char*>(&value), sizeof(VAL_TYPE));\
@@ -192,6 +193,13 @@ template <typename T> char *type_index_num(char *index, std::shared_ptr<IOWrappe
   }
 }
 
+// big endian numbers are swapped right away so that the index only ever contains native values
+template <typename T> char *type_index_num_be(char *index, std::shared_ptr<IOWrapper> &data, const std::string &debug) {
+  data->read(index, sizeof(T));
+  swapBytesInPlace(index, sizeof(T));
+  return index + sizeof(T);
+}
+
 char *type_index_obj(char *index, std::shared_ptr<IOWrapper> &data, std::streampos dataPos, ObjSize size, const DynObject *obj) {
   // LogBracket::log(fmt::format("write index obj type {}, data {}, size {}", obj->getTypeId(), offset, size));
   int64_t pos = dataPos;
@@ -284,13 +292,20 @@ char *type_index(TypeId type, const SizeFunc &size, char *index, std::shared_ptr
     case TypeId::stringz: return type_index_impl<std::string>(index, data, size, obj, false, debug);
     case TypeId::string: return type_index_impl<std::string>(index, data, size, obj, true, debug);
     case TypeId::bytes: return type_index_impl<std::vector<uint8_t>>(index, data, size, obj, true, debug);
+    case TypeId::int16be: return type_index_num_be<int16_t>(index, data, debug);
+    case TypeId::int32be: return type_index_num_be<int32_t>(index, data, debug);
+    case TypeId::int64be: return type_index_num_be<int64_t>(index, data, debug);
+    case TypeId::uint16be: return type_index_num_be<uint16_t>(index, data, debug);
+    case TypeId::uint32be: return type_index_num_be<uint32_t>(index, data, debug);
+    case TypeId::uint64be: return type_index_num_be<uint64_t>(index, data, debug);
+    case TypeId::float32be: return type_index_num_be<float>(index, data, debug);
     case TypeId::custom: return type_index_obj(index, data, data->tellg(), size(*obj), obj);
   }
   throw std::runtime_error("invalid type");
 }
 
 std::any type_read_any(TypeId type, char *index, std::shared_ptr<IOWrapper> &data, std::shared_ptr<IOWrapper> &write, char **indexAfter) {
-  switch (type) {
+  switch (nativeType(type)) {
     case TypeId::int8: return type_read<int8_t>(type, index, data, write, indexAfter);
     case TypeId::int16: return type_read<int16_t>(type, index, data, write, indexAfter);
     case TypeId::int32: return type_read<int32_t>(type, index, data, write, indexAfter);
@@ -306,12 +321,14 @@ std::any type_read_any(TypeId type, char *index, std::shared_ptr<IOWrapper> &dat
     case TypeId::bytes: return type_read<std::vector<uint8_t>>(type, index, data, write, indexAfter);
     // case TypeId::custom: return std::shared_ptr<DynObject>(new DynObject(type_read<DynObject>(type, index, data, write)));
     case TypeId::custom: throw std::runtime_error("not implemented");
+    // big endian types were mapped to their native counterpart by nativeType
+    default: break;
   }
   return std::any();
 }
 
 char *type_write_any(TypeId type, char *index, std::shared_ptr<IOWrapper> &write, const std::any &value) {
-  switch (type) {
+  switch (nativeType(type)) {
     case TypeId::int8: return type_write<int8_t>(type, index, write, flexi_cast<int8_t>(value));
     case TypeId::int16: return type_write<int16_t>(type, index, write, flexi_cast<int16_t>(value));
     case TypeId::int32: return type_write<int32_t>(type, index, write, flexi_cast<int32_t>(value));
@@ -348,6 +365,11 @@ void stream_write(std::shared_ptr<IOWrapper> &output, const T &value) {
   output->write(reinterpret_cast<const char*>(&value), sizeof(T));
 }
 
+template <typename T>
+void stream_write_be(std::shared_ptr<IOWrapper> &output, const T &value) {
+  stream_write(output, swapBytes(value));
+}
+
 void type_copy_bytes(std::shared_ptr<IOWrapper> &output, char *index, std::shared_ptr<IOWrapper> &data, std::shared_ptr<IOWrapper> &write, char **indexAfter) {
   int32_t offset;
   memcpy(reinterpret_cast<char*>(&offset), index, sizeof(int32_t));
@@ -407,6 +429,13 @@ void type_copy_any(TypeId type, char *index, std::shared_ptr<IOWrapper> &output,
   case TypeId::string: stream_write_str(output, type_read<std::string>(type, index, data, write, indexAfter)); break;
   // case TypeId::bytes: stream_write_bytes(output, type_read<std::vector<uint8_t>>(type, index, data, write, indexAfter)); break;
   case TypeId::bytes: type_copy_bytes(output, index, data, write, indexAfter); break;
+  case TypeId::int16be: stream_write_be(output, type_read<int16_t>(type, index, data, write, indexAfter)); break;
+  case TypeId::int32be: stream_write_be(output, type_read<int32_t>(type, index, data, write, indexAfter)); break;
+  case TypeId::int64be: stream_write_be(output, type_read<int64_t>(type, index, data, write, indexAfter)); break;
+  case TypeId::uint16be: stream_write_be(output, type_read<uint16_t>(type, index, data, write, indexAfter)); break;
+  case TypeId::uint32be: stream_write_be(output, type_read<uint32_t>(type, index, data, write, indexAfter)); break;
+  case TypeId::uint64be: stream_write_be(output, type_read<uint64_t>(type, index, data, write, indexAfter)); break;
+  case TypeId::float32be: stream_write_be(output, type_read<float>(type, index, data, write, indexAfter)); break;
   case TypeId::custom: throw std::runtime_error("not implemented");
   }
 }
@@ -21,11 +21,38 @@ enum TypeId {
   string,
   stringz,
   bytes,
+  // big endian variants of the numerical types. The index stores them in native byte order,
+  // they only get swapped when reading from or writing to a data stream
+  int16be,
+  int32be,
+  int64be,
+  uint16be,
+  uint32be,
+  uint64be,
+  float32be,
   runtime,
 
   custom,
 };
 
+inline bool isBigEndian(uint32_t type) {
+  return (type >= TypeId::int16be) && (type <= TypeId::float32be);
+}
+
+// maps a big endian type to the type with the same representation in the index
+inline TypeId nativeType(uint32_t type) {
+  switch (type) {
+    case TypeId::int16be: return TypeId::int16;
+    case TypeId::int32be: return TypeId::int32;
+    case TypeId::int64be: return TypeId::int64;
+    case TypeId::uint16be: return TypeId::uint16;
+    case TypeId::uint32be: return TypeId::uint32;
+    case TypeId::uint64be: return TypeId::uint64;
+    case TypeId::float32be: return TypeId::float32;
+    default: return static_cast<TypeId>(type);
+  }
+}
+
 class DynObject;
 
 typedef int32_t ObjSize;
@@ -1,8 +1,18 @@
 #include <catch.hpp>
+#include <future>
 #include <numeric>
 #include "../pagan/DynObject.h"
 #include "../pagan/TypeRegistry.h"
 #include "../pagan/TypeSpec.h"
+#include "../pagan/ThreadPool.h"
+#include "../pagan/BackgroundIndexer.h"
+#include "../pagan/IncrementalIndexer.h"
+#include "../pagan/ListView.h"
+#include "../pagan/byteorder.h"
+#include "../pagan/PropertyPath.h"
+#include "../pagan/expr.h"
+#include "../pagan/ExpressionCache.h"
+#include <thread>
 
 class SimpleFixture {
 protected:
@@ -152,6 +162,159 @@ public:
   }
 };
 
+class BigEndianFixture {
+protected:
+  std::shared_ptr<TypeRegistry> types;
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> testType;
+  std::shared_ptr<IOWrapper> testStream;
+  std::vector<uint8_t> buffer;
+
+public:
+  BigEndianFixture()
+    : types(TypeRegistry::init())
+    , testType(types->create("test"))
+    , buffer{ 0x00, 0x00, 0x01, 0x02, 0xFF, 0xFE,
+              0x00, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00, 0x04, 0x00, 0x05,
+              0x00, 0x06, 0x00, 0x07, 0x00, 0x08, 0x01, 0x00,
+              0x00, 0x00, 0x00, 0x2A, 0x12, 0x34, 0x56, 0x78 }
+  {
+    testType->appendProperty("num", TypeId::uint32be);
+    testType->appendProperty("neg", TypeId::int16be);
+    testType->appendProperty("lst", TypeId::uint16be)
+      .withCount([](const IScriptQuery&) { return 9; });
+    testType->appendProperty("rest", TypeId::uint32be)
+      .withRepeatToEOS();
+
+    testStream.reset(IOWrapper::memoryBuffer());
+    testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    streams.add(testStream);
+  }
+};
+
+class StaticLayoutFixture {
+protected:
+  std::shared_ptr<TypeRegistry> types;
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> testType;
+  std::shared_ptr<IOWrapper> testStream;
+  std::vector<uint8_t> buffer;
+
+public:
+  StaticLayoutFixture()
+    : types(TypeRegistry::init())
+    , testType(types->create("test"))
+    , buffer{ 0x2A, 0x00, 0x00, 0x00, 0x01, 0x02,
+              0x07, 0x00, 0x00, 0x00, 0x01, 0x00,
+              0xFF, 0x45 }
+  {
+    std::shared_ptr<TypeSpec> nestedType = types->create("nested");
+    nestedType->appendProperty("num", TypeId::uint16);
+    nestedType->appendProperty("big", TypeId::uint32be);
+
+    testType->appendProperty("num", TypeId::int32);
+    testType->appendProperty("short", TypeId::uint16be);
+    testType->appendProperty("nested", nestedType->getId());
+    testType->appendProperty("byte", TypeId::uint8);
+    testType->appendProperty("last", TypeId::int8);
+
+    testStream.reset(IOWrapper::memoryBuffer());
+    testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    streams.add(testStream);
+  }
+};
+
+class FixtureWithVariableSizeArray {
+protected:
+  std::shared_ptr<TypeRegistry> types;
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> listType;
+  std::shared_ptr<TypeSpec> itemType;
+  std::shared_ptr<IOWrapper> testStream;
+
+public:
+  static constexpr int NUM_ITEMS = 150;
+
+  FixtureWithVariableSizeArray()
+    : types(TypeRegistry::init())
+    , listType(types->create("list"))
+    , itemType(types->create("item"))
+  {
+    itemType->appendProperty("len", TypeId::uint8);
+    itemType->appendProperty("str", TypeId::string)
+      .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("len")); });
+
+    listType->appendProperty("list", itemType->getId())
+      .withRepeatToEOS();
+
+    testStream.reset(IOWrapper::memoryBuffer());
+
+    // item i contains the string representation of i
+    std::vector<uint8_t> buffer;
+    for (int i = 0; i < NUM_ITEMS; ++i) {
+      std::string str = std::to_string(i);
+      buffer.push_back(static_cast<uint8_t>(str.length()));
+      buffer.insert(buffer.end(), str.begin(), str.end());
+    }
+    testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    streams.add(testStream);
+  }
+};
+
+class FixtureWithNestedSizes {
+protected:
+  std::shared_ptr<TypeRegistry> types;
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> fileType;
+  std::shared_ptr<TypeSpec> recordType;
+  std::shared_ptr<TypeSpec> bodyType;
+  std::shared_ptr<TypeSpec> innerType;
+  std::shared_ptr<IOWrapper> testStream;
+
+public:
+  static constexpr int NUM_RECORDS = 100;
+
+  FixtureWithNestedSizes()
+    : types(TypeRegistry::init())
+    , fileType(types->create("file"))
+    , recordType(types->create("record"))
+    , bodyType(types->create("body"))
+    , innerType(types->create("inner"))
+  {
+    innerType->appendProperty("len", TypeId::uint8);
+    innerType->appendProperty("str", TypeId::string)
+      .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("len")); });
+
+    bodyType->appendProperty("size", TypeId::uint8);
+    bodyType->appendProperty("inner", innerType->getId())
+      .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("size")); });
+
+    recordType->appendProperty("size", TypeId::uint8);
+    recordType->appendProperty("body", bodyType->getId())
+      .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("size")); });
+
+    fileType->appendProperty("records", recordType->getId())
+      .withCount([](const IScriptQuery&) { return NUM_RECORDS; });
+
+    testStream.reset(IOWrapper::memoryBuffer());
+
+    // record i contains the string representation of i, wrapped in two size-delimited objects
+    std::vector<uint8_t> buffer;
+    for (int i = 0; i < NUM_RECORDS; ++i) {
+      std::string str = std::to_string(i);
+      buffer.push_back(static_cast<uint8_t>(str.length() + 2));
+      buffer.push_back(static_cast<uint8_t>(str.length() + 1));
+      buffer.push_back(static_cast<uint8_t>(str.length()));
+      buffer.insert(buffer.end(), str.begin(), str.end());
+    }
+    testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    streams.add(testStream);
+  }
+};
 
 TEST_CASE_METHOD(SimpleFixture, "can create simple", "[DynObject]") {
   ObjectIndex *index = indexTable.allocateObject(testType, 0, 0);
@@ -193,6 +356,37 @@ TEST_CASE_METHOD(SimpleFixture, "can edit simple", "[DynObject]") {
   REQUIRE(*reinterpret_cast<int32_t*>(output) == 69);
 }
 
+TEST_CASE_METHOD(SimpleFixture, "caches computed properties until their inputs change", "[DynObject]") {
+  int numCalls = 0;
+  testType->addComputed("double", [&numCalls](const IScriptQuery &obj) -> std::any {
+    ++numCalls;
+    return flexi_cast<int32_t>(obj.getAny("num")) * 2;
+  }, { "num" });
+  testType->addComputed("uncached", [&numCalls](const IScriptQuery &obj) -> std::any {
+    ++numCalls;
+    return flexi_cast<int32_t>(obj.getAny("num")) * 3;
+  });
+
+  ObjectIndex *index = indexTable.allocateObject(testType, 0, 0);
+
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  REQUIRE(obj.get<int32_t>("double") == 84);
+  REQUIRE(std::any_cast<int32_t>(obj.getAny("double")) == 84);
+  REQUIRE(numCalls == 1);
+
+  // results of functions with unknown inputs are never cached
+  REQUIRE(obj.get<int32_t>("uncached") == 126);
+  REQUIRE(obj.get<int32_t>("uncached") == 126);
+  REQUIRE(numCalls == 3);
+
+  obj.set<int32_t>("num", 10);
+  REQUIRE(obj.get<int32_t>("double") == 20);
+  REQUIRE(obj.get<int32_t>("double") == 20);
+  REQUIRE(numCalls == 4);
+}
+
 TEST_CASE_METHOD(SimpleFixture, "returns reasonable error", "[DynObject]") {
   ObjectIndex *index = indexTable.allocateObject(testType, 0, 0);
 
@@ -268,6 +462,35 @@ TEST_CASE_METHOD(FixtureWithParameters, "can access parameters", "[DynObject]")
   REQUIRE(std::any_cast<int>(test.getAny("in")) == 42);
 }
 
+TEST_CASE("passes enum arguments as integers", "[DynObject]") {
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> childType = types->create("child");
+  childType->appendParameter("k", TypeId::uint8);
+  std::shared_ptr<TypeSpec> parentType = types->create("parent");
+  parentType->addEnums({ { "record_type", { { 0, "rec" }, { 1, "grup" } } } });
+  parentType->appendProperty("kind", TypeId::uint8)
+    .withEnum("record_type");
+  parentType->appendProperty("child", childType->getId())
+    .withArguments(std::vector<std::string> { "kind" });
+
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  testStream->write("\x01", 1);
+  streams.add(testStream);
+
+  ObjectIndex *index = indexTable.allocateObject(parentType, 0, 0);
+  DynObject parent(parentType, streams, &indexTable, index, nullptr);
+  parent.writeIndex(0, testStream->size(), true);
+
+  DynObject child = parent.get<DynObject>("child");
+  REQUIRE(std::any_cast<uint8_t>(child.getAny("k")) == 1);
+  EnumResolver enums = [&child](const std::string &enumName, const std::string &key) -> std::optional<int64_t> {
+    return child.enumValue(enumName, key);
+  };
+  REQUIRE(compileExpression("k == record_type::grup", false, enums)->run(child).toBool());
+}
+
 TEST_CASE_METHOD(FixtureWithRTArray, "correctly indexes eos sized array of runtime custom types", "[DynObject]") {
   ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
 
@@ -293,3 +516,777 @@ TEST_CASE_METHOD(FixtureWithRTPODArray, "correctly indexes eos sized array of ru
   REQUIRE(items[5] == 13);
 }
 
+
+TEST_CASE_METHOD(BigEndianFixture, "reads big endian values", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  REQUIRE(obj.get<uint32_t>("num") == 258);
+  REQUIRE(obj.get<int16_t>("neg") == -2);
+
+  std::vector<uint16_t> list = obj.getList<uint16_t>("lst");
+  REQUIRE(list.size() == 9);
+  REQUIRE(list[0] == 1);
+  REQUIRE(list[7] == 8);
+  REQUIRE(list[8] == 256);
+
+  std::vector<uint32_t> rest = obj.getList<uint32_t>("rest");
+  REQUIRE(rest.size() == 2);
+  REQUIRE(rest[0] == 42);
+  REQUIRE(rest[1] == 0x12345678);
+}
+
+TEST_CASE("swaps arrays of big endian values", "[DynObject]") {
+  // enough items for the vectorized kernel plus a tail it leaves to the scalar loop
+  std::vector<uint8_t> input(16 * 5 + 7);
+  std::iota(input.begin(), input.end(), static_cast<uint8_t>(1));
+
+  for (size_t width : { 2, 4, 8 }) {
+    size_t count = input.size() / width;
+    std::vector<uint8_t> expected(input);
+    swapBytesArrayScalar(expected.data(), 0, count, width);
+    REQUIRE(expected[0] == width);
+    REQUIRE(expected[width - 1] == 1);
+
+    std::vector<uint8_t> swapped(input);
+    swapBytesArray(swapped.data(), count, width);
+    REQUIRE(swapped == expected);
+
+#ifdef PAGAN_SIMD_BSWAP
+    if (hasSIMDByteSwap()) {
+      std::vector<uint8_t> vectorized(input);
+      size_t done = swapBytesArraySIMD(vectorized.data(), count, width);
+      REQUIRE(done == (count * width / 16) * 16 / width);
+      swapBytesArrayScalar(vectorized.data(), done, count, width);
+      REQUIRE(vectorized == expected);
+    }
+#endif
+  }
+}
+
+TEST_CASE_METHOD(BigEndianFixture, "saves big endian values", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+  obj.set<int16_t>("neg", -3);
+
+  std::shared_ptr<IOWrapper> result(IOWrapper::memoryBuffer());
+  obj.saveTo(result);
+
+  std::vector<uint8_t> output(buffer.size());
+  result->read(reinterpret_cast<char*>(output.data()), output.size());
+
+  buffer[5] = 0xFD;
+  REQUIRE(output == buffer);
+}
+
+TEST_CASE_METHOD(StaticLayoutFixture, "indexes static layout", "[DynObject]") {
+  REQUIRE(testType->hasStaticLayout());
+
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  REQUIRE(obj.getKeys().size() == 5);
+  REQUIRE(obj.get<int32_t>("num") == 42);
+  REQUIRE(obj.get<uint16_t>("short") == 0x0102);
+  REQUIRE(obj.get<uint8_t>("byte") == 0xFF);
+  REQUIRE(obj.get<int8_t>("last") == 0x45);
+
+  DynObject nested = obj.get<DynObject>("nested");
+  REQUIRE(nested.get<uint16_t>("num") == 7);
+  REQUIRE(nested.get<uint32_t>("big") == 256);
+
+  std::shared_ptr<IOWrapper> result(IOWrapper::memoryBuffer());
+  obj.saveTo(result);
+
+  std::vector<uint8_t> output(buffer.size());
+  result->read(reinterpret_cast<char*>(output.data()), output.size());
+  REQUIRE(output == buffer);
+}
+
+TEST_CASE("finds properties following ones that aren't present", "[DynObject]") {
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> testType = types->create("test");
+  testType->appendProperty("flag", TypeId::int8);
+  testType->appendProperty("optional", TypeId::int32)
+    .withCondition([](const IScriptQuery &obj) { return flexi_cast<int8_t>(obj.getAny("flag")) != 0; });
+  testType->appendProperty("num", TypeId::int32);
+
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  std::vector<uint8_t> buffer{ 0x00, 0x2A, 0x00, 0x00, 0x00 };
+  testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  streams.add(testStream);
+
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  REQUIRE(std::any_cast<int32_t>(obj.getAny("num")) == 42);
+  REQUIRE(obj.get<int32_t>("num") == 42);
+  REQUIRE(PropertyPath("num").getValue(obj).toInteger() == 42);
+  REQUIRE_THROWS(obj.get<int32_t>("optional"));
+}
+
+TEST_CASE("skips properties that are never present", "[DynObject]") {
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> testType = types->create("test");
+  testType->appendProperty("never", TypeId::int32).withStaticCondition(false);
+  testType->appendProperty("num", TypeId::int32);
+  REQUIRE(testType->hasStaticLayout());
+
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  std::vector<uint8_t> buffer{ 0x2A, 0x00, 0x00, 0x00 };
+  testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  streams.add(testStream);
+
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  REQUIRE(obj.getKeys() == std::vector<std::string>{ "num" });
+  REQUIRE(obj.get<int32_t>("num") == 42);
+}
+
+TEST_CASE_METHOD(StaticLayoutFixture, "reads static children without indexing them", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  uint32_t numObjects = indexTable.numObjectIndices();
+
+  DynObject nested = obj.get<DynObject>("nested");
+  REQUIRE(nested.isLazy());
+  REQUIRE(nested.get<uint32_t>("big") == 256);
+  REQUIRE(std::any_cast<uint16_t>(obj.getAny(std::string("nested.num"))) == 7);
+  REQUIRE(indexTable.numObjectIndices() == numObjects);
+}
+
+TEST_CASE_METHOD(StaticLayoutFixture, "indexes static children on edit", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  DynObject nested = obj.get<DynObject>("nested");
+  nested.set<uint32_t>("big", 0x01020304);
+  REQUIRE(!nested.isLazy());
+
+  // the edit has to be visible through the parent
+  REQUIRE(!obj.get<DynObject>("nested").isLazy());
+  REQUIRE(std::any_cast<uint32_t>(obj.getAny(std::string("nested.big"))) == 0x01020304);
+
+  std::shared_ptr<IOWrapper> result(IOWrapper::memoryBuffer());
+  obj.saveTo(result);
+
+  std::vector<uint8_t> output(buffer.size());
+  result->read(reinterpret_cast<char*>(output.data()), output.size());
+  REQUIRE(output[8] == 0x01);
+  REQUIRE(output[11] == 0x04);
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "can access items of unindexed eos array", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  REQUIRE(list.getListItem("list", 130).get<std::string>("str") == "130");
+  REQUIRE(list.getListItem("list", 10).get<std::string>("str") == "10");
+  REQUIRE(list.getListItem("list", 149).get<std::string>("str") == "149");
+  REQUIRE(list.getListItem("list", 64).get<std::string>("str") == "64");
+  REQUIRE_THROWS(list.getListItem("list", NUM_ITEMS));
+
+  // indexing the whole array still works after that
+  std::vector<DynObject> items = list.getList<DynObject>("list");
+  REQUIRE(items.size() == NUM_ITEMS);
+  REQUIRE(items[99].get<std::string>("str") == "99");
+  REQUIRE(list.getListItem("list", 42).get<std::string>("str") == "42");
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "only indexes the accessed items of unindexed eos array", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  // the items in front of the requested one are located from their headers
+  uint32_t before = indexTable.numObjectIndices();
+  REQUIRE(list.getListItem("list", 149).get<std::string>("str") == "149");
+  REQUIRE(indexTable.numObjectIndices() - before == 1);
+
+  for (int i = 0; i < NUM_ITEMS; ++i) {
+    REQUIRE(list.getListItem("list", i).get<std::string>("str") == std::to_string(i));
+  }
+  REQUIRE(indexTable.numObjectIndices() - before == NUM_ITEMS);
+
+  // items located before are reused rather than indexed again
+  REQUIRE(list.getListItem("list", 130).get<std::string>("str") == "130");
+  REQUIRE(list.getListItem("list", 7).get<std::string>("str") == "7");
+  REQUIRE(indexTable.numObjectIndices() - before == NUM_ITEMS);
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "items of unindexed eos array keep their changes", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  SECTION("sequentially") {
+  }
+
+  SECTION("in parallel") {
+    types->setIndexPool(std::make_shared<ThreadPool>(4));
+  }
+
+  list.getListItem("list", 1).set<std::string>("str", "x");
+  list.getListItem("list", 140).set<std::string>("str", "y");
+  REQUIRE(list.getListItem("list", 1).get<std::string>("str") == "x");
+
+  std::vector<DynObject> items = list.getList<DynObject>("list");
+  REQUIRE(items.size() == NUM_ITEMS);
+  REQUIRE(items[0].get<std::string>("str") == "0");
+  REQUIRE(items[1].get<std::string>("str") == "x");
+  REQUIRE(items[139].get<std::string>("str") == "139");
+  REQUIRE(items[140].get<std::string>("str") == "y");
+  REQUIRE(list.getListItem("list", 140).get<std::string>("str") == "y");
+}
+
+TEST_CASE("static items of unindexed eos array keep their changes", "[DynObject]") {
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> itemType = types->create("item");
+  itemType->appendProperty("num", TypeId::int32);
+  std::shared_ptr<TypeSpec> listType = types->create("list");
+  listType->appendProperty("list", itemType->getId())
+    .withRepeatToEOS();
+  REQUIRE(itemType->hasStaticLayout());
+
+  std::vector<int32_t> values{ 1, 2, 3, 4 };
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  testStream->write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(int32_t));
+  streams.add(testStream);
+
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  list.getListItem("list", 2).set<int32_t>("num", 42);
+  REQUIRE(list.getListItem("list", 2).get<int32_t>("num") == 42);
+  REQUIRE(list.getListItem("list", 3).get<int32_t>("num") == 4);
+
+  std::vector<DynObject> items = list.getList<DynObject>("list");
+  REQUIRE(items.size() == 4);
+  REQUIRE(items[1].get<int32_t>("num") == 2);
+  REQUIRE(items[2].get<int32_t>("num") == 42);
+}
+
+TEST_CASE("keeps checkpoints of located items", "[DynObject]") {
+  ObjectIndexTable indexTable;
+  uint8_t arrayProp[8];
+
+  DataOffset offset;
+  REQUIRE(indexTable.scanPosition(arrayProp, 10, 100, offset) == 0);
+  REQUIRE(offset == 100);
+
+  // item i is 2 bytes large
+  for (ObjSize i = 0; i < 200; ++i) {
+    indexTable.addLocatedItem(arrayProp, i, 100 + i * 2, 102 + i * 2);
+  }
+  // not the next item, ignored
+  indexTable.addLocatedItem(arrayProp, 300, 0, 0);
+
+  REQUIRE(indexTable.scanPosition(arrayProp, 150, 100, offset) == 2 * CHECKPOINT_INTERVAL);
+  REQUIRE(offset == 100 + 2 * CHECKPOINT_INTERVAL * 2);
+  REQUIRE(indexTable.scanPosition(arrayProp, 63, 100, offset) == 0);
+  REQUIRE(indexTable.scanPosition(arrayProp, 250, 100, offset) == 200);
+  REQUIRE(offset == 500);
+
+  REQUIRE(indexTable.sealScannedItems(arrayProp).checkpoints.size() == 4);
+  ObjectIndexTable::ScannedItem item;
+  REQUIRE_FALSE(indexTable.addScannedItem(arrayProp, 5, item));
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "types can be shared between concurrent parses", "[DynObject]") {
+  std::vector<std::future<bool>> results;
+  for (int i = 0; i < 4; ++i) {
+    std::shared_ptr<StreamRegistry> ownStreams = streams.fork();
+    results.push_back(std::async(std::launch::async, [this, ownStreams]() {
+      ObjectIndexTable ownTable;
+      ObjectIndex* index = ownTable.allocateObject(listType, 0, 0);
+      DynObject list(listType, *ownStreams, &ownTable, index, nullptr);
+      list.writeIndex(0, ownStreams->get(0)->size(), true);
+
+      std::vector<DynObject> items = list.getList<DynObject>("list");
+      bool res = items.size() == NUM_ITEMS;
+      for (int i = 0; res && (i < NUM_ITEMS); ++i) {
+        res = items[i].get<std::string>("str") == std::to_string(i);
+      }
+      return res;
+    }));
+  }
+
+  for (std::future<bool> &result : results) {
+    REQUIRE(result.get());
+  }
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "parsed objects can be read from several threads", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  // all threads race to index the array and its items lazily
+  std::vector<std::future<bool>> results;
+  for (int i = 0; i < 4; ++i) {
+    results.push_back(std::async(std::launch::async, [list, i]() {
+      bool res = list.getListItem("list", 100 + i).get<std::string>("str") == std::to_string(100 + i);
+      std::vector<DynObject> items = list.getList<DynObject>("list");
+      res = res && (items.size() == NUM_ITEMS);
+      for (int j = 0; res && (j < NUM_ITEMS); ++j) {
+        res = items[j].get<std::string>("str") == std::to_string(j);
+      }
+      return res;
+    }));
+  }
+
+  for (std::future<bool> &result : results) {
+    REQUIRE(result.get());
+  }
+  REQUIRE(list.getListItem("list", 42).get<std::string>("str") == "42");
+}
+
+TEST_CASE("lists of numbers can be read from several threads", "[DynObject]") {
+  static const uint32_t NUM_VALUES = 5000;
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> testType = types->create("test");
+  testType->appendProperty("nums", TypeId::uint32)
+    .withRepeatToEOS();
+
+  std::vector<uint32_t> values(NUM_VALUES);
+  std::iota(values.begin(), values.end(), 0);
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  testStream->write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(uint32_t));
+  streams.add(testStream);
+
+  ObjectIndex* index = indexTable.allocateObject(testType, 0, 0);
+  DynObject obj(testType, streams, &indexTable, index, nullptr);
+  obj.writeIndex(0, testStream->size(), true);
+
+  // all threads race to index the array
+  std::vector<std::future<bool>> results;
+  for (int i = 0; i < 4; ++i) {
+    results.push_back(std::async(std::launch::async, [obj, &values]() {
+      return obj.getList<uint32_t>("nums") == values;
+    }));
+  }
+
+  for (std::future<bool> &result : results) {
+    REQUIRE(result.get());
+  }
+  REQUIRE(obj.getList<uint32_t>("nums") == values);
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "list views materialize items on access", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  ListView items = list.getListView("list");
+  REQUIRE(items.size() == NUM_ITEMS);
+  REQUIRE(items[123].get<std::string>("str") == "123");
+  REQUIRE_THROWS(items.at(NUM_ITEMS));
+
+  auto found = std::find_if(items.begin(), items.end(), [](const DynObject &item) {
+    return item.get<std::string>("str") == "42";
+  });
+  REQUIRE(found != items.end());
+  REQUIRE(found - items.begin() == 42);
+  REQUIRE(found->get<uint8_t>("len") == 2);
+  REQUIRE((found + 10)->get<std::string>("str") == "52");
+
+  int count = 0;
+  for (const DynObject &item : items) {
+    REQUIRE(item.get<std::string>("str") == std::to_string(count++));
+  }
+  REQUIRE(count == NUM_ITEMS);
+
+  // iterators remain usable after the view they came from is gone
+  ListView::const_iterator first = list.getListView("list").begin();
+  REQUIRE((first + 7)->get<std::string>("str") == "7");
+  auto last = std::find_if(list.getListView("list").begin(), list.getListView("list").end(), [](const DynObject &item) {
+    return item.get<std::string>("str") == std::to_string(NUM_ITEMS - 1);
+  });
+  REQUIRE(last - first == NUM_ITEMS - 1);
+}
+
+TEST_CASE("selects list items by comparing a column", "[DynObject]") {
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  std::shared_ptr<ExpressionCache> expressions = std::make_shared<ExpressionCache>();
+  types->setExpressions(expressions);
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> recordType = types->create("record");
+  recordType->appendProperty("id", TypeId::uint16be);
+  recordType->appendProperty("flags", TypeId::uint8);
+  std::shared_ptr<TypeSpec> listType = types->create("list");
+  listType->appendProperty("list", recordType->getId())
+    .withRepeatToEOS();
+
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  std::vector<uint8_t> buffer;
+  for (int i = 0; i < 100; ++i) {
+    buffer.insert(buffer.end(), { 0x00, static_cast<uint8_t>(i), static_cast<uint8_t>(i % 4) });
+  }
+  testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  streams.add(testStream);
+
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  ListView items = list.getListView("list");
+  REQUIRE(items.select("id >= 97") == std::vector<size_t>{ 97, 98, 99 });
+  REQUIRE(items.select("3 > id") == std::vector<size_t>{ 0, 1, 2 });
+
+  // edited items are read from their index
+  items[10].set<uint8_t>("flags", 1);
+  std::vector<size_t> odd = items.select("(flags & 1) != 0");
+  REQUIRE(odd.size() == 51);
+  REQUIRE(std::find(odd.begin(), odd.end(), 10) != odd.end());
+
+  // not a simple comparison, evaluated per item
+  REQUIRE(items.select("(id < 8) && (flags == 2)") == std::vector<size_t>{ 2, 6 });
+
+  // repeated selections reuse the compiled expression
+  REQUIRE(items.select("id >= 97").size() == 3);
+  REQUIRE(expressions->size() == 4);
+}
+
+TEST_CASE("compares enums as integers", "[DynObject]") {
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> recordType = types->create("record");
+  recordType->appendProperty("id", TypeId::uint8);
+  recordType->appendProperty("kind", TypeId::uint8)
+    .withEnum("record_type");
+  std::shared_ptr<TypeSpec> listType = types->create("list");
+  // the enum is defined by the parent of the items
+  listType->addEnums({ { "record_type", { { 0, "rec" }, { 1, "grup" } } } });
+  listType->appendProperty("list", recordType->getId())
+    .withRepeatToEOS();
+
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  std::vector<uint8_t> buffer;
+  for (int i = 0; i < 10; ++i) {
+    buffer.insert(buffer.end(), { static_cast<uint8_t>(i), static_cast<uint8_t>(i % 3 == 0 ? 1 : 0) });
+  }
+  testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  streams.add(testStream);
+
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  ListView items = list.getListView("list");
+  // names only when asked for explicitly
+  REQUIRE(std::any_cast<std::string>(items[3].getAny(std::string("kind"))) == "record_type::grup");
+  REQUIRE(items.select("kind == record_type::grup") == std::vector<size_t>{ 0, 3, 6, 9 });
+  REQUIRE(items.select("(id < 3) && (kind != record_type::grup)") == std::vector<size_t>{ 1, 2 });
+  REQUIRE_THROWS(items.select("kind == record_type::invalid"));
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "object handles convert back to objects", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  std::vector<ObjectHandle> handles = list.getListHandles("list");
+  REQUIRE(handles.size() == NUM_ITEMS);
+  REQUIRE(handles[123].getTypeId() == itemType->getId());
+
+  DynObject item = handles[123].toObject(list, &list);
+  REQUIRE(item.get<std::string>("str") == "123");
+  REQUIRE(item.handle() == handles[123]);
+  REQUIRE_FALSE(ObjectHandle().isValid());
+  REQUIRE_THROWS(ObjectHandle().toObject(list));
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "background indexer runs ahead of the consumer", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  BackgroundIndexer indexer(list, BackgroundIndexer::Budget());
+  for (int i = 0; (i < 500) && !indexer.isDone(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  REQUIRE(indexer.isDone());
+  REQUIRE(indexer.numVisited() == NUM_ITEMS + 1);
+
+  // the array is already indexed so accessing it doesn't allocate anything
+  size_t memoryBefore = indexTable.memoryUsage();
+  std::vector<DynObject> items = list.getList<DynObject>("list");
+  REQUIRE(items.size() == NUM_ITEMS);
+  REQUIRE(items[123].get<std::string>("str") == "123");
+  REQUIRE(indexTable.memoryUsage() == memoryBefore);
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "indexes incrementally", "[DynObject]") {
+  IncrementalIndexer indexer(itemType, streams, &indexTable, 0, 0, true);
+
+  // zero length slices suspend the indexer whenever it reports progress
+  while ((indexer.numItems() == 0) && indexer.step(std::chrono::milliseconds(0))) {
+  }
+  REQUIRE(indexer.getState() == IncrementalIndexer::State::INDEXING);
+  IncrementalIndexer::Progress progress = indexer.getProgress();
+  REQUIRE(progress.bytesConsumed > 0);
+  REQUIRE(progress.bytesConsumed < progress.bytesTotal);
+  std::vector<DynObject> partial = indexer.getItems(10);
+  REQUIRE(partial.size() == indexer.numItems());
+  REQUIRE(partial[0].get<std::string>("str") == "0");
+
+  SECTION("runs to completion") {
+    int numSteps = 0;
+    while (indexer.step(std::chrono::milliseconds(0))) {
+      ++numSteps;
+    }
+    REQUIRE(numSteps > 1);
+    REQUIRE(indexer.getState() == IncrementalIndexer::State::DONE);
+    REQUIRE(indexer.getProgress().bytesConsumed == progress.bytesTotal);
+    REQUIRE(indexer.getProgress().itemsIndexed == NUM_ITEMS);
+    std::vector<DynObject> items = indexer.getItems(NUM_ITEMS);
+    REQUIRE(items.size() == NUM_ITEMS);
+    REQUIRE(items[123].get<std::string>("str") == "123");
+  }
+
+  SECTION("can be canceled") {
+    indexer.cancel();
+    REQUIRE(indexer.getState() == IncrementalIndexer::State::CANCELED);
+    REQUIRE_FALSE(indexer.step(std::chrono::milliseconds(0)));
+    REQUIRE(indexer.numItems() < NUM_ITEMS);
+    REQUIRE(indexer.getItems(1)[0].get<std::string>("str") == "0");
+  }
+}
+
+TEST_CASE_METHOD(FixtureWithVariableSizeArray, "indexes eos array in parallel", "[DynObject]") {
+  types->setIndexPool(std::make_shared<ThreadPool>(4));
+  REQUIRE(itemType->hasBoundaries());
+
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  std::vector<DynObject> items = list.getList<DynObject>("list");
+  REQUIRE(items.size() == NUM_ITEMS);
+  for (int i = 0; i < NUM_ITEMS; ++i) {
+    REQUIRE(items[i].get<std::string>("str") == std::to_string(i));
+  }
+  REQUIRE(list.getListItem("list", 77).get<std::string>("str") == "77");
+
+  // saving reproduces the input
+  std::shared_ptr<IOWrapper> result(IOWrapper::memoryBuffer());
+  list.saveTo(result);
+  REQUIRE(result->size() == testStream->size());
+}
+
+TEST_CASE("locates items with wide headers from their boundaries", "[DynObject]") {
+  static const int NUM_HEADER_FIELDS = 80;
+  static const int NUM_ITEMS = 20;
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  std::shared_ptr<TypeSpec> listType = types->create("list");
+  std::shared_ptr<TypeSpec> itemType = types->create("item");
+  // the header takes more index space than fits on the stack
+  for (int i = 0; i < NUM_HEADER_FIELDS; ++i) {
+    itemType->appendProperty(("h" + std::to_string(i)).c_str(), TypeId::uint8);
+  }
+  itemType->appendProperty("len", TypeId::uint8);
+  itemType->appendProperty("str", TypeId::string)
+    .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("len")); });
+  listType->appendProperty("list", itemType->getId())
+    .withRepeatToEOS();
+  REQUIRE(itemType->hasBoundaries());
+
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  std::vector<uint8_t> buffer;
+  for (int i = 0; i < NUM_ITEMS; ++i) {
+    std::string str = std::to_string(i);
+    buffer.insert(buffer.end(), NUM_HEADER_FIELDS, static_cast<uint8_t>(i));
+    buffer.push_back(static_cast<uint8_t>(str.length()));
+    buffer.insert(buffer.end(), str.begin(), str.end());
+  }
+  testStream->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  streams.add(testStream);
+
+  ObjectIndex* index = indexTable.allocateObject(listType, 0, 0);
+  DynObject list(listType, streams, &indexTable, index, nullptr);
+  list.writeIndex(0, testStream->size(), true);
+
+  uint32_t before = indexTable.numObjectIndices();
+  DynObject item = list.getListItem("list", NUM_ITEMS - 1);
+  REQUIRE(indexTable.numObjectIndices() - before == 1);
+  REQUIRE(item.get<std::string>("str") == std::to_string(NUM_ITEMS - 1));
+  REQUIRE(item.get<uint8_t>(("h" + std::to_string(NUM_HEADER_FIELDS - 1)).c_str()) == NUM_ITEMS - 1);
+}
+
+TEST_CASE_METHOD(FixtureWithNestedSizes, "parent links outlive the objects they came from", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(fileType, 0, 0);
+
+  DynObject file(fileType, streams, &indexTable, index, nullptr);
+  file.writeIndex(0, testStream->size(), true);
+
+  // none of the intermediate objects exist any more when inner is used
+  auto getInner = [&](int record) {
+    return file.getList<DynObject>("records")[record].get<DynObject>("body").get<DynObject>("inner");
+  };
+  DynObject inner = getInner(42);
+
+  DynObject body = inner.get<DynObject>("_parent");
+  REQUIRE(body.getTypeId() == bodyType->getId());
+  REQUIRE(body.get<uint8_t>("size") == 3);
+  REQUIRE(body.get<DynObject>("_parent").getTypeId() == recordType->getId());
+  REQUIRE(inner.get<DynObject>("_root").getIndex() == file.getIndex());
+  REQUIRE(std::any_cast<uint8_t>(inner.getAny(std::string("_parent._parent.size"))) == 4);
+
+  // paths follow the same links
+  PropertyPath grandParentSize("_parent._parent.size");
+  REQUIRE(std::any_cast<uint8_t>(grandParentSize.get(inner)) == 4);
+  REQUIRE(grandParentSize.getValue(getInner(7)).toInteger() == 3);
+}
+
+TEST_CASE("property paths serve objects of different types", "[DynObject]") {
+  std::shared_ptr<TypeRegistry> types(TypeRegistry::init());
+  StreamRegistry streams;
+  ObjectIndexTable indexTable;
+  // "num" is at a different position in each type
+  std::shared_ptr<TypeSpec> firstType = types->create("first");
+  firstType->appendProperty("num", TypeId::uint8);
+  std::shared_ptr<TypeSpec> secondType = types->create("second");
+  secondType->appendProperty("pad", TypeId::uint16);
+  secondType->appendProperty("len", TypeId::uint8);
+  secondType->appendProperty("str", TypeId::string)
+    .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("len")); });
+  secondType->appendProperty("num", TypeId::uint8);
+
+  std::shared_ptr<IOWrapper> testStream(IOWrapper::memoryBuffer());
+  testStream->write("\x01\x00\x00\x02" "ab" "\x03", 7);
+  streams.add(testStream);
+
+  DynObject first(firstType, streams, &indexTable, indexTable.allocateObject(firstType, 0, 0), nullptr);
+  first.writeIndex(0, 1, true);
+  DynObject second(secondType, streams, &indexTable, indexTable.allocateObject(secondType, 0, 1), nullptr);
+  second.writeIndex(1, 7, true);
+
+  std::shared_ptr<const ExpressionProgram> program = compileExpression("num * 2");
+  for (int pass = 0; pass < 2; ++pass) {
+    REQUIRE(program->run(first).toInteger() == 2);
+    REQUIRE(program->run(second).toInteger() == 6);
+  }
+}
+
+TEST_CASE_METHOD(FixtureWithNestedSizes, "property paths follow indexed children", "[DynObject]") {
+  ObjectIndex* index = indexTable.allocateObject(fileType, 0, 0);
+
+  DynObject file(fileType, streams, &indexTable, index, nullptr);
+  file.writeIndex(0, testStream->size(), true);
+
+  PropertyPath str("body.inner.str");
+  PropertyPath inner("body.inner");
+  PropertyPath parentSize("body.inner._parent.size");
+  std::vector<DynObject> records = file.getList<DynObject>("records");
+  // evaluate everything twice, the first time children may not be indexed yet
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < NUM_RECORDS; ++i) {
+      REQUIRE(std::any_cast<std::string>(str.get(records[i])) == std::to_string(i));
+      REQUIRE(inner.getObject(records[i]).get<uint8_t>("len") == std::to_string(i).length());
+      REQUIRE(std::any_cast<uint8_t>(records[i].getAny(parentSize)) == std::to_string(i).length() + 1);
+    }
+  }
+
+  REQUIRE_THROWS(PropertyPath("body.missing").get(records[0]));
+}
+
+TEST_CASE_METHOD(FixtureWithNestedSizes, "indexes size-delimited children in parallel", "[DynObject]") {
+  types->setIndexPool(std::make_shared<ThreadPool>(4));
+  types->setIndexSubtrees(true);
+
+  ObjectIndex* index = indexTable.allocateObject(fileType, 0, 0);
+
+  DynObject file(fileType, streams, &indexTable, index, nullptr);
+  file.writeIndex(0, testStream->size(), true);
+
+  std::vector<DynObject> records = file.getList<DynObject>("records");
+  REQUIRE(records.size() == NUM_RECORDS);
+  for (int i = 0; i < NUM_RECORDS; ++i) {
+    DynObject inner = records[i].get<DynObject>("body").get<DynObject>("inner");
+    REQUIRE(inner.get<std::string>("str") == std::to_string(i));
+  }
+
+  std::shared_ptr<IOWrapper> result(IOWrapper::memoryBuffer());
+  file.saveTo(result);
+  REQUIRE(result->size() == testStream->size());
+}
+
+TEST_CASE_METHOD(FixtureWithNestedSizes, "retries only the children that failed in parallel", "[DynObject]") {
+  types->setIndexPool(std::make_shared<ThreadPool>(4));
+  types->setIndexSubtrees(true);
+
+  // same layout as the fixture but inner objects with a single digit can't be indexed on a worker
+  std::thread::id mainThread = std::this_thread::get_id();
+  std::atomic<int> numSized{ 0 };
+  std::shared_ptr<TypeSpec> flakyInner = types->create("flaky_inner");
+  flakyInner->appendProperty("len", TypeId::uint8);
+  flakyInner->appendProperty("str", TypeId::string)
+    .withSize([&](const IScriptQuery &obj) -> ObjSize {
+      ++numSized;
+      uint8_t len = std::any_cast<uint8_t>(obj.getAny("len"));
+      if ((len == 1) && (std::this_thread::get_id() != mainThread)) {
+        throw std::runtime_error("not on a worker");
+      }
+      return len;
+    });
+  std::shared_ptr<TypeSpec> flakyBody = types->create("flaky_body");
+  flakyBody->appendProperty("size", TypeId::uint8);
+  flakyBody->appendProperty("inner", flakyInner->getId())
+    .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("size")); });
+  std::shared_ptr<TypeSpec> flakyRecord = types->create("flaky_record");
+  flakyRecord->appendProperty("size", TypeId::uint8);
+  flakyRecord->appendProperty("body", flakyBody->getId())
+    .withSize([](const IScriptQuery &obj) -> ObjSize { return std::any_cast<uint8_t>(obj.getAny("size")); });
+  std::shared_ptr<TypeSpec> flakyFile = types->create("flaky_file");
+  flakyFile->appendProperty("records", flakyRecord->getId())
+    .withCount([](const IScriptQuery&) { return NUM_RECORDS; });
+
+  ObjectIndex* index = indexTable.allocateObject(flakyFile, 0, 0);
+
+  DynObject file(flakyFile, streams, &indexTable, index, nullptr);
+  file.writeIndex(0, testStream->size(), true);
+
+  // the ten failed children got indexed once more, nothing else
+  REQUIRE(numSized == NUM_RECORDS + 10);
+  std::vector<DynObject> records = file.getList<DynObject>("records");
+  for (int i = 0; i < NUM_RECORDS; ++i) {
+    DynObject inner = records[i].get<DynObject>("body").get<DynObject>("inner");
+    REQUIRE(inner.get<std::string>("str") == std::to_string(i));
+  }
+}
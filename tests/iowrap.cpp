@@ -1,5 +1,6 @@
 #include <catch.hpp>
 #include "../pagan/iowrap.h"
+#include <memory>
 
 TEST_CASE("can read&write in memory", "[iowrap]") {
   IOWrapper *wrap = IOWrapper::memoryBuffer();
@@ -19,5 +20,31 @@ TEST_CASE("can read&write in memory", "[iowrap]") {
   REQUIRE(wrap->size() == 7);
 }
 
+TEST_CASE("readers share the data of a memory buffer", "[iowrap]") {
+  std::unique_ptr<IOWrapper> wrap(IOWrapper::memoryBuffer());
+  wrap->write("foobarf", 7);
+
+  std::unique_ptr<IOWrapper> first(wrap->reader());
+  std::unique_ptr<IOWrapper> second(first->reader());
+  char buffer[4];
+  memset(buffer, 0, 4);
+  first->seekg(3);
+  first->read(buffer, 3);
+  REQUIRE(memcmp(buffer, "bar", 3) == 0);
+  // each reader has its own position
+  second->seekg(0);
+  REQUIRE(second->get() == 'f');
+  REQUIRE(first->get() == 'f');
+  REQUIRE(second->size() == 7);
+
+  // readers opened after a write see the change
+  wrap->seekp(0);
+  wrap->write("g", 1);
+  std::unique_ptr<IOWrapper> third(wrap->reader());
+  third->seekg(0);
+  REQUIRE(third->get() == 'g');
+  REQUIRE(second->get() == 'o');
+}
+
 // TODO test file streaming
 
@@ -92,3 +92,74 @@ TEST_CASE_METHOD(SimpleFixture, "spec has sensible defaults", "[typespec]") {
   REQUIRE(prop.isValidated == false);
   REQUIRE(prop.key == "prop1");
 }
+
+TEST_CASE_METHOD(SimpleFixture, "compiles static layout", "[typespec]") {
+  auto inner = registry->create("layout_inner");
+  inner->appendProperty("a", TypeId::uint16);
+  inner->appendProperty("b", TypeId::uint32be);
+
+  auto spec = registry->create("layout_outer");
+  spec->appendProperty("prop1", TypeId::int32);
+  spec->appendProperty("prop2", inner->getId());
+  spec->appendProperty("prop3", TypeId::float32);
+
+  REQUIRE(inner->hasStaticLayout());
+  REQUIRE(spec->hasStaticLayout());
+  REQUIRE(spec->getStaticSize() == 14);
+
+  auto dynamic = registry->create("layout_dynamic");
+  dynamic->appendProperty("prop1", TypeId::int32);
+  dynamic->appendProperty("prop2", TypeId::stringz);
+
+  REQUIRE(!dynamic->hasStaticLayout());
+}
+
+TEST_CASE_METHOD(SimpleFixture, "keeps static size with static sizes and conditions", "[typespec]") {
+  auto spec = registry->create("static_conditions");
+  spec->appendProperty("prop1", TypeId::int32);
+  spec->appendProperty("never", TypeId::int32).withStaticCondition(false);
+  spec->appendProperty("always", TypeId::int16).withStaticCondition(true);
+
+  REQUIRE(spec->hasStaticLayout());
+  REQUIRE(spec->getStaticSize() == 6);
+
+  spec->appendProperty("magic", TypeId::bytes).withStaticSize(4);
+
+  // can still be skipped but not read without indexing
+  REQUIRE(spec->getStaticSize() == 10);
+  REQUIRE(!spec->hasStaticLayout());
+}
+
+TEST_CASE_METHOD(SimpleFixture, "tracks which properties expressions read", "[typespec]") {
+  auto spec = registry->create("dependencies");
+  spec->appendProperty("len", TypeId::int32);
+  spec->appendProperty("header", TypeId::int32);
+  spec->appendProperty("data", TypeId::bytes)
+    .withSize([](const IScriptQuery &obj) -> ObjSize { return flexi_cast<ObjSize>(obj.getAny("len")); })
+    .withDependencies({ "len", "_parent.len" });
+  spec->appendProperty("extra", TypeId::bytes)
+    .withSize([](const IScriptQuery &) -> ObjSize { return 4; })
+    .withDependencies({ "header.size" });
+
+  REQUIRE(spec->getDependents("len") == std::vector<std::string>{ "data" });
+  REQUIRE(spec->getDependents("header") == std::vector<std::string>{ "extra" });
+  REQUIRE(spec->getDependents("head").empty());
+}
+
+TEST_CASE("compiles switch cases into lookup tables", "[typespec]") {
+  SwitchTable numbers({ { 1, 100 }, { 2, 101 }, { 5, 102 }, { -3, 103 }, { "_", 104 } });
+  REQUIRE(numbers.find(5) == 102);
+  REQUIRE(numbers.find(-3) == 103);
+  REQUIRE(numbers.find(3) == 104);
+
+  SwitchTable sparse({ { 1, 100 }, { 1000000, 101 } });
+  REQUIRE(sparse.find(1000000) == 101);
+  REQUIRE(sparse.find(2) == SwitchTable::NO_MATCH);
+
+  SwitchTable tags({ { "GRUP", 100 }, { "TES4", 101 }, { "AB", 102 }, { "LONG_NAME", 103 } });
+  REQUIRE(tags.find(std::string("TES4")) == 101);
+  REQUIRE(tags.find(std::string("AB")) == 102);
+  REQUIRE(tags.find(std::string("AB\0", 3)) == SwitchTable::NO_MATCH);
+  REQUIRE(tags.find(std::string("LONG_NAME")) == 103);
+  REQUIRE(tags.find(std::string("WEAP")) == SwitchTable::NO_MATCH);
+}